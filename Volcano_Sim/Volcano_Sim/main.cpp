@@ -9,6 +9,20 @@
 #include "../include/cloud.h"
 #include "../include/weather.h"
 #include "../include/formulas.h"
+#include "../include/wind_field.h"
+#include "../include/terrain_wind.h"
+#include "../include/plume_model.h"
+#include "../include/ballistic_table.h"
+#include "../include/gl_loader.h"
+#include "../include/terrain_renderer.h"
+#include "../include/particle_renderer.h"
+#include "../include/deposit_map.h"
+#include "../include/density_splat.h"
+#include "../include/particle_trails.h"
+#include "../include/frame_budget.h"
+#include "../include/headless_renderer.h"
+#include "../include/startup_tasks.h"
+#include "../include/scenario.h"
 #include <gdal_priv.h>
 #include <thread>
 #include <chrono>
@@ -17,6 +31,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <streambuf>
+#include <filesystem>
 #include <GL/glut.h>
 #include <imgui.h>
 #include <imgui_impl_glfw.h> 
@@ -28,7 +43,6 @@
 
 using namespace std;
 
-struct NullBuffer : streambuf { int overflow(int c) override { return c; } };
 void Wait(int milliseconds) { this_thread::sleep_for(chrono::milliseconds(milliseconds)); }
 
 void renderText(float x, float y, const char* text, void* font = GLUT_BITMAP_HELVETICA_18) {
@@ -58,9 +72,148 @@ void drawRectOutline(float x, float y, float width, float height, float r, float
     glEnd();
 }
 
-int main(int argc, char** argv) {
-    glutInit(&argc, argv);
+// Tryb wsadowy bez okna: symulacja z parametrami domyslnymi menu, klatki PNG
+// co frameInterval sekund czasu symulacji z kamery ze skryptu
+struct HeadlessOptions {
+    bool enabled = false;
+    string outputDir;
+    string cameraPath;          // pusty = jeden obrot wokol krateru
+    double duration = 60.0;     // czas symulacji [s]
+    double frameInterval = 0.1; // [s]
+    int width = 1280;
+    int height = 720;
+
+    float zScale = 4.0f;
+    EruptionParams eruption;
+    // Wysokosci DEM jako uint16 (skala/offset, polowa pamieci) zamiast float32;
+    // --quantize-heights dziala tez w trybie okienkowym
+    bool quantizeHeights = false;
+};
+
+// --headless <katalog> [--camera plik] [--duration s] [--frame-interval s] [--size SZERxWYS]
+// [--quantize-heights]
+bool parseHeadlessArgs(int argc, char** argv, HeadlessOptions& opt) {
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--headless" && hasValue) {
+            opt.enabled = true;
+            opt.outputDir = argv[++i];
+        }
+        else if (arg == "--camera" && hasValue) opt.cameraPath = argv[++i];
+        else if (arg == "--duration" && hasValue) opt.duration = atof(argv[++i]);
+        else if (arg == "--frame-interval" && hasValue) opt.frameInterval = atof(argv[++i]);
+        else if (arg == "--quantize-heights") opt.quantizeHeights = true;
+        else if (arg == "--size" && hasValue) {
+            if (sscanf(argv[++i], "%dx%d", &opt.width, &opt.height) != 2) {
+                cerr << "Niepoprawny rozmiar klatki: " << argv[i] << " (oczekiwano np. 1280x720)\n";
+                return false;
+            }
+        }
+        else if (arg == "--headless") {
+            cerr << "Uzycie: --headless <katalog_klatek> [--camera plik] [--duration s] [--frame-interval s] [--size 1280x720] [--quantize-heights]\n";
+            return false;
+        }
+    }
+    if (opt.enabled && (opt.duration <= 0.0 || opt.frameInterval <= 0.0 || opt.width <= 0 || opt.height <= 0)) {
+        cerr << "Niepoprawne parametry trybu --headless\n";
+        return false;
+    }
+    return true;
+}
+
+// Ta sama symulacja co po ENTER w menu, bez GLFW i GL: klatki rysuje
+// HeadlessRenderer na wlasnym watku ze zrzutow stanu
+int runHeadless(const HeadlessOptions& opt, const string& heightPath, const string& colorsPath,
+    const string& weatherCSV, const string& windFieldPath) {
+    std::error_code ec;
+    filesystem::create_directories(opt.outputDir, ec);
+
+    Weather weatherSystem;
+    DEMLoader dem;
+    dem.setHeightQuantization(opt.quantizeHeights);
+    DEMLoader colorLoader;
+    TerrainWind terrainWind;
+    StartupTasks startup;
+    Scenario::LoadTasks load = Scenario::addLoadTasks(startup, weatherSystem, weatherCSV,
+        dem, heightPath, terrainWind);
+    startup.add("Kolory terenu", [&]() { return colorLoader.loadColors(colorsPath); });
+    startup.wait();
+
+    if (!startup.succeeded(load.weather)) {
+        cout << "Nie mozna zaladowac danych pogodowych. Uzywam domyslnych warunkow.\n";
+        weatherSystem = Scenario::defaultWeather();
+    }
+    if (!startup.succeeded(load.height)) {
+        cerr << "Nie mozna wczytac pliku wysokosci: " << heightPath << "\n";
+        return 1;
+    }
+    dem.adoptColors(colorLoader);
+
+    Scenario scenario(dem, weatherSystem);
+    Cloud cloud(&weatherSystem);
+    WindField windField;
+    if (windField.open(windFieldPath)) cloud.setWindField(&windField);
+    if (startup.succeeded(load.wind)) cloud.setTerrainWind(&terrainWind);
+    PlumeModel plume;
+    BallisticTable ballistics;
+    scenario.start(opt.eruption, cloud, plume, ballistics);
+
+    CameraPath camera;
+    if (!opt.cameraPath.empty()) {
+        if (!camera.load(opt.cameraPath)) return 1;
+    }
+    else {
+        camera.setOrbit((scenario.maxX - scenario.minX) * 0.8, 4000.0, opt.duration);
+    }
+
+    HeadlessRenderer renderer;
+    HeadlessRenderer::Settings settings;
+    settings.width = opt.width;
+    settings.height = opt.height;
+    settings.zScale = opt.zScale;
+    settings.baseZ = scenario.minElev;
+    settings.craterX = scenario.craterX;
+    settings.craterY = scenario.craterY;
+    settings.craterZ = scenario.craterZ;
+    settings.outputDir = opt.outputDir;
+    if (!renderer.start(dem, camera, settings)) {
+        cerr << "Nie mozna uruchomic renderowania bez okna\n";
+        return 1;
+    }
+
+    // Bez okna nie ma terminu klatki - emisja bez przerzedzania (wagi 1)
+    const double dt = 0.01;
+    FrameBudget frameBudget(dt);
+    frameBudget.adaptive = false;
+    int steps = (int)ceil(opt.duration / dt);
+    int frame = 0;
+    double nextFrameTime = 0.0;
+    for (int step = 0; step <= steps; step++) {
+        double simTime = step * dt;
+        if (simTime + 1e-9 >= nextFrameTime) {
+            SceneSnapshot snapshot;
+            snapshot.capture(frame++, simTime, cloud.particles, scenario.particlesOnEarth);
+            renderer.submit(move(snapshot));
+            nextFrameTime += opt.frameInterval;
+        }
+        if (step == steps) break;
+        scenario.step(cloud, frameBudget, dt);
+    }
+    renderer.finish();
+
+    cout << "\nSymulacja zakonczona (" << opt.duration << " s, " << frame << " klatek).\n";
+    cout << "Liczba czastek, ktore spadly na ziemie: " << llround(scenario.landedParticles())
+        << " (superczastek: " << scenario.particlesOnEarth.size() << ")\n";
+    cout << "Liczba czastek, ktore opuscily atmosfere: " << llround(scenario.overflowParticles())
+        << " (superczastek: " << scenario.particlesOverflow.size() << ")\n";
+    cout << "Liczba czastek pozostalych w powietrzu: " << llround(Scenario::airborneParticles(cloud))
+        << " (superczastek: " << cloud.particles.size() << ")\n";
+    cout << "Laczna liczba czastek: " << scenario.emittedParticles() << "\n";
+    return 0;
+}
 
+int main(int argc, char** argv) {
     srand((unsigned)time(NULL));
 
     int volcanoChoice = 1;
@@ -80,9 +233,31 @@ int main(int argc, char** argv) {
     string heightPath = "../geo/vesuvius_dem_height.tif";
     string colorsPath = "../geo/vesuvius_dem_colors.tif";
     string weatherCSV = "../geo/open-meteo-40.81N14.44E1176m.csv";
+    string windFieldPath = "../geo/wind_field.vwf";
     float orbitRadius = 8000.0f;
     Weather weatherSystem;
 
+    // Parametry z menu w chwili startu erupcji
+    auto eruptionParams = [&]() {
+        EruptionParams params;
+        params.particleCount = userParticleCount;
+        params.turbulence = userTurbulence;
+        params.windSpeed = userWindSpeed;
+        params.craterRadius = userCraterRadius;
+        params.minSpeed = userMinSpeed;
+        params.maxSpeed = userMaxSpeed;
+        return params;
+    };
+
+    HeadlessOptions headless;
+    headless.zScale = userZScale;
+    headless.eruption = eruptionParams();
+    if (!parseHeadlessArgs(argc, argv, headless)) return 1;
+    if (headless.enabled) {
+        return runHeadless(headless, heightPath, colorsPath, weatherCSV, windFieldPath);
+    }
+
+    glutInit(&argc, argv);
     if (!glfwInit()) { cerr << "glfwInit failed\n"; return 1; }
 
     int winW = 1400;
@@ -105,29 +280,309 @@ int main(int argc, char** argv) {
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+    // Sterowniki GDAL rejestrowane raz, zanim ruszy wczytywanie w tle
+    GDALAllRegister();
+
+    // ImGui przed wczytywaniem danych: menu i postep sa widoczne od pierwszej klatki
+    IMGUI_CHECKVERSION();
+    ImGui::CreateContext();
+    ImGuiIO& io = ImGui::GetIO();
+    ImGui_ImplGlfw_InitForOpenGL(window, true);
+    ImGui_ImplOpenGL3_Init("#version 330");
+    ImGui::StyleColorsDark();
+
+    double lastKeyTime = 0.0;
+    double keyDelay = 0.25;
+
+    // Klawisze menu startowego; true po wybraniu START SYMULACJI
+    auto menuKeys = [&](double currentTime) {
+        if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS && (currentTime - lastKeyTime) > keyDelay) {
+            selectedMenuItem = (selectedMenuItem - 1 + menuItems) % menuItems;
+            lastKeyTime = currentTime;
+        }
+        if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS && (currentTime - lastKeyTime) > keyDelay) {
+            selectedMenuItem = (selectedMenuItem + 1) % menuItems;
+            lastKeyTime = currentTime;
+        }
+        if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS && (currentTime - lastKeyTime) > keyDelay) {
+            switch (selectedMenuItem) {
+            case 0:
+                volcanoChoice = (volcanoChoice == 1) ? 2 : 1;
+                break;
+            case 1:
+                userParticleCount = max(0, userParticleCount - 500);
+                break;
+            case 2:
+                userZScale = max(1.0f, userZScale - 0.5f);
+                break;
+            case 3:
+                userTurbulence = max(0.0f, userTurbulence - 0.05f);
+                break;
+            case 4:
+                userWindSpeed = max(0.0f, userWindSpeed - 0.5f);
+                break;
+            }
+            lastKeyTime = currentTime;
+        }
+        if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS && (currentTime - lastKeyTime) > keyDelay) {
+            switch (selectedMenuItem) {
+            case 0:
+                volcanoChoice = (volcanoChoice == 1) ? 2 : 1;
+                break;
+            case 1:
+                userParticleCount = min(10000, userParticleCount + 500);
+                break;
+            case 2:
+                userZScale = min(50.0f, userZScale + 0.5f);
+                break;
+            case 3:
+                userTurbulence = min(2.0f, userTurbulence + 0.05f);
+                break;
+            case 4:
+                userWindSpeed = min(50.0f, userWindSpeed + 0.5f);
+                break;
+            }
+            lastKeyTime = currentTime;
+        }
+        bool start = false;
+        if (glfwGetKey(window, GLFW_KEY_ENTER) == GLFW_PRESS && (currentTime - lastKeyTime) > keyDelay) {
+            start = selectedMenuItem == 5;
+            lastKeyTime = currentTime;
+        }
+        return start;
+    };
+
+    auto drawMenu = [&]() {
+        glMatrixMode(GL_PROJECTION);
+        glPushMatrix();
+        glLoadIdentity();
+        glOrtho(0, winW, winH, 0, -1, 1);
+        glMatrixMode(GL_MODELVIEW);
+        glPushMatrix();
+        glLoadIdentity();
+
+        glDisable(GL_LIGHTING);
+        glDisable(GL_DEPTH_TEST);
+
+        drawRect(winW / 2 - 300, winH / 2 - 200, 600, 400, 0.1f, 0.1f, 0.1f, 0.9f);
+        drawRectOutline(winW / 2 - 300, winH / 2 - 200, 600, 400, 1.0f, 1.0f, 1.0f);
+
+        glColor3f(1.0f, 1.0f, 1.0f);
+        renderText(winW / 2 - 150, winH / 2 - 180, "ERUPTION SIMULATOR", GLUT_BITMAP_TIMES_ROMAN_24);
+
+        int yPos = winH / 2 - 120;
+
+        if (selectedMenuItem == 0) glColor3f(1.0f, 1.0f, 0.0f);
+        else glColor3f(1.0f, 1.0f, 1.0f);
+        string volcanoText = "Wulkan: " + string((volcanoChoice == 1) ? "Vesuvius" : "Inny (do implementacji)");
+        renderText(winW / 2 - 250, yPos, volcanoText.c_str());
+
+        yPos += 30;
+        if (selectedMenuItem == 1) glColor3f(1.0f, 1.0f, 0.0f);
+        else glColor3f(1.0f, 1.0f, 1.0f);
+        string particlesText = "Liczba czastek: " + to_string(userParticleCount == 0 ? 3000 : userParticleCount);
+        renderText(winW / 2 - 250, yPos, particlesText.c_str());
+
+        yPos += 30;
+        if (selectedMenuItem == 2) glColor3f(1.0f, 1.0f, 0.0f);
+        else glColor3f(1.0f, 1.0f, 1.0f);
+        char zScaleText[50];
+        snprintf(zScaleText, sizeof(zScaleText), "Skala wysokosci: %.1f", userZScale);
+        renderText(winW / 2 - 250, yPos, zScaleText);
+
+        yPos += 30;
+        if (selectedMenuItem == 3) glColor3f(1.0f, 1.0f, 0.0f);
+        else glColor3f(1.0f, 1.0f, 1.0f);
+        char turbText[50];
+        snprintf(turbText, sizeof(turbText), "Turbulencja: %.2f", userTurbulence);
+        renderText(winW / 2 - 250, yPos, turbText);
+
+        yPos += 30;
+        if (selectedMenuItem == 4) glColor3f(1.0f, 1.0f, 0.0f);
+        else glColor3f(1.0f, 1.0f, 1.0f);
+        char windText[50];
+        snprintf(windText, sizeof(windText), "Predkosc wiatru: %.1f m/s", userWindSpeed);
+        renderText(winW / 2 - 250, yPos, windText);
+
+        yPos += 50;
+        if (selectedMenuItem == 5) glColor3f(0.0f, 1.0f, 0.0f);
+        else glColor3f(1.0f, 1.0f, 1.0f);
+        renderText(winW / 2 - 100, yPos, "START SYMULACJI [ENTER]");
+
+        glColor3f(0.7f, 0.7f, 0.7f);
+        renderText(winW / 2 - 250, winH / 2 + 150, "STRZALKI GORA/DOL - nawigacja");
+        renderText(winW / 2 - 250, winH / 2 + 130, "STRZALKI LEWO/PRAWO - zmiana wartosci");
+        renderText(winW / 2 - 250, winH / 2 + 110, "ENTER - rozpocznij symulacje");
+
+        glEnable(GL_DEPTH_TEST);
+        glEnable(GL_LIGHTING);
+
+        glMatrixMode(GL_PROJECTION);
+        glPopMatrix();
+        glMatrixMode(GL_MODELVIEW);
+        glPopMatrix();
+    };
+
+    DEMLoader dem;
+    // Domyslnie float32; --quantize-heights: uint16 (skala/offset), dla zakresu
+    // Wezuwiusza blad < 1 cm
+    dem.setHeightQuantization(headless.quantizeHeights);
+    // Kolory czytane rownolegle z wysokosciami do osobnego loadera
+    DEMLoader colorLoader;
+    // Oplyw stozka: pole przeliczane przy pierwszym kroku i przy kazdej nowej klatce pogody
+    TerrainWind terrainWind;
+    // Tekstura terenu, gdy nie idzie prosto z kolorow DEMLoader: podglad kolorow
+    // duzego rastra albo skala szarosci
+    vector<unsigned char> tex;
+    int texW = 0, texH = 0;
+    bool texFromColors = false;
+    int colorW = 0, colorH = 0;
+    // Raster wiekszy niz limit tekstury (albo strumieniowy) trafia do tekstury
+    // zmniejszony, bez czytania pelnej rozdzielczosci
+    GLint maxTextureSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    const int textureLimit = min((int)maxTextureSize, 8192);
+
+    // Wczytywanie jako graf zadan: pogoda, wysokosci i kolory niezaleznie,
+    // siatka oplywu i tekstura po wysokosciach. Zadania nie dotykaja GL -
+    // tekstury i bufory powstaja na tym watku po wczytaniu.
     cout << "Ladowanie danych pogodowych z: " << weatherCSV << "\n";
-    bool weatherLoaded = false;
-    {
-        NullBuffer nb; streambuf* oldOut = cout.rdbuf(); streambuf* oldErr = cerr.rdbuf();
-        cout.rdbuf(&nb); cerr.rdbuf(&nb);
-        weatherLoaded = weatherSystem.loadWeatherProfile(weatherCSV);
-        cout.rdbuf(oldOut); cerr.rdbuf(oldErr);
+    StartupTasks startup;
+    Scenario::LoadTasks load = Scenario::addLoadTasks(startup, weatherSystem, weatherCSV,
+        dem, heightPath, terrainWind);
+    int colorTask = startup.add("Kolory terenu", [&]() {
+        bool large = DEMLoader::rasterSize(colorsPath, colorW, colorH) &&
+            ((long long)colorW * colorH > Scenario::demStreamingThreshold || colorW > maxTextureSize || colorH > maxTextureSize);
+        if (!large) return colorLoader.loadColors(colorsPath);
+        texFromColors = DEMLoader::readColorPreview(colorsPath, textureLimit, tex, texW, texH);
+        return texFromColors;
+    });
+    startup.add("Tekstura terenu", [&]() {
+        if (!dem.isLoaded()) return false;
+        int nx = dem.width();
+        int ny = dem.height();
+        if (colorW == nx && colorH == ny && (colorLoader.hasColors() || texFromColors)) {
+            return true;
+        }
+        texFromColors = false;
+        auto [minH, maxH] = dem.getHeightRange();
+        double range = maxH - minH;
+        if (range <= 0) range = 1.0;
+
+        if (dem.isStreaming() || nx > maxTextureSize || ny > maxTextureSize) {
+            // Wysokosci z podgladu GDAL; getGroundZ dla kazdego piksela
+            // przeciagnalby caly raster przez cache kafli
+            vector<float> heights;
+            if (!DEMLoader::readHeightPreview(heightPath, textureLimit, heights, texW, texH)) return false;
+            tex.assign((size_t)texW * (size_t)texH * 4, 0);
+            for (int y = 0; y < texH; y++) {
+                // Podglad od polnocy, tekstura w skali szarosci od minY
+                const float* row = heights.data() + (size_t)(texH - 1 - y) * texW;
+                for (int x = 0; x < texW; x++) {
+                    unsigned char val = 0;
+                    if (!isnan(row[x])) {
+                        val = (unsigned char)(min(max((row[x] - minH) / range, 0.0), 1.0) * 255.0);
+                    }
+                    size_t idx = ((size_t)y * texW + x) * 4;
+                    tex[idx] = val;
+                    tex[idx + 1] = val;
+                    tex[idx + 2] = val;
+                    tex[idx + 3] = 255;
+                }
+            }
+            return true;
+        }
+
+        const double* gt = dem.geoTransform();
+        double minX = gt[0];
+        double minY = gt[3] + ny * gt[5];
+        double pxSizeY_abs = abs(gt[5]);
+        texW = nx;
+        texH = ny;
+        tex.assign((size_t)nx * (size_t)ny * 4, 0);
+        for (int y = 0; y < ny; y++) {
+            for (int x = 0; x < nx; x++) {
+                double gx = minX + x * gt[1];
+                double gy = minY + y * pxSizeY_abs;
+                double z = dem.getGroundZ(gx, gy);
+                unsigned char val = 0;
+                if (!isnan(z)) {
+                    val = (unsigned char)(((z - minH) / range) * 255.0);
+                }
+                size_t idx = (size_t)(y * nx + x) * 4;
+                tex[idx] = val;
+                tex[idx + 1] = val;
+                tex[idx + 2] = val;
+                tex[idx + 3] = 255;
+            }
+        }
+        return true;
+    }, { load.height, colorTask });
+
+    // Menu startowe dziala w trakcie wczytywania; START czeka na koniec zadan
+    bool startRequested = false;
+    while (!startup.finished()) {
+        startup.poll();
+        double currentTime = glfwGetTime();
+        glfwPollEvents();
+        if (glfwWindowShouldClose(window) || glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
+            // Zadania pisza do dem/tex - koniec dopiero po ich zakonczeniu
+            startup.wait();
+            glfwDestroyWindow(window);
+            glfwTerminate();
+            return 0;
+        }
+        if (menuKeys(currentTime)) startRequested = true;
+
+        int w, h; glfwGetFramebufferSize(window, &w, &h);
+        glViewport(0, 0, max(w, 1), max(h, 1));
+        glClearColor(0.6f, 0.8f, 1.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        drawMenu();
+
+        ImGui_ImplOpenGL3_NewFrame();
+        ImGui_ImplGlfw_NewFrame();
+        ImGui::NewFrame();
+        ImGui::SetNextWindowPos(ImVec2(20, 20));
+        ImGui::SetNextWindowSize(ImVec2(260, 0));
+        ImGui::Begin("Wczytywanie");
+        ImGui::ProgressBar(startup.progress());
+        for (int i = 0; i < startup.count(); i++) {
+            const char* mark = "[ ]";
+            if (startup.state(i) == StartupTasks::State::Running) mark = "[.]";
+            else if (startup.state(i) == StartupTasks::State::Done) mark = "[x]";
+            else if (startup.state(i) == StartupTasks::State::Failed) mark = "[!]";
+            ImGui::Text("%s %s", mark, startup.name(i).c_str());
+        }
+        if (startRequested) ImGui::Text("Start po wczytaniu danych");
+        ImGui::End();
+        ImGui::Render();
+        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+
+        glfwSwapBuffers(window);
+        Wait(16);
     }
-    if (!weatherLoaded) {
+
+    cout << "Czasy wczytywania:\n";
+    for (int i = 0; i < startup.count(); i++) {
+        cout << "  " << startup.name(i) << ": " << startup.seconds(i) << " s"
+            << (startup.succeeded(i) ? "" : " (blad)") << "\n";
+    }
+
+    if (!startup.succeeded(load.weather)) {
         cout << "Nie mozna zaladowac danych pogodowych. Uzywam domyslnych warunkow.\n";
-        weatherSystem = Weather(0, 2.0, 1.0, 15.0, 101300, 50, 0.1);
+        weatherSystem = Scenario::defaultWeather();
     }
     else {
         cout << "Dane pogodowe zaladowane pomyslnie.\n";
     }
 
-    DEMLoader dem;
-    if (!dem.loadHeight(heightPath)) {
+    if (!startup.succeeded(load.height)) {
         cerr << "Nie mozna wczytac pliku wysokosci: " << heightPath << "\n";
         return 1;
     }
 
-    bool hasColors = dem.loadColors(colorsPath);
+    bool hasColors = dem.adoptColors(colorLoader) || texFromColors;
     if (!hasColors) {
         cout << "Ostrzezenie: Nie wczytano pliku z kolorami. Teren bedzie w skali szarosci.\n";
     }
@@ -136,16 +591,15 @@ int main(int argc, char** argv) {
     int ny = dem.height();
 
     const double* gt = dem.geoTransform();
-    double originX = gt[0];
-    double originY = gt[3];
     double pxSizeX = gt[1];
-    double pxSizeY = gt[5];
+    double pxSizeY_abs = abs(gt[5]);
 
-    double minX = originX;
-    double maxY = originY;
-    double maxX = originX + nx * pxSizeX;
-    double minY = originY + ny * pxSizeY;
-    double pxSizeY_abs = abs(pxSizeY);
+    // Granice terenu, krater i pogoda na jego wysokosci - wspolne z --headless
+    Scenario scenario(dem, weatherSystem);
+    double minX = scenario.minX;
+    double maxX = scenario.maxX;
+    double minY = scenario.minY;
+    double maxY = scenario.maxY;
 
     double terrainWidth = maxX - minX;
     double terrainHeight = maxY - minY;
@@ -153,53 +607,21 @@ int main(int argc, char** argv) {
 
     orbitRadius = terrainWidth * 0.8f;
 
-    double craterX = (minX + maxX) * 0.5;
-    double craterY = (minY + maxY) * 0.5;
+    double craterX = scenario.craterX;
+    double craterY = scenario.craterY;
 
     cout << "Zakres X (metry UTM): " << minX << " - " << maxX << "\n";
     cout << "Zakres Y (metry UTM): " << minY << " - " << maxY << "\n";
     cout << "Krater X (metry): " << craterX << "\n";
     cout << "Krater Y (metry): " << craterY << "\n";
 
-    vector<unsigned char> tex((size_t)nx * (size_t)ny * 4, 0);
-
-    if (dem.hasColors()) {
-        cout << "Tworzenie tekstury z kolorow...\n";
-        for (int y = 0; y < ny; y++) {
-            for (int x = 0; x < nx; x++) {
-                const DEMLoader::Color* col = dem.getColor(x, y);
-                if (col) {
-                    size_t idx = (size_t)(y * nx + x) * 4;
-                    tex[idx] = col->r;
-                    tex[idx + 1] = col->g;
-                    tex[idx + 2] = col->b;
-                    tex[idx + 3] = 255;
-                }
-            }
-        }
-    }
-    else {
-        cout << "Brak kolorow - tworzenie tekstury w skali szarosci...\n";
-        auto [minH, maxH] = dem.getHeightRange();
-        double range = maxH - minH;
-        if (range <= 0) range = 1.0;
-
-        for (int y = 0; y < ny; y++) {
-            for (int x = 0; x < nx; x++) {
-                double gx = minX + x * pxSizeX;
-                double gy = minY + y * pxSizeY_abs;
-                double z = dem.getGroundZ(gx, gy);
-                unsigned char val = 0;
-                if (!isnan(z)) {
-                    val = (unsigned char)(((z - minH) / range) * 255.0);
-                }
-                size_t idx = (size_t)(y * nx + x) * 4;
-                tex[idx] = val;
-                tex[idx + 1] = val;
-                tex[idx + 2] = val;
-                tex[idx + 3] = 255;
-            }
-        }
+    // Kolory z DEMLoader sa juz w ukladzie RGBA i ida do tekstury bez kopii;
+    // bufor tex jest potrzebny tylko dla tekstury w skali szarosci
+    const unsigned char* texPixels = tex.empty() ? nullptr : tex.data();
+    if (dem.rgbaData()) {
+        texPixels = dem.rgbaData();
+        texW = nx;
+        texH = ny;
     }
     static bool materialEnabled[10] = { true, true, true, true, true, true, true, true, true, true };
     GLuint texId = 0;
@@ -210,20 +632,33 @@ int main(int argc, char** argv) {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, nx, ny, 0, GL_RGBA, GL_UNSIGNED_BYTE, tex.data());
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texW, texH, 0, GL_RGBA, GL_UNSIGNED_BYTE, texPixels);
+    tex.clear();
+    tex.shrink_to_fit();
     glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
 
-    double minElev = 1e15, maxElev = -1e15;
-    for (int y = 0; y < ny; y++) {
-        for (int x = 0; x < nx; x++) {
-            double gx = minX + x * pxSizeX;
-            double gy = minY + y * pxSizeY_abs;
-            double z = dem.getGroundZ(gx, gy);
-            if (!isnan(z)) { if (z < minElev) minElev = z; if (z > maxElev) maxElev = z; }
-        }
+    // Teren z buforow GPU; bez shaderow (stary sterownik) zostaje rysowanie glBegin
+    TerrainRenderer terrainRenderer;
+    if (!gl::load() || !terrainRenderer.build(dem)) {
+        cout << "Brak shaderow - teren rysowany w trybie natychmiastowym.\n";
     }
-    double craterZRaw = dem.getGroundZ(craterX, craterY);
-    if (isnan(craterZRaw)) craterZRaw = (minElev + maxElev) * 0.5;
+    ParticleRenderer particleRenderer;
+    if (gl::isLoaded()) particleRenderer.build();
+    // Przy bardzo wielu czastkach zamiast punktow - gestosc liczona na CPU
+    DensitySplat densitySplat;
+    if (gl::isLoaded()) densitySplat.build();
+    static int particleView = 0;
+    // Slady trajektorii wybranych czastek (domyslnie wylaczone)
+    ParticleTrails particleTrails;
+    if (gl::isLoaded()) particleTrails.build();
+    // Opadly material jako nakladka na teren zamiast punktu na kazda czastke
+    DepositMap depositMap;
+    if (terrainRenderer.isBuilt()) depositMap.build(dem);
+    static bool showDeposit = true;
+
+    double minElev = scenario.minElev;
+    double maxElev = scenario.maxElev;
+    double craterZRaw = scenario.craterZ;
 
     cout << "Zakres wysokosci: " << minElev << " - " << maxElev << " m\n";
     cout << "Wysokosc krateru: " << craterZRaw << " m\n";
@@ -231,7 +666,6 @@ int main(int argc, char** argv) {
     double baseZ = minElev;
     float camHeightOverCrater = 4000.0f;
 
-    weatherSystem.updateForAltitude(craterZRaw);
     cout << "Warunki poczatkowe w kraterze (wysokosc " << craterZRaw << " m):\n";
     cout << "  Temperatura: " << weatherSystem.temperature << "°C\n";
     cout << "  Wiatr U: " << weatherSystem.wind_u << " m/s\n";
@@ -251,23 +685,29 @@ int main(int argc, char** argv) {
     glLightfv(GL_LIGHT0, GL_AMBIENT, lightAmbient);
     glLightfv(GL_LIGHT0, GL_POSITION, lightPosition);
     glShadeModel(GL_SMOOTH);
-    IMGUI_CHECKVERSION(); 
-    ImGui::CreateContext(); 
-    ImGuiIO& io = ImGui::GetIO(); 
-    ImGui_ImplGlfw_InitForOpenGL(window, true);
-    ImGui_ImplOpenGL3_Init("#version 330");
 	bool isPaused = false;
-    ImGui::StyleColorsDark();
-    int holdParticlesCount = 0;
     Cloud* cloud = new Cloud(&weatherSystem);
-    bool isActive = true;
-    vector<Materia> particlesOnEarth;
-    vector<Materia> particlesOverflow;
+    WindField windField;
+    if (windField.open(windFieldPath)) {
+        cloud->setWindField(&windField);
+    }
+    else {
+        cout << "Brak pola wiatru 4D - uzywam profilu pionowego.\n";
+    }
+    if (startup.succeeded(load.wind)) {
+        cloud->setTerrainWind(&terrainWind);
+    }
+    // Kolumna erupcyjna i tablice trajektorii bomb ustawiane przy starcie
+    // erupcji z parametrow menu (tablice zalezne od profilu pogody)
+    PlumeModel plume;
+    BallisticTable ballistics;
+    vector<Materia>& particlesOnEarth = scenario.particlesOnEarth;
+    vector<Materia>& particlesOverflow = scenario.particlesOverflow;
 
     static int frameCounter = 0;
-
-    double lastKeyTime = 0.0;
-    double keyDelay = 0.25;
+    double frameMs = 0.0;
+    // Kroki na klatke i limit superczastek dobierane do czasu klatki
+    FrameBudget frameBudget(0.01);
 
     while (!glfwWindowShouldClose(window)) {
         double currentTime = glfwGetTime();
@@ -276,7 +716,7 @@ int main(int argc, char** argv) {
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
         ImGui::SetNextWindowPos(ImVec2(20, 20));
-        ImGui::SetNextWindowSize(ImVec2(260, 300));
+        ImGui::SetNextWindowSize(ImVec2(260, 470));
         ImGui::Begin("Material Menu");
 
         for (int i = 0;i < 10;i++) {
@@ -284,80 +724,41 @@ int main(int argc, char** argv) {
             ImGui::SameLine();
             ImGui::Checkbox(MaterialTypeS[i], &materialEnabled[i]);
 
+        }
+        ImGui::Checkbox("Bomby z tablic balistycznych", &cloud->useBallisticTable);
+        if (depositMap.isBuilt()) ImGui::Checkbox("Mapa depozytu", &showDeposit);
+        if (particleTrails.isBuilt()) ImGui::Checkbox("Slady czastek", &particleTrails.enabled);
+        ImGui::Checkbox("Adaptacyjny budzet klatki", &frameBudget.adaptive);
+        if (frameBudget.adaptive) {
+            ImGui::SliderFloat("Symulacja/czas", &frameBudget.targetSimRatio, 0.1f, 2.0f, "%.1f");
+            ImGui::Text("Kroki: %d, limit czastek: %.0f", frameBudget.substeps(), frameBudget.particleBudget());
+        }
+        if (particleRenderer.isBuilt()) {
+            ImGui::Text("Rysowane: %zu, poza widokiem: %zu", particleRenderer.drawnParticles(), particleRenderer.culledParticles());
+        }
+        if (densitySplat.isBuilt()) {
+            ImGui::RadioButton("Auto", &particleView, 0); ImGui::SameLine();
+            ImGui::RadioButton("Punkty", &particleView, 1); ImGui::SameLine();
+            ImGui::RadioButton("Gestosc", &particleView, 2);
+            densitySplat.mode = static_cast<DensitySplat::Mode>(particleView);
         }
 		ImGui::End();
-        if (menuActive) {
-            if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS && (currentTime - lastKeyTime) > keyDelay) {
-                selectedMenuItem = (selectedMenuItem - 1 + menuItems) % menuItems;
-                lastKeyTime = currentTime;
-            }
-            if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS && (currentTime - lastKeyTime) > keyDelay) {
-                selectedMenuItem = (selectedMenuItem + 1) % menuItems;
-                lastKeyTime = currentTime;
-            }
-            if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS && (currentTime - lastKeyTime) > keyDelay) {
-                switch (selectedMenuItem) {
-                case 0:
-                    volcanoChoice = (volcanoChoice == 1) ? 2 : 1;
-                    break;
-                case 1:
-                    userParticleCount = max(0, userParticleCount - 500);
-                    break;
-                case 2:
-                    userZScale = max(1.0f, userZScale - 0.5f);
-                    break;
-                case 3:
-                    userTurbulence = max(0.0f, userTurbulence - 0.05f);
-                    break;
-                case 4:
-                    userWindSpeed = max(0.0f, userWindSpeed - 0.5f);
-                    break;
-                }
-                lastKeyTime = currentTime;
-            }
-            if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS && (currentTime - lastKeyTime) > keyDelay) {
-                switch (selectedMenuItem) {
-                case 0:
-                    volcanoChoice = (volcanoChoice == 1) ? 2 : 1;
-                    break;
-                case 1:
-                    userParticleCount = min(10000, userParticleCount + 500);
-                    break;
-                case 2:
-                    userZScale = min(50.0f, userZScale + 0.5f);
-                    break;
-                case 3:
-                    userTurbulence = min(2.0f, userTurbulence + 0.05f);
-                    break;
-                case 4:
-                    userWindSpeed = min(50.0f, userWindSpeed + 0.5f);
-                    break;
-                }
-                lastKeyTime = currentTime;
-            }
-            if (glfwGetKey(window, GLFW_KEY_ENTER) == GLFW_PRESS && (currentTime - lastKeyTime) > keyDelay) {
-                if (selectedMenuItem == 5) {
-                    menuActive = false;
+        if (menuActive && (menuKeys(currentTime) || startRequested)) {
+            startRequested = false;
+            menuActive = false;
 
-                    if (volcanoChoice != 1) {
-                        cout << "Wybrano wulkan numer " << volcanoChoice << ". Używam Vesuvius.\n";
-                    }
-
-                    int particleCount = (userParticleCount == 0) ? (rand() % 1000 + 2000) : userParticleCount;
+            if (volcanoChoice != 1) {
+                cout << "Wybrano wulkan numer " << volcanoChoice << ". Używam Vesuvius.\n";
+            }
 
-                    cout << "\nSymulacja rozpoczyna sie. Nacisnij ESC aby zakonczyc.\n";
-                    cout << "Parametry:\n";
-                    cout << "  Liczba czastek: " << particleCount << "\n";
-                    cout << "  Skala wysokosci: " << userZScale << "\n";
-                    cout << "  Turbulencja: " << userTurbulence << "\n";
-                    cout << "  Predkosc wiatru: " << userWindSpeed << " m/s\n";
+            scenario.start(eruptionParams(), *cloud, plume, ballistics);
 
-                    weatherSystem.turbulence = userTurbulence;
-                    weatherSystem.wind_u = userWindSpeed * 0.8;
-                    weatherSystem.wind_v = userWindSpeed * 0.6;
-                }
-                lastKeyTime = currentTime;
-            }
+            cout << "\nSymulacja rozpoczyna sie. Nacisnij ESC aby zakonczyc.\n";
+            cout << "Parametry:\n";
+            cout << "  Liczba czastek: " << scenario.params().particleCount << "\n";
+            cout << "  Skala wysokosci: " << userZScale << "\n";
+            cout << "  Turbulencja: " << userTurbulence << "\n";
+            cout << "  Predkosc wiatru: " << userWindSpeed << " m/s\n";
         }
 
         if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
@@ -425,55 +826,62 @@ int main(int argc, char** argv) {
         glClearColor(0.6f, 0.8f, 1.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        glEnable(GL_TEXTURE_2D);
-        glBindTexture(GL_TEXTURE_2D, texId);
-
-        for (int y = 0; y < ny - 1; y++) {
-            for (int x = 0; x < nx - 1; x++) {
-                double x0 = minX + x * pxSizeX;
-                double x1 = minX + (x + 1) * pxSizeX;
-
-                double y0 = minY + y * pxSizeY_abs;
-                double y1 = minY + (y + 1) * pxSizeY_abs;
-
-                double z00r = dem.getGroundZ(x0, y0);
-                double z10r = dem.getGroundZ(x1, y0);
-                double z11r = dem.getGroundZ(x1, y1);
-                double z01r = dem.getGroundZ(x0, y1);
-
-                if (isnan(z00r)) z00r = minElev;
-                if (isnan(z10r)) z10r = minElev;
-                if (isnan(z11r)) z11r = minElev;
-                if (isnan(z01r)) z01r = minElev;
-
-                double z00 = (z00r - baseZ) * userZScale;
-                double z10 = (z10r - baseZ) * userZScale;
-                double z11 = (z11r - baseZ) * userZScale;
-                double z01 = (z01r - baseZ) * userZScale;
-
-                float u0 = (float)x / (float)(nx - 1);
-                float u1 = (float)(x + 1) / (float)(nx - 1);
-                float v0 = 1.0f - (float)y / (float)(ny - 1);
-                float v1 = 1.0f - (float)(y + 1) / (float)(ny - 1);
-
-                glm::vec3 v00((float)x0, (float)y0, (float)z00);
-                glm::vec3 v10((float)x1, (float)y0, (float)z10);
-                glm::vec3 v01((float)x0, (float)y1, (float)z01);
-
-                glm::vec3 n = glm::normalize(glm::cross(v10 - v00, v01 - v00));
-
-                glBegin(GL_QUADS);
-                glColor3f(1.f, 1.f, 1.f);
-                glNormal3f(n.x, n.y, n.z);
-                glTexCoord2f(u0, v0); glVertex3f((float)x0, (float)y0, (float)z00);
-                glTexCoord2f(u1, v0); glVertex3f((float)x1, (float)y0, (float)z10);
-                glTexCoord2f(u1, v1); glVertex3f((float)x1, (float)y1, (float)z11);
-                glTexCoord2f(u0, v1); glVertex3f((float)x0, (float)y1, (float)z01);
-                glEnd();
-            }
+        if (terrainRenderer.isBuilt()) {
+            depositMap.upload();
+            terrainRenderer.setDeposit(showDeposit ? &depositMap : nullptr);
+            terrainRenderer.draw(proj, view, h, texId, userZScale, (float)baseZ, lightPos);
         }
+        else {
+            glEnable(GL_TEXTURE_2D);
+            glBindTexture(GL_TEXTURE_2D, texId);
+
+            for (int y = 0; y < ny - 1; y++) {
+                for (int x = 0; x < nx - 1; x++) {
+                    double x0 = minX + x * pxSizeX;
+                    double x1 = minX + (x + 1) * pxSizeX;
+
+                    double y0 = minY + y * pxSizeY_abs;
+                    double y1 = minY + (y + 1) * pxSizeY_abs;
+
+                    double z00r = dem.getGroundZ(x0, y0);
+                    double z10r = dem.getGroundZ(x1, y0);
+                    double z11r = dem.getGroundZ(x1, y1);
+                    double z01r = dem.getGroundZ(x0, y1);
+
+                    if (isnan(z00r)) z00r = minElev;
+                    if (isnan(z10r)) z10r = minElev;
+                    if (isnan(z11r)) z11r = minElev;
+                    if (isnan(z01r)) z01r = minElev;
+
+                    double z00 = (z00r - baseZ) * userZScale;
+                    double z10 = (z10r - baseZ) * userZScale;
+                    double z11 = (z11r - baseZ) * userZScale;
+                    double z01 = (z01r - baseZ) * userZScale;
+
+                    float u0 = (float)x / (float)(nx - 1);
+                    float u1 = (float)(x + 1) / (float)(nx - 1);
+                    float v0 = 1.0f - (float)y / (float)(ny - 1);
+                    float v1 = 1.0f - (float)(y + 1) / (float)(ny - 1);
+
+                    glm::vec3 v00((float)x0, (float)y0, (float)z00);
+                    glm::vec3 v10((float)x1, (float)y0, (float)z10);
+                    glm::vec3 v01((float)x0, (float)y1, (float)z01);
+
+                    glm::vec3 n = glm::normalize(glm::cross(v10 - v00, v01 - v00));
+
+                    glBegin(GL_QUADS);
+                    glColor3f(1.f, 1.f, 1.f);
+                    glNormal3f(n.x, n.y, n.z);
+                    glTexCoord2f(u0, v0); glVertex3f((float)x0, (float)y0, (float)z00);
+                    glTexCoord2f(u1, v0); glVertex3f((float)x1, (float)y0, (float)z10);
+                    glTexCoord2f(u1, v1); glVertex3f((float)x1, (float)y1, (float)z11);
+                    glTexCoord2f(u0, v1); glVertex3f((float)x0, (float)y1, (float)z01);
+                    glEnd();
+                }
+            }
 
-        glDisable(GL_TEXTURE_2D);
+            glDisable(GL_TEXTURE_2D);
+        }
 
         glDisable(GL_LIGHTING);
         glPointSize(8.0f);
@@ -482,63 +890,62 @@ int main(int argc, char** argv) {
         glVertex3f((float)craterX, (float)craterY, (float)((craterZRaw - baseZ) * userZScale));
         glEnd();
 
-        for (const auto& p : particlesOnEarth) {
-            glPointSize(4.0f);
-            glBegin(GL_POINTS);
-            glColor3f(0.0f, 0.0f, 0.0f);
-            float pz = (float)((p.position_z - baseZ) * userZScale);
-            glVertex3f((float)p.position_x, (float)p.position_y, pz);
-            glEnd();
+        // Czastki jednym wywolaniem z bufora GPU; wylaczone materialy to pominiete
+        // zakresy chmury, a skupiska poza widokiem odrzuca renderer
+        if (particleRenderer.isBuilt()) {
+            unsigned materialMask = 0;
+            for (int i = 0; i < 10; i++) {
+                if (materialEnabled[i]) materialMask |= 1u << i;
+            }
+            bool landedOnMap = showDeposit && depositMap.isBuilt();
+            bool splats = densitySplat.isBuilt() && densitySplat.chooseSplats(cloud->particles.size(), frameMs);
+            vector<ParticleRenderer::Batch> batches;
+            if (!landedOnMap && !particlesOnEarth.empty()) {
+                batches.push_back({ particlesOnEarth.data(), particlesOnEarth.size(), true });
+            }
+            for (int i = 0; i < 10 && !splats; i++) {
+                size_t begin, end;
+                if (materialEnabled[i] && cloud->materialRange(static_cast<MaterialType>(i), begin, end) && end > begin) {
+                    batches.push_back({ cloud->particles.data() + begin, end - begin, false });
+                }
+            }
+            particleRenderer.draw(batches, proj * view, userZScale, (float)baseZ);
+            if (splats) densitySplat.draw(cloud->particles, materialMask, proj, view, w, h, userZScale, (float)baseZ);
+            particleTrails.draw(materialMask, userZScale, (float)baseZ);
         }
-
-        for (const auto& p : cloud->particles) {
-            if (materialEnabled[static_cast<int>(p.type)]) {
-                glPointSize(3.0f);
+        else {
+            for (const auto& p : particlesOnEarth) {
+                glPointSize(4.0f);
                 glBegin(GL_POINTS);
-                float heightFactor = (float)min(1.0, max(0.0, (p.position_z - craterZRaw + 500.0) / 1000.0));
-                glColor3f(ParticleColor[static_cast<int>(p.type)][0], ParticleColor[static_cast<int>(p.type)][1], ParticleColor[static_cast<int>(p.type)][2]);
+                glColor3f(0.0f, 0.0f, 0.0f);
                 float pz = (float)((p.position_z - baseZ) * userZScale);
                 glVertex3f((float)p.position_x, (float)p.position_y, pz);
                 glEnd();
             }
-        }
-
-        glEnable(GL_LIGHTING);
 
-        if (!menuActive&&!isPaused) {
-            int particleCount = (userParticleCount == 0) ? (rand() % 1000 + 2000) : userParticleCount;
-            int particlesPerFrame = rand() % 30 + 10;
-
-            if (isActive && holdParticlesCount < particleCount) {
-                int particlesToAdd = min(particlesPerFrame, particleCount - holdParticlesCount);
-                if (particlesToAdd > 0) {
-                    cloud->generateParticles(particlesToAdd, craterX, craterY, craterZRaw,
-                        userCraterRadius, userMinSpeed, userMaxSpeed,
-                        0.0005, 0.002, rand() % 10);
-                    holdParticlesCount += particlesToAdd;
+            for (int i = 0; i < 10; i++) {
+                size_t begin, end;
+                if (!materialEnabled[i] || !cloud->materialRange(static_cast<MaterialType>(i), begin, end)) continue;
+                glPointSize(3.0f);
+                glColor3f(ParticleColor[i][0], ParticleColor[i][1], ParticleColor[i][2]);
+                glBegin(GL_POINTS);
+                for (size_t k = begin; k < end; k++) {
+                    const Materia& p = cloud->particles[k];
+                    glVertex3f((float)p.position_x, (float)p.position_y, (float)((p.position_z - baseZ) * userZScale));
                 }
-                else { isActive = false; }
+                glEnd();
             }
+        }
 
-            double wind_u = userWindSpeed * 0.8;
-            double wind_v = userWindSpeed * 0.6;
-            double updraft = max(0.0, (weatherSystem.temperature - 15.0) * 0.2) * 100;
-
-            cloud->update(0.01, weatherSystem.CalculateAirDensity(), wind_u, wind_v,
-                particlesOnEarth, particlesOverflow, dem, updraft, userTurbulence * 0.5);
+        glEnable(GL_LIGHTING);
 
-            for (auto it = particlesOnEarth.begin(); it != particlesOnEarth.end();) {
-                bool out = (it->position_x < minX || it->position_x > maxX ||
-                    it->position_y < minY || it->position_y > maxY);
-                double gz = dem.getGroundZ(it->position_x, it->position_y);
-                if (out || isnan(gz)) {
-                    particlesOverflow.push_back(*it);
-                    it = particlesOnEarth.erase(it);
-                }
-                else {
-                    it->position_z = gz;
-                    ++it;
-                }
+        int simSteps = 0;
+        double simMs = 0.0;
+        if (!menuActive&&!isPaused) {
+            double simStart = glfwGetTime();
+            simSteps = frameBudget.substeps();
+            for (int s = 0; s < simSteps; s++) {
+                scenario.step(*cloud, frameBudget, 0.01, &particleTrails, &depositMap);
             }
 
             if (frameCounter % 50 == 0) {
@@ -548,78 +955,10 @@ int main(int argc, char** argv) {
                     << ", Poza: " << particlesOverflow.size() << endl;
             }
             frameCounter++;
+            simMs = (glfwGetTime() - simStart) * 1000.0;
         }
 
-        if (menuActive) {
-            glMatrixMode(GL_PROJECTION);
-            glPushMatrix();
-            glLoadIdentity();
-            glOrtho(0, winW, winH, 0, -1, 1);
-            glMatrixMode(GL_MODELVIEW);
-            glPushMatrix();
-            glLoadIdentity();
-
-            glDisable(GL_LIGHTING);
-            glDisable(GL_DEPTH_TEST);
-
-            drawRect(winW / 2 - 300, winH / 2 - 200, 600, 400, 0.1f, 0.1f, 0.1f, 0.9f);
-            drawRectOutline(winW / 2 - 300, winH / 2 - 200, 600, 400, 1.0f, 1.0f, 1.0f);
-
-            glColor3f(1.0f, 1.0f, 1.0f);
-            renderText(winW / 2 - 150, winH / 2 - 180, "ERUPTION SIMULATOR", GLUT_BITMAP_TIMES_ROMAN_24);
-
-            int yPos = winH / 2 - 120;
-
-            if (selectedMenuItem == 0) glColor3f(1.0f, 1.0f, 0.0f);
-            else glColor3f(1.0f, 1.0f, 1.0f);
-            string volcanoText = "Wulkan: " + string((volcanoChoice == 1) ? "Vesuvius" : "Inny (do implementacji)");
-            renderText(winW / 2 - 250, yPos, volcanoText.c_str());
-
-            yPos += 30;
-            if (selectedMenuItem == 1) glColor3f(1.0f, 1.0f, 0.0f);
-            else glColor3f(1.0f, 1.0f, 1.0f);
-            string particlesText = "Liczba czastek: " + to_string(userParticleCount == 0 ? 3000 : userParticleCount);
-            renderText(winW / 2 - 250, yPos, particlesText.c_str());
-
-            yPos += 30;
-            if (selectedMenuItem == 2) glColor3f(1.0f, 1.0f, 0.0f);
-            else glColor3f(1.0f, 1.0f, 1.0f);
-            char zScaleText[50];
-            snprintf(zScaleText, sizeof(zScaleText), "Skala wysokosci: %.1f", userZScale);
-            renderText(winW / 2 - 250, yPos, zScaleText);
-
-            yPos += 30;
-            if (selectedMenuItem == 3) glColor3f(1.0f, 1.0f, 0.0f);
-            else glColor3f(1.0f, 1.0f, 1.0f);
-            char turbText[50];
-            snprintf(turbText, sizeof(turbText), "Turbulencja: %.2f", userTurbulence);
-            renderText(winW / 2 - 250, yPos, turbText);
-
-            yPos += 30;
-            if (selectedMenuItem == 4) glColor3f(1.0f, 1.0f, 0.0f);
-            else glColor3f(1.0f, 1.0f, 1.0f);
-            char windText[50];
-            snprintf(windText, sizeof(windText), "Predkosc wiatru: %.1f m/s", userWindSpeed);
-            renderText(winW / 2 - 250, yPos, windText);
-
-            yPos += 50;
-            if (selectedMenuItem == 5) glColor3f(0.0f, 1.0f, 0.0f);
-            else glColor3f(1.0f, 1.0f, 1.0f);
-            renderText(winW / 2 - 100, yPos, "START SYMULACJI [ENTER]");
-
-            glColor3f(0.7f, 0.7f, 0.7f);
-            renderText(winW / 2 - 250, winH / 2 + 150, "STRZALKI GORA/DOL - nawigacja");
-            renderText(winW / 2 - 250, winH / 2 + 130, "STRZALKI LEWO/PRAWO - zmiana wartosci");
-            renderText(winW / 2 - 250, winH / 2 + 110, "ENTER - rozpocznij symulacje");
-
-            glEnable(GL_DEPTH_TEST);
-            glEnable(GL_LIGHTING);
-
-            glMatrixMode(GL_PROJECTION);
-            glPopMatrix();
-            glMatrixMode(GL_MODELVIEW);
-            glPopMatrix();
-        }
+        if (menuActive) drawMenu();
         glDisable(GL_DEPTH_TEST);
         glDisable(GL_LIGHTING);
         glEnable(GL_BLEND);
@@ -631,20 +970,31 @@ int main(int argc, char** argv) {
         glEnable(GL_DEPTH_TEST);
         glEnable(GL_LIGHTING);
         glfwSwapBuffers(window);
-        Wait(33);
+        frameMs = (glfwGetTime() - currentTime) * 1000.0;
+        frameBudget.update(simMs, frameMs, cloud->particles.size(), simSteps);
+        Wait(frameBudget.idleMs(frameMs));
     }
 
     if (texId) glDeleteTextures(1, &texId);
+    terrainRenderer.release();
+    particleRenderer.release();
+    depositMap.release();
+    densitySplat.release();
+    particleTrails.release();
     glfwDestroyWindow(window);
     glfwTerminate();
 
     
 
     cout << "\nSymulacja zakonczona.\n";
-    cout << "Liczba czastek, ktore spadly na ziemie: " << particlesOnEarth.size() << "\n";
-    cout << "Liczba czastek, ktore opuscily atmosfere: " << particlesOverflow.size() << "\n";
-    cout << "Liczba czastek pozostalych w powietrzu: " << cloud->particles.size() << "\n";
-    cout << "Laczna liczba czastek: " << holdParticlesCount << "\n";
+    // Liczby czastek rzeczywistych (z wagami), w nawiasie superczastki
+    cout << "Liczba czastek, ktore spadly na ziemie: " << llround(scenario.landedParticles())
+        << " (superczastek: " << particlesOnEarth.size() << ")\n";
+    cout << "Liczba czastek, ktore opuscily atmosfere: " << llround(scenario.overflowParticles())
+        << " (superczastek: " << particlesOverflow.size() << ")\n";
+    cout << "Liczba czastek pozostalych w powietrzu: " << llround(Scenario::airborneParticles(*cloud))
+        << " (superczastek: " << cloud->particles.size() << ")\n";
+    cout << "Laczna liczba czastek: " << scenario.emittedParticles() << "\n";
     delete cloud;
     return 0;
 }
\ No newline at end of file
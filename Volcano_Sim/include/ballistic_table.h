@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vector>
+#include "grain_size.h"
+#include "weather.h"
+#include "dem_loader.h"
+
+// Tablice trajektorii balistycznych z oporem powietrza dla grubych klas ziaren
+// (bomby). Dla kazdej klasy (srednica i gestosc sa stale w klasie) liczona jest
+// siatka startow po (predkosc, kat od pionu, wiatr wzdluz, wiatr w poprzek);
+// kazdy wezel to trajektoria probkowana rownomiernie w czasie az do maxDrop
+// ponizej punktu startu. Zapytanie to interpolacja wieloliniowa 16 sasiednich
+// trajektorii i przejscie lamana po drzewie min/max DEM - bez calkowania.
+// Ta sama fizyka co w Cloud::update (opor Gansera, wzmocniony ciezar, wypor),
+// gestosc powietrza z profilu Weather; wiatr staly na calej trajektorii.
+class BallisticTable {
+public:
+    static constexpr int samples = 32;
+
+    // Trajektoria w ukladzie swiata: przesuniecia wzgledem punktu startu co dt
+    struct Trajectory {
+        double x0 = 0.0, y0 = 0.0, z0 = 0.0;
+        double dt = 0.0;
+        float x[samples], y[samples], z[samples];
+    };
+
+    struct Landing {
+        double x = 0.0, y = 0.0, z = 0.0;
+        double time = 0.0;              // czas lotu [s]
+        double vx = 0.0, vy = 0.0, vz = 0.0;
+    };
+
+    BallisticTable();
+
+    // Tablice dla klas o srednicy >= minDiameter, start na wysokosci launchZ;
+    // trajektorie siegaja maxDrop metrow ponizej startu
+    bool build(const GrainSizeModel& grains, const Weather& weather,
+        double launchZ, double maxDrop, double minDiameter = 0.064);
+    bool isBuilt() const { return built_; }
+    bool hasClass(int sizeClass) const;
+
+    // Trajektoria z tablicy; false poza zakresem tablicy lub dla klasy bez tablicy.
+    // zenith - kat od pionu, azimuth - kierunek poziomy [rad]
+    bool trajectory(int sizeClass, double x, double y, double z,
+        double speed, double zenith, double azimuth,
+        double windU, double windV, Trajectory& out) const;
+
+    // Punkt upadku lamanej na DEM. false, gdy trajektoria uderza w teren juz
+    // przy wznoszeniu, wylatuje poza DEM lub konczy sie nad terenem -
+    // takie starty trzeba policzyc krokowo
+    static bool land(const Trajectory& path, const DEMLoader& dem, Landing& out);
+
+    bool land(int sizeClass, double x, double y, double z,
+        double speed, double zenith, double azimuth,
+        double windU, double windV, const DEMLoader& dem, Landing& out) const;
+
+    // Zakres i gestosc siatki (przed build)
+    double speedMax = 400.0;        // [m/s]
+    double zenithMax = 1.0472;      // 60 stopni
+    double windMax = 30.0;          // [m/s]
+    int speedCount = 17;
+    int zenithCount = 13;
+    int windAlongCount = 7;         // od -windMax do windMax
+    int windCrossCount = 4;         // od 0 do windMax (ujemny przez odbicie)
+    double integrationStep = 0.05;  // [s]
+    double maxFlightTime = 600.0;   // [s]
+
+private:
+    size_t entryIndex(int is, int iz, int ia, int ic) const {
+        return (((size_t)is * zenithCount + iz) * windAlongCount + ia) * windCrossCount + ic;
+    }
+    void integrate(const SizeClass& sc, const std::vector<float>& density,
+        double speed, double zenith, double windAlong, double windCross, float* entry) const;
+
+    // Wezel: [czas lotu, wzdluz[samples], w poprzek[samples], z[samples]]
+    static constexpr int entrySize = 1 + 3 * samples;
+    // Kolumna gestosci powietrza do calkowania: od maxDrop ponizej startu co densityStep
+    static constexpr double densityStep = 10.0;
+
+    bool built_;
+    double launchZ_;
+    double maxDrop_;
+    std::vector<std::vector<float>> tables_;    // per klasa; puste = brak tablicy
+};
@@ -4,29 +4,76 @@
 #include "materia.h"
 #include "dem_loader.h"
 #include "weather.h"  
+#include "wind_field.h"
+#include "terrain_wind.h"
+#include "plume_model.h"
+#include "grain_size.h"
+#include "ballistic_table.h"
+
+// Lot z tablicy balistycznej: pozycja odczytywana z lamanej zamiast calkowania
+struct BallisticFlight {
+    BallisticTable::Trajectory path;
+    BallisticTable::Landing landing;    // landing.time < 0: jeszcze nie wyznaczony
+    double launchTime = 0.0;
+};
 
 class Cloud {
 public:
     std::vector<Materia> particles;
     Weather* weatherSystem;  
+    WindField* windField;      // opcjonalne pole 4D (nullptr = tylko profil)
+    TerrainWind* terrainWind;  // opcjonalna poprawka wiatru od terenu
+    PlumeModel* plume;         // kolumna erupcyjna (pionowy wiatr nad kraterem)
+    BallisticTable* ballistics; // opcjonalne tablice trajektorii bomb
+    bool useBallisticTable;    // bomby z tablic zamiast calkowania krokowego
+    double simTime;            // czas symulacji [s]
+    GrainSizeModel grainSizes; // rozklady uziarnienia i klasy ziaren
+    // Czastki trzymane sa grupami wg klasy uziarnienia: klasa c zajmuje
+    // particles[classStart[c], classStart[c + 1])
+    std::vector<size_t> classStart;
+    std::vector<BallisticFlight> flights;
 
     Cloud();
     Cloud(Weather* weather);  
     ~Cloud();
 
     void setWeatherSystem(Weather* weather);  
+    void setWindField(WindField* field);
+    void setTerrainWind(TerrainWind* wind);
+    void setPlume(PlumeModel* model);
+    void setBallisticTable(BallisticTable* table);
 
     void generateParticles(size_t N,
         double crater_x, double crater_y, double crater_z,
         double crater_radius,
         double min_speed, double max_speed,
-        double min_diameter, double max_diameter,
-        int choice = 0);
+        int choice = 0, double weight = 1.0);
 
     void update(double dt, double airDensity,
         double wind_u, double wind_v,
 		std::vector<Materia>& particlesOnEart, std::vector<Materia>& particlesOverflow,
         const DEMLoader& dem,
         double wind_w = 0.0, double turbulence = 0.0);
-    void clear() { particles.clear(); }
+    // Zakres particles[begin, end) jednego materialu (klasy materialu leza obok
+    // siebie); false, gdy grupy nie sa aktualne
+    bool materialRange(MaterialType type, size_t& begin, size_t& end) const;
+
+    void clear() {
+        particles.clear();
+        classStart.assign(grainSizes.classCount() + 1, 0);
+        flights.clear();
+        freeFlights.clear();
+    }
+
+private:
+    bool advanceFlight(Materia& p, double dt, const DEMLoader& dem);
+    void releaseFlight(Materia& p);
+
+    std::vector<int> freeFlights;
+    std::vector<Materia> incoming;     // bufor nowych czastek w insertGrouped
+    std::vector<std::pair<double, double>> prefetchPoints; // bufor punktow prefetch DEM
+    size_t prefetchPhase;              // przesuniecie probkowania prefetch w kroku
+    void regroup();
+    void insertGrouped(size_t firstNew);
+    void rebuildClassRanges();
 };
\ No newline at end of file
@@ -4,12 +4,40 @@
 #include <string>
 #include <vector>
 #include <utility>
+#include <memory>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include "tile_cache.h"
+
+class GDALDataset;
+class GDALRasterBand;
 
 class DEMLoader {
 public:
+    // Ukad RGBA odpowiada GL_RGBA/GL_UNSIGNED_BYTE, wic colors_ mona
+    // wysa do tekstury bez konwersji
     struct Color {
-        unsigned char r, g, b;
+        unsigned char r, g, b, a;
+    };
+    static_assert(sizeof(Color) == 4, "Color musi mie ukad RGBA bez dopenienia");
+
+    // Poziom piramidy wysokoci: wze (i, j) obejmuje komrki interpolacji
+    // [i*cell, (i+1)*cell] x [j*cell, (j+1)*cell] (wcznie z pikselami brzegowymi),
+    // wic min/max wza ogranicza z dou/gry wynik getGroundZ w jego obszarze.
+    struct PyramidLevel {
+        int nx = 0, ny = 0;           // liczba wzw
+        int cell = 1;                 // rozmiar wza w pikselach
+        std::vector<float> minH;      // +inf gdy w wle s tylko NoData
+        std::vector<float> maxH;      // -inf gdy w wle s tylko NoData
+        // 0: min/max tylko z przyblionych statystyk rastra (tryb strumieniowy,
+        // kafle pod wzem jeszcze nie wczytane) - dobre dla LOD, ale nie jako
+        // ograniczenie przy kolizjach
+        std::vector<unsigned char> exact;
     };
+    // Najdrobniejszy poziom piramidy: 9 B na 64 piksele (z wyszymi poziomami
+    // ok. 0.19 B/px), czyli may uamek samego rastra wysokoci
+    static const int kPyramidCell = 8;
 
     DEMLoader();
     ~DEMLoader();
@@ -18,6 +46,32 @@ public:
     bool loadHeight(const std::string& path);   // wczytuje tylko wysoko (1 pasmo)
     bool loadColors(const std::string& path);   // wczytuje tylko kolory (3+ pasm)
     bool load(const std::string& path);          // kompatybilno wsteczna
+    // Przejmuje kolory wczytane przez inny loader (np. rwnolegle z wysokociami);
+    // false, gdy tamten nie ma kolorw albo wymiary si nie zgadzaj
+    bool adoptColors(DEMLoader& other);
+
+    // Przechowywanie wysokoci jako uint16 ze skal i offsetem (poowa pamici);
+    // ustawiane przed loadHeight, NoData mapowane na kod 0xFFFF
+    void setHeightQuantization(bool enabled);
+    bool isQuantized() const;
+
+    // Tryb strumieniowy: raster otwierany leniwie, kafle wczytywane na danie
+    // do ograniczonego cache LRU (dla DEM wikszych ni pami). Przy otwarciu
+    // nie jest czytany aden kafel - piramida startuje z zakresu caego rastra
+    // (metadane lub przyblione statystyki GDAL) i zawa si w updatePyramid.
+    bool openStreaming(const std::string& path, int tileSize = 256, size_t maxTiles = 512);
+    bool isStreaming() const;
+    // Zleca wczytanie w tle kafli pod podanymi punktami (np. przewidywane pozycje czstek).
+    // Bez alokacji: powtrki kafla odsiewa znacznik wywoania w prefetchStamp_.
+    void prefetch(const std::vector<std::pair<double, double>>& geoPoints) const;
+    static bool rasterSize(const std::string& path, int& w, int& h);
+    // Zmniejszony podgld rastra (duszy bok <= maxSize) do tekstury, bez
+    // czytania penej rozdzielczoci - GDAL bierze dane z podgldw (overviews),
+    // jeli plik je ma. Wysokoci z pasma 1 (NoData jako NaN), kolory jako RGBA.
+    static bool readHeightPreview(const std::string& path, int maxSize,
+        std::vector<float>& heights, int& w, int& h);
+    static bool readColorPreview(const std::string& path, int maxSize,
+        std::vector<unsigned char>& rgba, int& w, int& h);
 
     // Informacje
     int width() const;
@@ -32,24 +86,96 @@ public:
         unsigned char& r, unsigned char& g, unsigned char& b) const;
     const Color* getColor(int x, int y) const;
     const Color* getColorAtPixel(double px, double py) const;
+    const unsigned char* rgbaData() const;      // nx*ny*4 bajtw lub nullptr
 
     // Dodatkowe
     std::pair<double, double> getHeightRange() const;
+
+    // Piramida min/max: poziom 0 ma wzy kPyramidCell px, ostatni jeden wze
+    int pyramidLevels() const;
+    const PyramidLevel& pyramidLevel(int level) const;
+    // Zmienia si przy kadym zaweniu piramidy (np. do przeliczenia LOD terenu)
+    unsigned pyramidRevision() const;
+    // Tryb strumieniowy: przenosi do piramidy dokadne min/max kafli wczytanych
+    // od ostatniego wywoania. Wze dostaje je, gdy wczytane s wszystkie kafle
+    // pod nim. Woa z wtku symulacji midzy krokami (nie wspbienie z zapytaniami).
+    void updatePyramid();
+    // Grne ograniczenie wysokoci terenu w otoczeniu punktu (szybkie odrzucenie kolizji);
+    // NaN poza rastrem, +inf nad wzem bez dokadnych min/max (niewczytane kafle)
+    double maxHeightBound(double geoX, double geoY) const;
+    // Przecicie odcinka (x0,y0,z0)-(x1,y1,z1) z terenem; tHit w [0,1] to
+    // parametr pierwszego kontaktu. Drzewo min/max pomija puste obszary.
+    bool intersectSegment(double x0, double y0, double z0,
+        double x1, double y1, double z1, double& tHit) const;
     double pixelSizeX() const;
     double pixelSizeY() const;
     bool geoToPixel(double gx, double gy, double& px, double& py) const;
 
 private:
+    struct SegmentQuery {
+        double px0, py0, px1, py1;    // koce w pikselach
+        double dpx, dpy;
+        double z0, dz;
+    };
+
+    // Min/max wzw poziomu 0 z jednego wczytanego kafla
+    struct TileBounds {
+        int tile;
+        int i0, j0, ni, nj;
+        std::vector<float> minH, maxH;
+    };
+    // Wze na granicy kafli, dla ktrego wczytano dopiero cz kafli
+    struct PartialNode {
+        float minH, maxH;
+        int tiles;
+    };
+
     double bilinearInterp(double px, double py) const;
+    double rawHeight(int x, int y, std::shared_ptr<const TileCache::Tile>& tile) const;
+    bool readQuantized(GDALRasterBand* band);
+    bool clipToRect(const SegmentQuery& q, double xa, double xb, double ya, double yb,
+        double& t0, double& t1) const;
+    bool intersectNode(const SegmentQuery& q, int level, int i, int j,
+        double t0, double t1, double& tHit) const;
+    bool intersectCell(const SegmentQuery& q, int cx, int cy,
+        double t0, double t1, double& tHit) const;
+    bool loadTile(int tx, int ty, TileCache::Tile& out);
+    void buildPyramid();
+    void buildUpperLevels();
+    void refreshAncestors(int i, int j);
+    void addTileBounds(const TileCache::Tile& t);
+    void closeStream();
 
     int nx_, ny_;
     std::vector<float> data_;        // dane wysokociowe
+    std::vector<uint16_t> qdata_;    // dane wysokociowe skwantowane (zamiast data_)
     std::vector<Color> colors_;      // dane kolorw
     double gt_[6];
     bool loaded_;
     bool hasNoData_;
     double noDataVal_;
     bool hasColors_;
+
+    static const uint16_t kQuantNoData = 0xFFFF;
+    bool quantize_;
+    double qScale_;                  // wysoko = qOffset_ + qScale_ * kod
+    double qOffset_;
+
+    std::vector<PyramidLevel> pyramid_;   // pyramid_[0] = wzy kPyramidCell px
+    unsigned pyramidRevision_;
+    std::mutex boundsMutex_;              // chroni pendingBounds_ (wtek prefetch)
+    std::vector<TileBounds> pendingBounds_;
+    std::vector<unsigned char> tileRefined_;               // kafle ju ujte w piramidzie
+    std::unordered_map<size_t, PartialNode> partialNodes_;
+
+    // Tryb strumieniowy
+    GDALDataset* streamDs_;
+    GDALRasterBand* streamBand_;
+    int tileSize_;
+    int tilesX_, tilesY_;
+    std::unique_ptr<TileCache> tiles_;
+    mutable std::vector<unsigned> prefetchStamp_;        // numer wywoania prefetch na kafel
+    mutable unsigned prefetchCall_;
 };
 
 #endif // DEM_LOADER_H
\ No newline at end of file
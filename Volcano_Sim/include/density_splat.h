@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "gl_loader.h"
+#include "materia.h"
+
+// Widok gestosci dla bardzo licznych czastek: zamiast punktu na czastke CPU
+// rzutuje czastki do siatki ekranowej (kubelek = binPixels x binPixels pikseli)
+// i zlicza je rownolegle: watki rzutuja swoje czastki i rozkladaja je na pasy
+// wierszy ekranu, potem kazdy pas liczy jeden watek we wspolnym histogramie
+// (pamiec rosnie z liczba czastek, nie z liczba watkow x rozmiar ekranu).
+// Kubelek niesie liczbe czastek, sredni kolor ParticleColor i najblizsza
+// glebokosc, wiec teren zaslania chmure jak przy punktach. Wynik to tekstura
+// RGBA rysowana jednym prostokatem na caly ekran (alfa ~ log gestosci).
+class DensitySplat {
+public:
+    enum class Mode { Auto, Points, Splats };
+
+    DensitySplat();
+    ~DensitySplat();
+
+    bool build();
+    bool isBuilt() const { return program_ != 0; }
+    void release();
+
+    // Tryb na biezaca klatke. Auto: punkty do minSplatCount, gestosc od
+    // maxPointCount, pomiedzy - gestosc, gdy poprzednia klatka przekroczyla
+    // frameBudgetMs (z histereza, zeby tryb nie migal)
+    bool chooseSplats(size_t particleCount, double frameMs);
+
+    // proj/view jak w GL; czastki spoza materialMask sa pomijane
+    void draw(const std::vector<Materia>& particles, unsigned materialMask,
+        const glm::mat4& proj, const glm::mat4& view, int viewportWidth, int viewportHeight,
+        float zScale, float baseZ);
+
+    Mode mode = Mode::Auto;
+    int binPixels = 2;
+    size_t minSplatCount = 20000;
+    size_t maxPointCount = 300000;
+    double frameBudgetMs = 33.0;
+
+    bool isSplatting() const { return splatting_; }
+    size_t splattedParticles() const { return splatted_; }
+
+private:
+    struct Bin {
+        float count;
+        float r, g, b;      // suma kolorow
+        float depth;        // najblizsza glebokosc okna [0, 1]
+    };
+    struct Splat {
+        std::uint32_t bin;  // indeks kubelka
+        float weight;
+        float depth;
+        int type;
+    };
+
+    void resize(int width, int height);
+
+    int bw_, bh_;
+    std::vector<Bin> histogram_;
+    std::vector<std::vector<Splat>> projected_;     // per watek
+    std::vector<Splat> sorted_;                     // czastki ulozone pasami
+    std::vector<unsigned char> rgba_;
+    std::vector<float> depth_;
+    GLuint colorTexture_, depthTexture_;
+    int textureW_, textureH_;
+
+    GLuint program_;
+    GLint locColor_, locDepth_;
+
+    bool splatting_;
+    size_t pointLimit_;     // granica punkty/gestosc wyuczona z czasu klatki
+    size_t splatted_;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include "gl_loader.h"
+#include "dem_loader.h"
+#include "materia.h"
+
+// Mapa depozytu: obciazenie [kg/m^2] opadlego materialu w komorkach siatki
+// pokrywajacej DEM (komorka = cellPixels x cellPixels pikseli, tak zeby tekstura
+// nie przekroczyla maxTextureSize). Kazda opadla czastka dokladana jest raz
+// (masa razy Materia::weight),
+// a do GPU co klatke trafiaja tylko zmienione bloki dirtyBlock x dirtyBlock
+// komorek (glTexSubImage2D), wiec koszt nie rosnie z liczba opadlych czastek.
+// Tekstura GL_R32F, wiersze od minY; kolory nadaje shader terenu (skala
+// logarytmiczna wzgledem maxLoad).
+class DepositMap {
+public:
+    static constexpr int dirtyBlock = 64;
+
+    DepositMap();
+    ~DepositMap();
+
+    bool build(const DEMLoader& dem, int maxTextureSize = 2048);
+    bool isBuilt() const { return texture_ != 0; }
+    void release();
+    void clear();
+
+    void add(const Materia& p);
+    // Wysyla zmienione komorki do tekstury; wywolywac z watku kontekstu GL
+    void upload();
+
+    GLuint texture() const { return texture_; }
+    // minX, minY, 1/szerokosc, 1/wysokosc obszaru tekstury (wspolrzedne tekstury)
+    const float* texMap() const { return texMap_; }
+    double maxLoad() const { return maxLoad_; }
+    double loadAt(double x, double y) const;
+    int width() const { return w_; }
+    int height() const { return h_; }
+    int cellPixels() const { return cellPixels_; }
+
+private:
+    bool cellOf(double x, double y, int& i, int& j) const;
+
+    int w_, h_, cellPixels_;
+    double minX_, minY_, cellW_, cellH_, invArea_;
+    std::vector<float> load_;
+    double maxLoad_;
+    int blocksX_, blocksY_;
+    std::vector<unsigned char> dirty_;     // flaga zmiany per blok
+    std::vector<int> dirtyList_;           // indeksy zmienionych blokow
+    GLuint texture_;
+    float texMap_[4];
+};
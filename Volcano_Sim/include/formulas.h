@@ -1,9 +1,12 @@
 #pragma once
 #include "materia.h"
+#include <cmath>
+#include <algorithm>
 
 namespace physics {
     constexpr double g = 9.80665;
     constexpr double airViscosity = 1.8e-5;
+    constexpr double gravityBoost = 1.4;    // wzmocnienie ciezaru czastek w symulacji
 
     double maxRange(double v0, double angle_rad);
     double flyingTime(double v0, double angle_rad);
@@ -12,6 +15,33 @@ namespace physics {
     double stokesDragMagnitude(double v_rel, const Materia& m);
     double quadraticDragMagnitude(double v_rel, const Materia& m, double airDensity = 1.225, double Cd = 0.47);
     double dragMagnitude(double v_rel, const Materia& m, double airDensity = 1.225);
+
+    // Wspolczynnik oporu Gansera (1993) dla czastek izometrycznych o sferycznosci psi;
+    // ciagly od zakresu Stokesa do Newtona
+    double ganserDragCoefficient(double Re, double sphericity);
+
+    // Tablica f(Re) = Cd Re / 24 (opor wzgledem Stokesa) w funkcji log2(Re).
+    // Sila oporu to wtedy F = -3 pi mu d f(Re) v_rel, bez dzielenia przez |v|
+    // i bez rozgalezien na zakres Re; odczyt to liniowa interpolacja.
+    struct DragTable {
+        static constexpr int size = 1024;
+        static constexpr double log2ReMin = -12.0;
+        static constexpr double log2ReMax = 22.0;
+        double f[size];
+
+        void build(double sphericity);
+
+        double lookup(double Re) const {
+            const double invStep = (size - 1) / (log2ReMax - log2ReMin);
+            double x = (std::log2(Re + 1e-30) - log2ReMin) * invStep;
+            x = std::min(std::max(x, 0.0), size - 1.000001);
+            int i = (int)x;
+            double t = x - i;
+            return f[i] + t * (f[i + 1] - f[i]);
+        }
+    };
+
+    const DragTable& dragTable(MaterialType type);
     void dragForceVector(double rel_vx, double rel_vy, double rel_vz, const Materia& m, double airDensity,
         double& out_fx, double& out_fy, double& out_fz);
 }
\ No newline at end of file
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+
+// Adaptacyjny budzet klatki: z czasu symulacji i rysowania (srednie
+// wykladnicze) wyznacza liczbe krokow symulacji na klatke i limit
+// superczastek w powietrzu. Kroki trzymaja zadany stosunek czasu symulacji
+// do rzeczywistego; limit czastek wynika z czasu, jaki zostaje na symulacje
+// w targetFrameMs. Powyzej limitu emisja jest przerzedzana, a kazda
+// wyemitowana superczastka niesie wage (Materia::weight) pominietych, wiec
+// masa wyrzucona i depozyt nie zaleza od szybkosci komputera. Gdy chmura
+// i tak nie miesci sie w budzecie, spada liczba krokow na klatke.
+class FrameBudget {
+public:
+    bool adaptive = true;
+    float targetFrameMs = 33.0f;
+    float targetSimRatio = 0.3f;   // sekundy symulacji na sekunde rzeczywista
+    int maxSubsteps = 8;
+    double minParticles = 2000.0;  // limit nie spada ponizej
+    double maxParticles = 2.0e6;
+
+    explicit FrameBudget(double stepDt = 0.01);
+
+    // Po klatce: czas krokow symulacji, czas calej klatki (bez czekania)
+    // i liczba czastek w powietrzu. steps == 0 (menu, pauza) - bez pomiaru.
+    void update(double simMs, double frameMs, size_t airborne, int steps);
+
+    int substeps() const { return adaptive ? substeps_ : 1; }
+    // Ile superczastek wyemitowac zamiast requested (co najmniej jedna, takze
+    // przy pelnym budzecie); weight - ile rzeczywistych czastek reprezentuje
+    // kazda z nich (requested / wynik)
+    int emitCount(int requested, size_t airborne, double& weight) const;
+    // Czekanie do konca klatki [ms]
+    int idleMs(double frameMs) const;
+
+    double particleBudget() const { return budget_; }
+    double renderMs() const { return renderMs_; }
+    double simMs() const { return simMs_; }
+
+private:
+    double dt_;
+    double renderMs_, simMs_, perParticleMs_;
+    double budget_;
+    int substeps_;
+    bool measured_;
+};
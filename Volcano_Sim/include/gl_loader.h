@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstddef>
+#include <GLFW/glfw3.h>
+
+// Funkcje OpenGL powyzej 1.1 ladowane przez glfwGetProcAddress (naglowek
+// systemowy na Windows konczy sie na 1.1). Wlasne nazwy w przestrzeni gl,
+// zeby nie zderzyc sie z prototypami z glext.h.
+#if defined(_WIN32)
+#define GL_LOADER_CALL __stdcall
+#else
+#define GL_LOADER_CALL
+#endif
+
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER 0x8892
+#endif
+#ifndef GL_ELEMENT_ARRAY_BUFFER
+#define GL_ELEMENT_ARRAY_BUFFER 0x8893
+#endif
+#ifndef GL_STATIC_DRAW
+#define GL_STATIC_DRAW 0x88E4
+#endif
+#ifndef GL_DYNAMIC_DRAW
+#define GL_DYNAMIC_DRAW 0x88E8
+#endif
+#ifndef GL_STREAM_DRAW
+#define GL_STREAM_DRAW 0x88E0
+#endif
+#ifndef GL_FRAGMENT_SHADER
+#define GL_FRAGMENT_SHADER 0x8B30
+#endif
+#ifndef GL_VERTEX_SHADER
+#define GL_VERTEX_SHADER 0x8B31
+#endif
+#ifndef GL_COMPILE_STATUS
+#define GL_COMPILE_STATUS 0x8B81
+#endif
+#ifndef GL_LINK_STATUS
+#define GL_LINK_STATUS 0x8B82
+#endif
+#ifndef GL_INFO_LOG_LENGTH
+#define GL_INFO_LOG_LENGTH 0x8B84
+#endif
+#ifndef GL_TEXTURE0
+#define GL_TEXTURE0 0x84C0
+#endif
+#ifndef GL_CLAMP_TO_EDGE
+#define GL_CLAMP_TO_EDGE 0x812F
+#endif
+#ifndef GL_R32F
+#define GL_R32F 0x822E
+#endif
+#ifndef GL_RED
+#define GL_RED 0x1903
+#endif
+#ifndef GL_VERSION
+#define GL_VERSION 0x1F02
+#endif
+#ifndef GL_VERTEX_PROGRAM_POINT_SIZE
+#define GL_VERTEX_PROGRAM_POINT_SIZE 0x8642
+#endif
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT 0x0002
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#endif
+#ifndef GL_SYNC_FLUSH_COMMANDS_BIT
+#define GL_SYNC_FLUSH_COMMANDS_BIT 0x00000001
+#endif
+#ifndef GL_TIMEOUT_EXPIRED
+#define GL_TIMEOUT_EXPIRED 0x911B
+#endif
+#ifndef GL_WAIT_FAILED
+#define GL_WAIT_FAILED 0x911D
+#endif
+
+namespace gl {
+    typedef char Char;
+    typedef std::ptrdiff_t SizeiPtr;
+    typedef std::ptrdiff_t IntPtr;
+    typedef unsigned long long Uint64;
+    struct SyncObject;
+    typedef SyncObject* Sync;
+
+    extern void (GL_LOADER_CALL* GenBuffers)(GLsizei n, GLuint* buffers);
+    extern void (GL_LOADER_CALL* DeleteBuffers)(GLsizei n, const GLuint* buffers);
+    extern void (GL_LOADER_CALL* BindBuffer)(GLenum target, GLuint buffer);
+    extern void (GL_LOADER_CALL* BufferData)(GLenum target, SizeiPtr size, const void* data, GLenum usage);
+    extern void (GL_LOADER_CALL* BufferSubData)(GLenum target, IntPtr offset, SizeiPtr size, const void* data);
+
+    extern GLuint(GL_LOADER_CALL* CreateShader)(GLenum type);
+    extern void (GL_LOADER_CALL* DeleteShader)(GLuint shader);
+    extern void (GL_LOADER_CALL* ShaderSource)(GLuint shader, GLsizei count, const Char* const* source, const GLint* length);
+    extern void (GL_LOADER_CALL* CompileShader)(GLuint shader);
+    extern void (GL_LOADER_CALL* GetShaderiv)(GLuint shader, GLenum pname, GLint* params);
+    extern void (GL_LOADER_CALL* GetShaderInfoLog)(GLuint shader, GLsizei bufSize, GLsizei* length, Char* infoLog);
+    extern GLuint(GL_LOADER_CALL* CreateProgram)();
+    extern void (GL_LOADER_CALL* DeleteProgram)(GLuint program);
+    extern void (GL_LOADER_CALL* AttachShader)(GLuint program, GLuint shader);
+    extern void (GL_LOADER_CALL* BindAttribLocation)(GLuint program, GLuint index, const Char* name);
+    extern void (GL_LOADER_CALL* LinkProgram)(GLuint program);
+    extern void (GL_LOADER_CALL* GetProgramiv)(GLuint program, GLenum pname, GLint* params);
+    extern void (GL_LOADER_CALL* GetProgramInfoLog)(GLuint program, GLsizei bufSize, GLsizei* length, Char* infoLog);
+    extern void (GL_LOADER_CALL* UseProgram)(GLuint program);
+
+    extern GLint(GL_LOADER_CALL* GetUniformLocation)(GLuint program, const Char* name);
+    extern void (GL_LOADER_CALL* Uniform1i)(GLint location, GLint v0);
+    extern void (GL_LOADER_CALL* Uniform1f)(GLint location, GLfloat v0);
+    extern void (GL_LOADER_CALL* Uniform3f)(GLint location, GLfloat v0, GLfloat v1, GLfloat v2);
+    extern void (GL_LOADER_CALL* Uniform4f)(GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3);
+    extern void (GL_LOADER_CALL* Uniform3fv)(GLint location, GLsizei count, const GLfloat* value);
+
+    extern void (GL_LOADER_CALL* EnableVertexAttribArray)(GLuint index);
+    extern void (GL_LOADER_CALL* DisableVertexAttribArray)(GLuint index);
+    extern void (GL_LOADER_CALL* VertexAttribPointer)(GLuint index, GLint size, GLenum type,
+        GLboolean normalized, GLsizei stride, const void* pointer);
+    extern void (GL_LOADER_CALL* ActiveTexture)(GLenum texture);
+    extern void (GL_LOADER_CALL* MultiDrawArrays)(GLenum mode, const GLint* first, const GLsizei* count, GLsizei drawcount);
+
+    // Opcjonalne: bufory trwale mapowane (GL 4.4 / ARB_buffer_storage) i fence'y
+    // (GL 3.2 / ARB_sync). Uzywac tylko, gdy hasPersistentMapping() zwraca true.
+    extern void (GL_LOADER_CALL* BufferStorage)(GLenum target, SizeiPtr size, const void* data, GLbitfield flags);
+    extern void* (GL_LOADER_CALL* MapBufferRange)(GLenum target, IntPtr offset, SizeiPtr length, GLbitfield access);
+    extern GLboolean(GL_LOADER_CALL* UnmapBuffer)(GLenum target);
+    extern Sync(GL_LOADER_CALL* FenceSync)(GLenum condition, GLbitfield flags);
+    extern GLenum(GL_LOADER_CALL* ClientWaitSync)(Sync sync, GLbitfield flags, Uint64 timeout);
+    extern void (GL_LOADER_CALL* DeleteSync)(Sync sync);
+
+    // Wymaga biezacego kontekstu; false, gdy brakuje ktorejs funkcji
+    bool load();
+    bool isLoaded();
+    bool hasPersistentMapping();
+
+    // Kompilacja i linkowanie programu; atrybuty wiazane kolejno od 0 wg nazw
+    // z attributes (lista zakonczona nullptr). 0 przy bledzie (log na cerr).
+    GLuint buildProgram(const char* name, const char* vertexSource, const char* fragmentSource,
+        const char* const* attributes);
+}
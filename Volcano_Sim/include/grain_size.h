@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+#include "materia.h"
+#include "formulas.h"
+
+// Rozklad uziarnienia w skali phi = -log2(d / 1 mm) (phiMin = frakcja najgrubsza)
+struct GrainSizeDistribution {
+    enum Kind { LogNormal, RosinRammler };
+    Kind kind = LogNormal;
+    double phiMean = 0.0;     // LogNormal: srednia phi; RosinRammler: phi srednicy skali lambda
+    double phiSigma = 1.0;    // LogNormal: odchylenie phi; RosinRammler: wykladnik ksztaltu k
+    double phiMin = -1.0;
+    double phiMax = 1.0;
+};
+
+// Klasa ziarna: stala srednica i stale fizyczne liczone raz dla calej klasy
+struct SizeClass {
+    MaterialType type = MaterialType::VolcanicAsh;
+    double phi = 0.0;
+    double diameter = 0.0;        // [m]
+    double massFraction = 0.0;    // udzial masowy klasy w materiale
+    double density = 0.0;         // [kg/m3]
+    double invDensity = 0.0;
+    double stokesRate = 0.0;      // 18 mu / (rho d^2) [1/s]: opor Stokesa / masa
+    double reynoldsFactor = 0.0;  // d / mu: Re = rho_a |v| * reynoldsFactor
+    const physics::DragTable* drag = nullptr;
+};
+
+// Dyskretyzacja rozkladow wszystkich materialow na klasy; indeks klasy to
+// material * classesPerMaterial + k (k = 0 najgrubsza)
+class GrainSizeModel {
+public:
+    static constexpr int classesPerMaterial = 8;
+    static constexpr int materialCount = 10;
+
+    GrainSizeModel();
+
+    void setDistribution(MaterialType type, const GrainSizeDistribution& dist);
+    const GrainSizeDistribution& distribution(MaterialType type) const;
+
+    int classCount() const { return (int)classes_.size(); }
+    const SizeClass& sizeClass(int index) const { return classes_[index]; }
+
+    // Losowanie klasy z udzialow masowych (u z [0, 1))
+    int sampleClass(MaterialType type, double u) const;
+
+private:
+    void rebuild(MaterialType type);
+
+    GrainSizeDistribution dist_[materialCount];
+    std::vector<SizeClass> classes_;
+    std::vector<double> cumulative_;    // dystrybuanta udzialow w obrebie materialu
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <glm/glm.hpp>
+#include "dem_loader.h"
+#include "materia.h"
+
+// Kamera ze skryptu: klatki kluczowe orbity wokol krateru, jak w podgladzie
+// (kat, promien orbity, wysokosc nad kraterem). Plik tekstowy, jedna klatka
+// na wiersz: czas[s] kat[stopnie] promien[m] wysokosc[m]; '#' to komentarz.
+// Miedzy klatkami interpolacja liniowa, poza zakresem - skrajna klatka.
+class CameraPath {
+public:
+    struct Key {
+        double time = 0.0;
+        double angle = 0.0;     // [rad]
+        double radius = 8000.0;
+        double height = 4000.0;
+    };
+
+    bool load(const std::string& path);
+    // Jeden obrot w period sekund na stalym promieniu i wysokosci
+    void setOrbit(double radius, double height, double period);
+    Key at(double time) const;
+    bool empty() const { return keys.empty(); }
+
+    std::vector<Key> keys;
+};
+
+// Stan sceny do narysowania: kopia pozycji z chwili zrzutu, zeby symulacja
+// mogla liczyc dalej, gdy watek renderujacy rysuje
+struct SceneSnapshot {
+    int frame = 0;
+    double time = 0.0;
+    std::vector<float> particles;   // x, y, z, MaterialType na czastke
+    std::vector<float> landed;      // x, y, z na czastke
+
+    void capture(int frameIndex, double simTime, const std::vector<Materia>& airborne,
+        const std::vector<Materia>& onGround);
+};
+
+// Renderowanie bez okna i bez GL: rasteryzer programowy (z-bufor, cieniowanie
+// Gourauda jak w podgladzie) rysuje teren z DEM i czastki jako punkty, a klatki
+// zapisuje do PNG przez sterowniki GDAL MEM/PNG. Dziala na wlasnym watku
+// zasilanym zrzutami sceny; submit() czeka tylko, gdy w kolejce jest juz
+// queueLimit zrzutow.
+class HeadlessRenderer {
+public:
+    struct Settings {
+        int width = 1280;
+        int height = 720;
+        float zScale = 4.0f;
+        double baseZ = 0.0;
+        double craterX = 0.0, craterY = 0.0, craterZ = 0.0;
+        float fovDeg = 55.0f;
+        int meshSize = 512;             // maksymalna liczba wezlow siatki terenu na bok
+        std::string outputDir = ".";
+        std::string prefix = "frame_";
+        size_t queueLimit = 8;
+    };
+
+    HeadlessRenderer();
+    ~HeadlessRenderer();
+
+    bool start(const DEMLoader& dem, const CameraPath& camera, const Settings& settings);
+    void submit(SceneSnapshot&& snapshot);
+    // Czeka na wszystkie zlecone klatki i konczy watek
+    void finish();
+    int framesWritten() const { return framesWritten_; }
+
+    // Jedna klatka RGB (wiersze od gory) - bez watku, np. do podgladu
+    void renderFrame(const SceneSnapshot& snapshot, std::vector<unsigned char>& rgb) const;
+    static bool writePNG(const std::string& path, const std::vector<unsigned char>& rgb, int width, int height);
+
+private:
+    struct Vertex {
+        glm::vec4 clip;
+        glm::vec3 color;
+    };
+    struct Target {
+        int width, height;
+        std::vector<unsigned char>* rgb;
+        std::vector<float>* depth;
+    };
+
+    void buildMesh(const DEMLoader& dem);
+    void worker();
+    void rasterize(const Target& target, Vertex a, Vertex b, Vertex c) const;
+    void drawTriangle(const Target& target, const Vertex& a, const Vertex& b, const Vertex& c) const;
+    void drawPoint(const Target& target, const glm::mat4& mvp, float x, float y, float z,
+        const glm::vec3& color, int size) const;
+
+    Settings settings_;
+    CameraPath camera_;
+
+    // Siatka terenu: wierzcholki w ukladzie sceny (z juz przeskalowane), kolor oswietlony
+    int meshW_, meshH_;
+    std::vector<glm::vec3> meshPos_;
+    std::vector<glm::vec3> meshColor_;
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::deque<SceneSnapshot> queue_;
+    bool stopping_;
+    bool running_;
+    std::atomic<int> framesWritten_;
+};
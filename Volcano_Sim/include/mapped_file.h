@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+// Plik zmapowany do pamieci tylko do odczytu (mmap / MapViewOfFile).
+// Dane sa dostepne przez data()/size() do czasu zamkniecia; strony
+// wczytuje system przy pierwszym dostepie, bez kopiowania do bufora.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    bool isOpen() const { return opened_; }
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    bool opened_ = false;       // pusty plik jest poprawny, ale nie ma mapowania
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#endif
+};
@@ -36,6 +36,19 @@ static const double MaterialDensity[] = {
     2700.0,
     2500.0
 };
+// Sferycznosc (Wadell) do wspolczynnika oporu Gansera; gazy jako kule
+static const double MaterialSphericity[] = {
+    1.0,
+    1.0,
+    1.0,
+    1.0,
+    1.0,
+    1.0,
+    0.7,
+    0.8,
+    0.85,
+    0.6
+};
 static const int ParticleColor[10][3] = {
     {255,0,0},
     {0,255,0},
@@ -60,6 +73,19 @@ public:
     double density = 2500.0;
     double diameter = 200e-6;
     MaterialType type = MaterialType::VolcanicAsh;
+    // Fluktuacja wiatru widziana przez czastke (proces Ornsteina-Uhlenbecka)
+    double turb_u = 0.0;
+    double turb_v = 0.0;
+    double turb_w = 0.0;
+    // Indeks klasy uziarnienia w GrainSizeModel
+    unsigned short sizeClass = 0;
+    // Indeks lotu z tablicy balistycznej w Cloud::flights (-1 = calkowanie krokowe)
+    int flight = -1;
+    // Slot sladu w ParticleTrails (-1 = jeszcze nie losowana, -2 = bez sladu)
+    int trail = -1;
+    // Liczba rzeczywistych czastek reprezentowanych przez superczastke
+    // (emisja przerzedzana przez FrameBudget); dynamika liczona dla jednej
+    double weight = 1.0;
 
     Materia() = default;
     Materia(double x, double y, double z, double vx, double vy, double vz, double dens, double diam, MaterialType t);
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "gl_loader.h"
+#include "materia.h"
+
+// Czastki rysowane jednym glDrawArrays(GL_POINTS) na klatke. Pozycje i numer
+// materialu trafiaja do bufora trwale zmapowanego (glBufferStorage) podzielonego
+// na trzy regiony: CPU pisze do regionu, ktorego GPU juz nie czyta (fence po
+// kazdym rysowaniu). Bez GL 4.4 bufor jest osierocany przez glBufferData
+// i wypelniany glBufferSubData. Kolor z tablicy ParticleColor w shaderze.
+// Wejscie to ciagle zakresy wlaczonych materialow (Cloud::materialRange), wiec
+// wylaczone materialy nie sa nawet czytane. Czastki sortowane sa rownolegle
+// przez zliczanie do binGrid x binGrid kubelkow siatki XY rozpietej na zasiegu
+// czastek z poprzedniej klatki (wystajace trafiaja do skrajnych kubelkow);
+// kubelek, ktorego prostopadloscian lezy poza piramida widzenia, nie trafia
+// do bufora.
+class ParticleRenderer {
+public:
+    static constexpr int regions = 3;
+
+    ParticleRenderer();
+    ~ParticleRenderer();
+
+    // initialCapacity - czastek na region; bufor rosnie, gdy zabraknie miejsca
+    bool build(size_t initialCapacity = 1 << 16);
+    bool isBuilt() const { return program_ != 0 && buffer_ != 0; }
+    bool isPersistent() const { return mapped_ != nullptr; }
+    void release();
+
+    // Ciagly zakres czastek; landed - czastki na ziemi (czarne, wieksze)
+    struct Batch {
+        const Materia* particles;
+        size_t count;
+        bool landed;
+    };
+
+    // viewProj - proj * view jak w GL (do odrzucania kubelkow)
+    void draw(const std::vector<Batch>& batches, const glm::mat4& viewProj, float zScale, float baseZ);
+
+    static constexpr int binGrid = 32;
+
+    size_t drawnParticles() const { return drawn_; }
+    size_t culledParticles() const { return culled_; }
+
+private:
+    struct ParticleVertex {
+        float x, y, z;      // z - surowa wysokosc (skala w shaderze)
+        float material;     // MaterialType; landedMaterial dla czastek na ziemi
+    };
+    static constexpr int landedMaterial = 10;
+
+    bool allocate(size_t capacity);
+    void releaseBuffer();
+    void waitRegion(int region);
+    // Faza 1: kubelki, ich prostopadlosciany i pozycje zapisu; zwraca liczbe
+    // czastek w widocznych kubelkach. Faza 2: zapis widocznych do out.
+    size_t binParticles(const std::vector<Batch>& batches, const glm::mat4& viewProj,
+        float zScale, float baseZ);
+    void writeVisible(const std::vector<Batch>& batches, ParticleVertex* out);
+    template <typename Job> void parallel(Job&& job) const;
+    template <typename Fn> void forThreadRange(const std::vector<Batch>& batches, int t, Fn&& fn) const;
+
+    struct BinBox {
+        float min[3], max[3];
+    };
+    static constexpr int bins = binGrid * binGrid;
+
+    GLuint program_;
+    GLuint buffer_;
+    size_t capacity_;               // wierzcholkow na region
+    ParticleVertex* mapped_;        // poczatek bufora trwalego albo nullptr
+    gl::Sync fences_[regions];
+    int region_;
+    std::vector<ParticleVertex> staging_;
+
+    // Sortowanie: kubelek kazdej czastki, liczniki i prostopadlosciany per watek
+    std::vector<uint16_t> binOf_;
+    std::vector<size_t> binCount_;      // [watek * bins + kubelek], potem pozycja zapisu
+    std::vector<BinBox> binBox_;
+    std::vector<unsigned char> visible_;
+    float gridMin_[2], gridInv_[2];     // siatka kubelkow z zasiegu poprzedniej klatki
+    int threads_;
+    size_t total_;
+    size_t drawn_, culled_;
+
+    GLint locZScale_, locBaseZ_, locColors_;
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "gl_loader.h"
+#include "materia.h"
+
+// Slady czastek: co sampleEvery-ta nowa czastka dostaje slot (Materia::trail)
+// z historia ostatnich historyLength pozycji. Slot to pierscien o podwojnej
+// dlugosci - probka h trafia pod h i h + historyLength, wiec ostatnie pozycje
+// zawsze leza w buforze kolejno i kazdy slad jest jednym GL_LINE_STRIP bez
+// kopiowania. Wszystkie sloty rysowane jednym glMultiDrawArrays, alfa maleje
+// z wiekiem probki. Bufor alokowany raz w build(); przy GL 4.4 trwale
+// zmapowany i pisany w miejscu, inaczej kopia CPU wysylana glBufferSubData.
+class ParticleTrails {
+public:
+    static constexpr int notSampled = -2;
+
+    ParticleTrails();
+    ~ParticleTrails();
+
+    bool build(int maxTrails = 2048, int historyLength = 64);
+    bool isBuilt() const { return program_ != 0 && buffer_ != 0; }
+    void release();
+
+    // Wywolywac po kazdym kroku symulacji (dt - krok w sekundach): nadaje
+    // sloty nowym czastkom, dopisuje pozycje co sampleInterval sekund czasu
+    // symulacji i zwalnia sloty czastek, ktorych juz nie ma w chmurze. Przy
+    // enabled == false nic nie robi, a po wlaczeniu slady zaczynaja sie od nowa.
+    void record(std::vector<Materia>& particles, double dt);
+    void draw(unsigned materialMask, float zScale, float baseZ);
+
+    bool enabled = false;
+    int sampleEvery = 16;
+    double sampleInterval = 0.5;    // [s]; 64 probki = 32 s lotu
+
+    int activeTrails() const { return maxTrails_ - (int)freeSlots_.size(); }
+
+private:
+    struct TrailVertex {
+        float x, y, z;      // z - surowa wysokosc (skala w shaderze)
+        float sample;       // numer probki (wiek = newest - sample)
+        float material;
+    };
+    struct Slot {
+        int count;          // wypelnione probki (do historyLength)
+        int material;
+        unsigned lastSeen;  // ostatnia probka, w ktorej czastka byla w chmurze
+        bool used;
+    };
+
+    int maxTrails_, history_;
+    std::vector<Slot> slots_;
+    std::vector<int> freeSlots_;
+    std::vector<TrailVertex> staging_;      // gdy brak bufora trwalego
+    TrailVertex* mapped_;
+    unsigned sample_;       // numer biezacej probki
+    int head_;              // pozycja biezacej probki w pierscieniu [0, history)
+    double sinceSample_;    // czas symulacji od ostatniej probki [s]
+    size_t candidates_;     // licznik nowych czastek do losowania co sampleEvery
+    bool paused_;
+    bool dirty_;
+
+    std::vector<GLint> firsts_;
+    std::vector<GLsizei> counts_;
+
+    GLuint program_;
+    GLuint buffer_;
+    GLint locZScale_, locBaseZ_, locNewest_, locHistory_, locColors_;
+};
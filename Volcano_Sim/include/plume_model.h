@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+#include "weather.h"
+
+// Jednowymiarowy model calkowy kolumny erupcyjnej (Woods 1988, wiatr wg Bursik 2001).
+// Profil "top-hat": strumien masy Q = beta b^2 U, pedu M = beta b^2 U^2
+// i entalpii E = Q C T calkowane w gore od krateru:
+//   dQ/dz = 2 rho_a b (ks U + kw V_a)
+//   dM/dz = g (rho_a - beta) b^2
+//   dE/dz = C_a T_a dQ/dz - g Q
+// Wynik to tablica predkosci, promienia i osi kolumny co tableStep metrow;
+// czastki odczytuja z niej pionowy wiatr kolumny zamiast liczyc go same.
+class PlumeModel {
+public:
+    struct Source {
+        double x = 0.0, y = 0.0, z = 0.0;   // srodek krateru [m]
+        double radius = 30.0;               // promien wylotu [m]
+        double velocity = 60.0;             // predkosc wylotowa [m/s]
+        double temperature = 1200.0;        // [K]
+        double gasFraction = 0.03;          // udzial masowy gazu (H2O) u wylotu
+        double magmaDensity = 2500.0;       // gestosc piroklastow [kg/m3]
+    };
+
+    PlumeModel();
+
+    void setSource(const Source& source);
+    const Source& source() const { return source_; }
+
+    // Przelicza kolumne, gdy zmienilo sie zrodlo lub tablica pogody
+    bool update(const Weather& weather);
+    void solve(const Weather& weather);
+    bool isSolved() const { return !w_.empty(); }
+
+    // Pionowa predkosc kolumny w punkcie (profil Gaussa o tym samym strumieniu
+    // objetosci co top-hat); false poza kolumna
+    bool sample(double x, double y, double z, double& w) const;
+
+    double columnHeight() const { return columnTop_; }           // [m n.p.m.]
+    double neutralBuoyancyHeight() const { return neutralHeight_; }
+    bool collapsed() const { return collapsed_; }
+
+    double ks = 0.09;           // wspolczynnik porywania w kolumnie
+    double kw = 0.9;            // wspolczynnik porywania przez wiatr
+    double tableStep = 10.0;    // [m]
+
+private:
+    Source source_;
+    bool dirty_;
+    unsigned long long solvedVersion_;
+
+    // Tablica od z = source_.z co tableStep
+    std::vector<float> w_;      // predkosc top-hat [m/s]
+    std::vector<float> b_;      // promien [m]
+    std::vector<float> axisX_;  // przesuniecie osi przez wiatr [m]
+    std::vector<float> axisY_;
+    double columnTop_;
+    double neutralHeight_;
+    bool collapsed_;
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "cloud.h"
+#include "frame_budget.h"
+#include "startup_tasks.h"
+
+class DepositMap;
+class ParticleTrails;
+
+// Parametry erupcji z menu albo z wiersza polecen (--headless)
+struct EruptionParams {
+    int particleCount = 3000;   // czastki rzeczywiste; 0 = losowo 2000-2999
+    float turbulence = 0.1f;
+    float windSpeed = 2.0f;     // [m/s], wiatr U/V = 0.8/0.6 predkosci
+    float craterRadius = 30.0f;
+    float minSpeed = 40.0f;
+    float maxSpeed = 80.0f;
+};
+
+// Scenariusz wspolny dla okna i trybu bez okna: wczytanie danych symulacji,
+// krater na srodku DEM, start erupcji i jeden krok symulacji. Petle w main
+// roznia sie tylko tym, co robia z wynikiem kroku (okno, zrzuty klatek).
+class Scenario {
+public:
+    // Rastry wieksze niz ten prog sa czytane strumieniowo, kafel po kaflu [piksele]
+    static constexpr long long demStreamingThreshold = 64LL * 1024 * 1024;
+
+    struct LoadTasks {
+        int weather, height, wind;
+    };
+    // Zadania: profil pogody, wysokosci DEM i siatka oplywu po wysokosciach
+    static LoadTasks addLoadTasks(StartupTasks& tasks, Weather& weather, const std::string& weatherCSV,
+        DEMLoader& dem, const std::string& heightPath, TerrainWind& terrainWind);
+    // Warunki, gdy profil pogody sie nie wczytal
+    static Weather defaultWeather();
+
+    // Granice terenu, krater na srodku DEM i pogoda na wysokosci krateru
+    Scenario(DEMLoader& dem, Weather& weather);
+
+    // Wiatr i turbulencja do pogody, zrodlo kolumny i tablice bomb
+    void start(const EruptionParams& params, Cloud& cloud, PlumeModel& plume, BallisticTable& ballistics);
+    // Krok dt: emisja przerzedzana przez budget (wagi superczastek), ruch
+    // chmury, piramida DEM, slady i nowe opadle czastki - osadzone na terenie
+    // i dodane do depozytu albo, poza DEM, przeniesione do particlesOverflow.
+    // trails i deposit moga byc nullptr.
+    void step(Cloud& cloud, const FrameBudget& budget, double dt,
+        ParticleTrails* trails = nullptr, DepositMap* deposit = nullptr);
+
+    const EruptionParams& params() const { return params_; }
+    int emittedParticles() const { return emitted_; }
+    // Czastki rzeczywiste (suma Materia::weight), a nie superczastki - przy
+    // przerzedzonej emisji dopiero te liczby sumuja sie do emittedParticles
+    double landedParticles() const { return landedWeight_; }
+    double overflowParticles() const { return overflowWeight_; }
+    static double airborneParticles(const Cloud& cloud);
+
+    double minX, maxX, minY, maxY;
+    double craterX, craterY, craterZ;
+    double minElev, maxElev;
+    std::vector<Materia> particlesOnEarth;
+    std::vector<Materia> particlesOverflow;
+
+private:
+    DEMLoader& dem_;
+    Weather& weather_;
+    EruptionParams params_;
+    int emitted_;           // czastki rzeczywiste wyemitowane do tej pory
+    double landedWeight_, overflowWeight_;
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <future>
+#include <functional>
+
+// Graf zadan startowych: kazde zadanie to funkcja bool() uruchamiana przez
+// std::async na wlasnym watku, gdy zakoncza sie jego poprzedniki (niezaleznie
+// od ich wyniku - zadanie samo sprawdza, czy ma na czym pracowac). poll()
+// wolany co klatke z watku okna uruchamia gotowe zadania i zbiera wyniki,
+// wiec petla menu dziala, gdy dane sie wczytuja. Zadania nie moga dotykac GL.
+class StartupTasks {
+public:
+    enum class State { Waiting, Running, Done, Failed };
+
+    ~StartupTasks();
+
+    // Zwraca numer zadania do uzycia w after; wszystkie zadania dodawac
+    // przed pierwszym poll()
+    int add(const std::string& name, std::function<bool()> job, std::vector<int> after = {});
+    void poll();
+    // Czeka na wszystkie zadania (takze te jeszcze nieuruchomione)
+    void wait();
+
+    bool finished() const;
+    bool succeeded(int task) const { return tasks_[task].state == State::Done; }
+    // Ulamek zakonczonych zadan [0, 1]
+    float progress() const;
+
+    int count() const { return (int)tasks_.size(); }
+    const std::string& name(int task) const { return tasks_[task].name; }
+    State state(int task) const { return tasks_[task].state; }
+    double seconds(int task) const { return tasks_[task].seconds; }
+
+private:
+    struct Task {
+        std::string name;
+        std::function<bool()> job;
+        std::vector<int> after;
+        State state = State::Waiting;
+        std::future<bool> result;
+        double seconds = 0.0;
+    };
+
+    std::vector<Task> tasks_;
+};
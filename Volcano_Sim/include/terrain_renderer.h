@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+#include "gl_loader.h"
+#include "dem_loader.h"
+#include "deposit_map.h"
+
+// Teren dzielony na kafle (chunked LOD): kazdy kafel ma kilka poziomow
+// szczegolowosci co 1, 2, 4, ... pikseli DEM. Poziom wybierany jest z bledu
+// ekranowego: blad geometryczny poziomu (z piramidy DEM) rzutowany z odleglosci
+// kamery nie moze przekroczyc pixelTolerance. Kafle poza piramida widzenia sa
+// pomijane, a pionowe "fartuchy" na brzegach zaslaniaja szczeliny miedzy
+// kaflami o roznych poziomach. Bufory wierzcholkow tworzone sa dopiero przy
+// pierwszym uzyciu i zwalniane najdawniej uzywane po przekroczeniu budzetu.
+// Wierzcholki: (x, y, surowa wysokosc, gradient terenu); skala wysokosci
+// i poziom odniesienia to uniformy shadera, wiec klawisze Z/X nie przebudowuja siatki.
+class TerrainRenderer {
+public:
+    static constexpr int levels = 6;
+
+    TerrainRenderer();
+    ~TerrainRenderer();
+
+    // tileCells - bok kafla w pikselach DEM (potega dwojki >= 2^(levels-1))
+    bool build(const DEMLoader& dem, int tileCells = 128);
+    bool isBuilt() const { return program_ != 0 && !chunks_.empty(); }
+    void release();
+
+    // Rysuje z biezacymi macierzami GL; proj/view sluza do odrzucania kafli
+    // i bledu ekranowego (musza byc te same co zaladowane do GL)
+    void draw(const glm::mat4& proj, const glm::mat4& view, int viewportHeight,
+        GLuint colorTexture, float zScale, float baseZ, const float lightPos[3]);
+
+    // Nakladka depozytu mieszana z kolorem terenu (nullptr = bez nakladki)
+    void setDeposit(const DepositMap* deposit) { deposit_ = deposit; }
+
+    double pixelTolerance = 2.0;            // dopuszczalny blad ekranowy [px]
+    size_t maxResidentVertices = 8u << 20;  // budzet buforow kafli
+    int maxBuildsPerFrame = 32;             // nowe bufory na klatke (reszta grubiej)
+
+    int drawnChunks() const { return drawnChunks_; }
+    size_t drawnVertices() const { return drawnVertices_; }
+
+private:
+    struct Chunk {
+        int i0, j0;                 // pierwszy wezel siatki (kolumna, rzad od minY)
+        float minX, minY, maxX, maxY;
+        float minZ, maxZ;           // surowe wysokosci (z piramidy)
+        float error[levels];        // blad geometryczny poziomu [m]
+        float skirt;                // glebokosc fartucha [m]
+        GLuint buffer[levels];
+        unsigned lastUsed[levels];
+    };
+
+    float nodeHeight(int i, int j) const;
+    void estimateErrors(Chunk& c) const;
+    bool buildLevel(Chunk& c, int level);
+    void evict();
+
+    const DEMLoader* dem_;
+    int nx_, ny_, tileCells_;
+    double minX_, minY_, px_, py_;
+    float minElev_;
+
+    std::vector<Chunk> chunks_;
+    GLuint indexBuffer_[levels];
+    GLsizei indexCount_[levels];
+    GLsizei vertexCount_[levels];
+    size_t residentVertices_;
+    unsigned frame_;
+    unsigned pyramidRevision_;
+    int drawnChunks_;
+    size_t drawnVertices_;
+
+    const DepositMap* deposit_;
+
+    GLuint program_;
+    GLint locZScale_, locBaseZ_, locTexMap_, locLight_, locColorMap_;
+    GLint locDepositMap_, locDepositTexMap_, locDepositScale_;
+    float texMap_[4];       // minX, minY, 1/szerokosc, 1/wysokosc (wspolrzedne tekstury)
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "dem_loader.h"
+#include "weather.h"
+
+// Diagnostyczne pole wiatru nad terenem (model zachowania masy, jak CALMET/WindNinja).
+// Wiatr z profilu Weather jest poprawiany tak, aby byl bezdywergentny i nie
+// przeplywal przez teren: u = u0 + dphi/dx, v = v0 + dphi/dy, w = T * dphi/dz,
+// gdzie phi spelnia d2phi/dx2 + d2phi/dy2 + T d2phi/dz2 = -div(u0).
+// Siatka kartezjanska nad DEM, komorki ponizej terenu sa lite; rownanie
+// rozwiazywane czerwono-czarnym SOR na kilku watkach raz na klatke pogodowa.
+// Przechowywana jest tylko poprawka wzgledem profilu, wiec interpolacja
+// czasowa profilu dziala dalej miedzy przeliczeniami.
+class TerrainWind {
+public:
+    TerrainWind();
+
+    // Siatka pokrywa caly DEM: maxCellsXY komorek wzdluz dluzszego boku,
+    // w pionie od najnizszego punktu terenu do heightAboveTerrain nad najwyzszym
+    bool build(const DEMLoader& dem, int maxCellsXY = 128, double dz = 50.0,
+        double heightAboveTerrain = 2000.0);
+    bool isBuilt() const { return nx_ > 0; }
+
+    // Przelicza pole, gdy zmienila sie tablica pogody (nowa klatka godzinowa);
+    // zwraca true, jesli bylo przeliczenie
+    bool update(const Weather& weather);
+    void solve(const Weather& weather);
+
+    // Poprawka wiatru wzgledem profilu, interpolacja trojliniowa;
+    // false poza siatka (wtedy obowiazuje sam profil)
+    bool sample(double x, double y, double z, double& du, double& dv, double& dw) const;
+
+    // T = alpha1^2 / alpha2^2: wieksze wartosci pozwalaja na wiecej ruchu
+    // pionowego (oplyw gory gora), mniejsze wymuszaja oplyw bokiem (stabilna atmosfera)
+    double stability = 1.0;
+    double omega = 1.9;            // wspolczynnik nadrelaksacji
+    int maxIterations = 1000;
+    double tolerance = 1e-3;       // docelowe residuum wzgledem poczatkowej dywergencji
+
+private:
+    size_t index(int i, int j, int k) const { return ((size_t)k * ny_ + j) * nx_ + i; }
+    void sweep(int k0, int k1, int colour, double& maxResidual);
+
+    int nx_, ny_, nz_;
+    double x0_, y0_, z0_;          // naroznik siatki (min x, min y, dol)
+    double dx_, dy_, dz_;
+
+    std::vector<uint8_t> solid_;
+    std::vector<uint8_t> open_;    // bity: sasiad -x, +x, -y, +y, -z, +z jest komorka plynu
+    std::vector<double> phi_;      // zachowywane miedzy przeliczeniami (szybszy start)
+    std::vector<double> rhs_;
+    std::vector<double> diagInv_;
+
+    std::vector<float> du_, dv_, dw_;
+    unsigned long long solvedVersion_;
+};
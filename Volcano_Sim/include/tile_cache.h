@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vector>
+#include <list>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <cstdint>
+
+// Ograniczony, bezpieczny watkowo cache LRU kafli wysokosci.
+// Kafle wczytywane sa przez funkcje ladujaca (np. GDAL RasterIO) na zadanie
+// albo w tle przez watek prefetch.
+class TileCache {
+public:
+    struct Tile {
+        int tx = 0, ty = 0;     // indeks kafla
+        int x0 = 0, y0 = 0;     // pierwszy piksel kafla w rastrze
+        int w = 0, h = 0;       // rzeczywisty rozmiar (kafle brzegowe sa mniejsze)
+        std::vector<float> data;
+
+        float at(int px, int py) const { return data[(size_t)(py - y0) * w + (px - x0)]; }
+    };
+
+    using Loader = std::function<bool(int tx, int ty, Tile& out)>;
+
+    TileCache(size_t maxTiles, Loader loader);
+    ~TileCache();
+
+    TileCache(const TileCache&) = delete;
+    TileCache& operator=(const TileCache&) = delete;
+
+    // Zwraca kafel, wczytujac go synchronicznie jesli nie ma go w pamieci
+    std::shared_ptr<const Tile> get(int tx, int ty);
+    // Zwraca kafel tylko jesli jest juz w pamieci
+    std::shared_ptr<const Tile> peek(int tx, int ty);
+    // Zleca wczytanie kafla w tle (ignorowane gdy kolejka jest pelna)
+    void request(int tx, int ty);
+
+    size_t size() const;
+    size_t capacity() const { return maxTiles_; }
+
+private:
+    struct Entry {
+        std::shared_ptr<const Tile> tile;
+        std::list<uint64_t>::iterator lruIt;
+    };
+
+    static uint64_t key(int tx, int ty) {
+        return ((uint64_t)(uint32_t)ty << 32) | (uint32_t)tx;
+    }
+
+    std::shared_ptr<const Tile> findLocked(uint64_t k);
+    void insertLocked(uint64_t k, std::shared_ptr<const Tile> tile);
+    void workerLoop();
+
+    size_t maxTiles_;
+    Loader loader_;
+
+    mutable std::mutex mutex_;          // chroni mape i liste LRU
+    std::mutex ioMutex_;                // serializuje odczyty (uchwyt GDAL nie jest watkowo bezpieczny)
+    std::list<uint64_t> lru_;           // front = ostatnio uzyty
+    std::unordered_map<uint64_t, Entry> entries_;
+
+    std::deque<uint64_t> pending_;
+    std::unordered_set<uint64_t> pendingSet_;
+    std::condition_variable pendingCv_;
+    bool stop_ = false;
+    std::thread worker_;
+};
@@ -11,20 +11,72 @@ struct WeatherSample {
     double temperature;   // [C]
     double pressure;      // [Pa]
     double humidity;      // [%]
+    double time;          // [s od 1970-01-01 UTC], 0 dla profilu bez czasu
+};
+
+// Stan atmosfery w wezle tablicy wysokosci
+struct AtmosphereSample {
+    float wind_u;         // [m/s]
+    float wind_v;         // [m/s]
+    float temperature;    // [C]
+    float pressure;       // [Pa]
+    float density;        // [kg/m3]
+    float sigma_h;        // odchylenie std. turbulencji poziomej [m/s]
+    float sigma_w;        // odchylenie std. turbulencji pionowej [m/s]
+    float tau_h;          // lagranzowska skala czasu turbulencji poziomej [s]
+    float tau_w;          // lagranzowska skala czasu turbulencji pionowej [s]
 };
 
 class WeatherDataLoader {
 public:
+    // Kolumny rozpoznawane po naglowku: prosty profil (altitude, wind_u, ...)
+    // albo eksport open-meteo z poziomami wysokosci (_10m) i cisnienia (_850hPa).
+    // Wynik posortowany wg (czas, wysokosc).
     static std::vector<WeatherSample> LoadCSV(const std::string& file);
 };
 
 class Weather {
 private:
-    std::vector<WeatherSample> weatherProfile;
+    std::vector<WeatherSample> weatherProfile;      // profil biezacej klatki czasowej
     double currentAltitude;
     WeatherSample interpolatedWeather;
 
+    // Cala seria (czas, wysokosc); klatka k to zakres [frameStart[k], frameStart[k+1])
+    std::vector<WeatherSample> weatherSeries;
+    std::vector<double> frameTimes;
+    std::vector<size_t> frameStart;
+    size_t currentFrame;
+    double frameAlpha;        // waga klatki k+1 w biezacej chwili
+    double playbackStart;     // czas serii odpowiadajacy t = 0 symulacji [s od 1970]
+
+    // Tablice o stalym kroku wysokosci dla klatek k i k+1: stan atmosfery
+    // to indeks + interpolacja w wysokosci i w czasie
+    std::vector<AtmosphereSample> altitudeTable;
+    std::vector<AtmosphereSample> altitudeTableNext;
+    double tableStep;
+    double tableInvStep;
+    double tableMaxAltitude;
+    unsigned long long bakeCount;   // rosnie przy kazdej zmianie tablic
+
     WeatherSample interpolateForAltitude(double altitude) const;
+    static WeatherSample interpolateProfile(const std::vector<WeatherSample>& profile, double altitude);
+    std::vector<WeatherSample> frameProfile(size_t frame) const;
+    void bakeTable(const std::vector<WeatherSample>& profile, std::vector<AtmosphereSample>& table) const;
+    void bakeNextTable();
+    void selectFrame(double simTime, bool force);
+
+    static AtmosphereSample lerpSample(const AtmosphereSample& a, const AtmosphereSample& b, float t) {
+        return AtmosphereSample{
+            a.wind_u + t * (b.wind_u - a.wind_u),
+            a.wind_v + t * (b.wind_v - a.wind_v),
+            a.temperature + t * (b.temperature - a.temperature),
+            a.pressure + t * (b.pressure - a.pressure),
+            a.density + t * (b.density - a.density),
+            a.sigma_h + t * (b.sigma_h - a.sigma_h),
+            a.sigma_w + t * (b.sigma_w - a.sigma_w),
+            a.tau_h + t * (b.tau_h - a.tau_h),
+            a.tau_w + t * (b.tau_w - a.tau_w) };
+    }
 
 public:
     double altitude;
@@ -54,4 +106,60 @@ public:
 
     void getWeatherAtAltitude(double alt, double& out_wind_u, double& out_wind_v,
         double& out_temp, double& out_pres, double& out_hum) const;
+
+    // Wypelnia tablice wysokosci (domyslnie co 10 m do 200 km); powyzej
+    // profilu cisnienie i gestosc maleja hydrostatycznie
+    void bakeAltitudeTable(double step = 10.0, double maxAltitude = 200000.0);
+    bool hasAltitudeTable() const { return !altitudeTable.empty(); }
+
+    // Odtwarzanie serii godzinowej: simTime [s] liczony od playbackStart.
+    // Tablica jest wypalana tylko przy zmianie klatki, miedzy klatkami interpolacja
+    void setPlaybackStart(double epochTime);
+    void advanceTo(double simTime);
+    size_t frameCount() const { return frameTimes.size(); }
+    size_t currentFrameIndex() const { return currentFrame; }
+    // Zmienia sie, gdy tablice zostaly przeliczone (nowa klatka lub bakeAltitudeTable)
+    unsigned long long tableVersion() const { return bakeCount; }
+    double currentTime() const;
+
+    // Parametry turbulencji dla wysokosci bez tablicy (profil lub warunki stale)
+    AtmosphereSample turbulenceFor(double alt, double groundLevel, double windSpeed) const;
+
+    AtmosphereSample atmosphereAt(double alt) const {
+        if (altitudeTable.empty()) {
+            double wu, wv, temp, pres, hum;
+            getWeatherAtAltitude(alt, wu, wv, temp, pres, hum);
+            AtmosphereSample s = turbulenceFor(alt,
+                weatherProfile.empty() ? 0.0 : weatherProfile.front().altitude, std::sqrt(wu * wu + wv * wv));
+            s.wind_u = (float)wu;
+            s.wind_v = (float)wv;
+            s.temperature = (float)temp;
+            s.pressure = (float)pres;
+            s.density = (float)(pres / (287.05 * (temp + 273.15)));
+            return s;
+        }
+        double x = alt * tableInvStep;
+        if (x < 0.0) x = 0.0;
+        size_t last = altitudeTable.size() - 1;
+        size_t i = (size_t)x;
+        if (i >= last) i = last - 1;
+        double t = x - (double)i;
+        if (t > 1.0) t = 1.0;
+        AtmosphereSample s = lerpSample(altitudeTable[i], altitudeTable[i + 1], (float)t);
+        if (frameAlpha > 0.0) {
+            AtmosphereSample n = lerpSample(altitudeTableNext[i], altitudeTableNext[i + 1], (float)t);
+            s = lerpSample(s, n, (float)frameAlpha);
+        }
+        return s;
+    }
+
+    void sampleAtmosphere(double alt, double& out_wind_u, double& out_wind_v,
+        double& out_temp, double& out_pres, double& out_density) const {
+        AtmosphereSample s = atmosphereAt(alt);
+        out_wind_u = s.wind_u;
+        out_wind_v = s.wind_v;
+        out_temp = s.temperature;
+        out_pres = s.pressure;
+        out_density = s.density;
+    }
 };
\ No newline at end of file
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+// Siatkowe pole wiatru/temperatury/cisnienia (x, y, z, t) z pliku binarnego VWF1.
+// W pamieci sa tylko dwie klatki czasowe potrzebne do interpolacji (k, k+1);
+// watek w tle wczytuje klatke k+2 do bufora zapasowego.
+//
+// Format pliku (little-endian):
+//   char[4]  "VWF1"
+//   int32    nx, ny, nz, nt
+//   double   x0, y0, dx, dy     wspolrzedne geo wezla (0,0) i krok siatki [m]
+//   double   z0, dz             pierwszy poziom i krok wysokosci [m n.p.m.]
+//   double   t0, dt             czas pierwszej klatki i krok [s czasu symulacji]
+//   nt klatek, kazda nz*ny*nx punktow GridPoint (indeks (k*ny + j)*nx + i)
+class WindField {
+public:
+    struct GridPoint {
+        float u, v, w;        // [m/s]
+        float temperature;    // [C]
+        float pressure;       // [Pa]
+    };
+
+    WindField();
+    ~WindField();
+
+    WindField(const WindField&) = delete;
+    WindField& operator=(const WindField&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+    bool isLoaded() const { return loaded_; }
+
+    // Wolane raz na krok symulacji (przed petla po czastkach)
+    void advanceTo(double simTime);
+
+    // Interpolacja trojliniowa w przestrzeni i liniowa w czasie;
+    // false gdy punkt lezy poza siatka
+    bool sample(double x, double y, double z,
+        double& out_u, double& out_v, double& out_w,
+        double& out_temp, double& out_pres) const;
+
+private:
+    bool readFrame(int index, std::vector<GridPoint>& out);
+    void requestFrame(int index);
+    void workerLoop();
+
+    bool loaded_;
+    int nx_, ny_, nz_, nt_;
+    double x0_, y0_, dx_, dy_;
+    double z0_, dz_;
+    double t0_, dt_;
+    std::ifstream file_;
+    std::streamoff dataOffset_;
+
+    std::vector<GridPoint> frameA_;    // klatka k
+    std::vector<GridPoint> frameB_;    // klatka k+1
+    std::vector<GridPoint> back_;      // klatka wczytywana w tle
+    int frameIndex_;                   // k
+    double alpha_;                     // waga klatki k+1
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    int requested_;                    // indeks zleconej klatki (-1 = brak)
+    int ready_;                        // indeks klatki gotowej w back_ (-1 = brak)
+    bool readOk_;
+    bool stop_;
+    std::thread worker_;
+};
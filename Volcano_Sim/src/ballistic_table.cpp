@@ -0,0 +1,242 @@
+#include "../include/ballistic_table.h"
+#include "../include/formulas.h"
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cmath>
+
+using namespace std;
+
+BallisticTable::BallisticTable() : built_(false), launchZ_(0.0), maxDrop_(0.0) {
+}
+
+bool BallisticTable::hasClass(int sizeClass) const {
+    return sizeClass >= 0 && sizeClass < (int)tables_.size() && !tables_[sizeClass].empty();
+}
+
+bool BallisticTable::build(const GrainSizeModel& grains, const Weather& weather,
+    double launchZ, double maxDrop, double minDiameter) {
+    auto start = chrono::steady_clock::now();
+    launchZ_ = launchZ;
+    maxDrop_ = max(maxDrop, 1.0);
+    tables_.assign(grains.classCount(), vector<float>());
+
+    size_t entries = (size_t)speedCount * zenithCount * windAlongCount * windCrossCount;
+    vector<int> classes;
+    for (int c = 0; c < grains.classCount(); c++) {
+        if (grains.sizeClass(c).diameter < minDiameter) continue;
+        tables_[c].assign(entries * entrySize, 0.0f);
+        classes.push_back(c);
+    }
+    if (classes.empty()) {
+        cerr << "BallisticTable: brak klas o srednicy >= " << minDiameter << " m\n";
+        built_ = false;
+        return false;
+    }
+
+    // Gestosc powietrza raz z profilu; wyzej niz 30 km nad startem stala
+    vector<float> density((size_t)((maxDrop_ + 30000.0) / densityStep) + 2);
+    for (size_t i = 0; i < density.size(); i++) {
+        density[i] = weather.atmosphereAt(launchZ_ - maxDrop_ + i * densityStep).density;
+    }
+
+    // Zadanie = (klasa, predkosc); watki pobieraja kolejne z licznika
+    int jobs = (int)classes.size() * speedCount;
+    atomic<int> next(0);
+    auto worker = [&]() {
+        for (int job = next++; job < jobs; job = next++) {
+            int c = classes[job / speedCount];
+            int is = job % speedCount;
+            const SizeClass& sc = grains.sizeClass(c);
+            double speed = speedMax * is / max(1, speedCount - 1);
+            for (int iz = 0; iz < zenithCount; iz++) {
+                double zenith = zenithMax * iz / max(1, zenithCount - 1);
+                for (int ia = 0; ia < windAlongCount; ia++) {
+                    double wa = -windMax + 2.0 * windMax * ia / max(1, windAlongCount - 1);
+                    for (int ic = 0; ic < windCrossCount; ic++) {
+                        double wc = windMax * ic / max(1, windCrossCount - 1);
+                        integrate(sc, density, speed, zenith, wa, wc,
+                            &tables_[c][entryIndex(is, iz, ia, ic) * entrySize]);
+                    }
+                }
+            }
+        }
+    };
+
+    int nThreads = (int)min<unsigned>(max(1u, thread::hardware_concurrency()), (unsigned)jobs);
+    vector<thread> pool;
+    for (int t = 1; t < nThreads; t++) pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool) t.join();
+
+    built_ = true;
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "BallisticTable: " << classes.size() << " klas, " << entries
+        << " trajektorii na klase (" << ms << " ms)\n";
+    return true;
+}
+
+void BallisticTable::integrate(const SizeClass& sc, const vector<float>& density,
+    double speed, double zenith, double windAlong, double windCross, float* entry) const {
+    const physics::DragTable& drag = *sc.drag;
+    const double gravity = physics::gravityBoost * physics::g;
+    const double h = integrationStep;
+
+    // Uklad startu: os s wzdluz azymutu, c w poprzek, z w gore
+    double s = 0.0, c = 0.0, z = 0.0;
+    double vs = speed * sin(zenith), vc = 0.0, vz = speed * cos(zenith);
+
+    auto accel = [&](double z, double vs, double vc, double vz,
+        double& as, double& ac, double& az) {
+        double x = (z + maxDrop_) / densityStep;
+        x = min(max(x, 0.0), (double)density.size() - 1.000001);
+        size_t i = (size_t)x;
+        double rho = density[i] + (x - i) * (density[i + 1] - density[i]);
+        double rs = vs - windAlong;
+        double rc = vc - windCross;
+        double vrel = sqrt(rs * rs + rc * rc + vz * vz);
+        double k = -sc.stokesRate * drag.lookup(rho * vrel * sc.reynoldsFactor);
+        as = k * rs;
+        ac = k * rc;
+        az = k * vz - gravity + physics::g * rho * sc.invDensity;
+    };
+
+    vector<float> ts, ss, cs, zs;
+    ts.push_back(0.0f); ss.push_back(0.0f); cs.push_back(0.0f); zs.push_back(0.0f);
+
+    // RK2 (punkt srodkowy) do zejscia maxDrop ponizej startu
+    double t = 0.0;
+    while (z > -maxDrop_ && t < maxFlightTime) {
+        double as1, ac1, az1;
+        accel(z, vs, vc, vz, as1, ac1, az1);
+        double ms = vs + 0.5 * h * as1, mc = vc + 0.5 * h * ac1, mz = vz + 0.5 * h * az1;
+        double as2, ac2, az2;
+        accel(z + 0.5 * h * vz, ms, mc, mz, as2, ac2, az2);
+        s += h * ms;
+        c += h * mc;
+        z += h * mz;
+        vs += h * as2;
+        vc += h * ac2;
+        vz += h * az2;
+        t += h;
+        ts.push_back((float)t); ss.push_back((float)s); cs.push_back((float)c); zs.push_back((float)z);
+    }
+
+    // Przeprobkowanie na samples punktow rownomiernie w czasie
+    entry[0] = (float)t;
+    float* outS = entry + 1;
+    float* outC = outS + samples;
+    float* outZ = outC + samples;
+    size_t j = 0;
+    for (int k = 0; k < samples; k++) {
+        double tk = t * k / (samples - 1);
+        while (j + 2 < ts.size() && ts[j + 1] < tk) j++;
+        double span = ts[j + 1] - ts[j];
+        double a = span > 0.0 ? min(1.0, max(0.0, (tk - ts[j]) / span)) : 0.0;
+        outS[k] = (float)(ss[j] + a * (ss[j + 1] - ss[j]));
+        outC[k] = (float)(cs[j] + a * (cs[j + 1] - cs[j]));
+        outZ[k] = (float)(zs[j] + a * (zs[j + 1] - zs[j]));
+    }
+}
+
+bool BallisticTable::trajectory(int sizeClass, double x, double y, double z,
+    double speed, double zenith, double azimuth,
+    double windU, double windV, Trajectory& out) const {
+    if (!built_ || !hasClass(sizeClass)) return false;
+
+    // Wiatr w ukladzie startu; wiatr z prawej to odbicie lustrzane wiatru z lewej
+    double ca = cos(azimuth), sa = sin(azimuth);
+    double wa = windU * ca + windV * sa;
+    double wc = -windU * sa + windV * ca;
+    double mirror = wc < 0.0 ? -1.0 : 1.0;
+    wc = fabs(wc);
+
+    const double eps = 1e-9;
+    double f[4] = {
+        speed / speedMax * (speedCount - 1),
+        zenith / zenithMax * (zenithCount - 1),
+        (wa + windMax) / (2.0 * windMax) * (windAlongCount - 1),
+        wc / windMax * (windCrossCount - 1)
+    };
+    int counts[4] = { speedCount, zenithCount, windAlongCount, windCrossCount };
+    int i0[4];
+    double frac[4];
+    for (int d = 0; d < 4; d++) {
+        if (f[d] < -eps || f[d] > counts[d] - 1 + eps) return false;
+        double v = min(max(f[d], 0.0), (double)counts[d] - 1);
+        i0[d] = min((int)v, max(0, counts[d] - 2));
+        frac[d] = v - i0[d];
+    }
+
+    // Interpolacja wieloliniowa 16 wezlow
+    const vector<float>& table = tables_[sizeClass];
+    double T = 0.0;
+    double s[samples] = {}, c[samples] = {}, h[samples] = {};
+    for (int corner = 0; corner < 16; corner++) {
+        double w = 1.0;
+        int idx[4];
+        for (int d = 0; d < 4; d++) {
+            int bit = (corner >> d) & 1;
+            idx[d] = min(i0[d] + bit, counts[d] - 1);
+            w *= bit ? frac[d] : 1.0 - frac[d];
+        }
+        if (w == 0.0) continue;
+        const float* e = &table[entryIndex(idx[0], idx[1], idx[2], idx[3]) * entrySize];
+        T += w * e[0];
+        const float* es = e + 1;
+        const float* ec = es + samples;
+        const float* ez = ec + samples;
+        for (int k = 0; k < samples; k++) {
+            s[k] += w * es[k];
+            c[k] += w * ec[k];
+            h[k] += w * ez[k];
+        }
+    }
+
+    out.x0 = x;
+    out.y0 = y;
+    out.z0 = z;
+    out.dt = T / (samples - 1);
+    for (int k = 0; k < samples; k++) {
+        double cc = mirror * c[k];
+        out.x[k] = (float)(s[k] * ca - cc * sa);
+        out.y[k] = (float)(s[k] * sa + cc * ca);
+        out.z[k] = (float)h[k];
+    }
+    return true;
+}
+
+bool BallisticTable::land(const Trajectory& path, const DEMLoader& dem, Landing& out) {
+    if (path.dt <= 0.0) return false;
+    for (int k = 0; k + 1 < samples; k++) {
+        double ax = path.x0 + path.x[k], ay = path.y0 + path.y[k], az = path.z0 + path.z[k];
+        double bx = path.x0 + path.x[k + 1], by = path.y0 + path.y[k + 1], bz = path.z0 + path.z[k + 1];
+        double tHit;
+        if (!dem.intersectSegment(ax, ay, az, bx, by, bz, tHit)) continue;
+
+        // Uderzenie przy wznoszeniu (sciana krateru, zbocze tuz przy starcie)
+        // to przypadek brzegowy - zostawiamy go calkowaniu
+        if (bz > az) return false;
+
+        out.x = ax + (bx - ax) * tHit;
+        out.y = ay + (by - ay) * tHit;
+        double ground = dem.getGroundZ(out.x, out.y);
+        out.z = isnan(ground) ? az + (bz - az) * tHit : ground;
+        out.time = (k + tHit) * path.dt;
+        out.vx = (bx - ax) / path.dt;
+        out.vy = (by - ay) / path.dt;
+        out.vz = (bz - az) / path.dt;
+        return true;
+    }
+    return false;
+}
+
+bool BallisticTable::land(int sizeClass, double x, double y, double z,
+    double speed, double zenith, double azimuth,
+    double windU, double windV, const DEMLoader& dem, Landing& out) const {
+    Trajectory path;
+    if (!trajectory(sizeClass, x, y, z, speed, zenith, azimuth, windU, windV, path)) return false;
+    return land(path, dem, out);
+}
@@ -7,30 +7,100 @@
 
 using namespace std;
 
-Cloud::Cloud() : weatherSystem(nullptr) {}
-Cloud::Cloud(Weather* weather) : weatherSystem(weather) {}
+Cloud::Cloud() : weatherSystem(nullptr), windField(nullptr), terrainWind(nullptr), plume(nullptr),
+    ballistics(nullptr), useBallisticTable(true), simTime(0.0),
+    classStart(grainSizes.classCount() + 1, 0), prefetchPhase(0) {}
+Cloud::Cloud(Weather* weather) : weatherSystem(weather), windField(nullptr), terrainWind(nullptr), plume(nullptr),
+    ballistics(nullptr), useBallisticTable(true), simTime(0.0),
+    classStart(grainSizes.classCount() + 1, 0), prefetchPhase(0) {}
 Cloud::~Cloud() {}
 void Cloud::setWeatherSystem(Weather* weather) { weatherSystem = weather; }
+void Cloud::setWindField(WindField* field) { windField = field; }
+void Cloud::setTerrainWind(TerrainWind* wind) { terrainWind = wind; }
+void Cloud::setPlume(PlumeModel* model) { plume = model; }
+void Cloud::setBallisticTable(BallisticTable* table) { ballistics = table; }
 
 static mt19937& rng() {
     static thread_local mt19937 gen((random_device())());
     return gen;
 }
 
+// Stabilne sortowanie przez zliczanie wg klasy uziarnienia
+void Cloud::regroup() {
+    int classes = grainSizes.classCount();
+    classStart.assign(classes + 1, 0);
+    for (const auto& p : particles) classStart[p.sizeClass + 1]++;
+    for (int c = 0; c < classes; c++) classStart[c + 1] += classStart[c];
+
+    vector<size_t> next(classStart.begin(), classStart.end() - 1);
+    vector<Materia> sorted(particles.size());
+    for (const auto& p : particles) sorted[next[p.sizeClass]++] = p;
+    particles.swap(sorted);
+}
+
+// Nowe czastki z ogona (od firstNew) wstawiane w zakresy klas w miejscu, bez
+// kopii calej chmury: zakres klasy c przesuwa sie o liczbe nowych czastek klas
+// nizszych, a przesuniecie to przeniesienie jego poczatkowych czastek na koniec
+// (kolejnosc wewnatrz klasy nie ma znaczenia). Koszt ~ klasy x nowe czastki.
+void Cloud::insertGrouped(size_t firstNew) {
+    int classes = grainSizes.classCount();
+    if (classStart.size() != (size_t)classes + 1 || classStart.back() != firstNew) {
+        regroup();
+        return;
+    }
+    incoming.assign(particles.begin() + firstNew, particles.end());
+    // shift[c] - nowe czastki klas < c, czyli przesuniecie zakresu klasy c
+    vector<size_t> shift(classes + 1, 0);
+    for (const auto& p : incoming) shift[p.sizeClass + 1]++;
+    for (int c = 0; c < classes; c++) shift[c + 1] += shift[c];
+
+    // Od najwyzszej klasy: miejsce docelowe zwolnila juz klasa wyzsza (albo
+    // ogon z nowymi czastkami, skopiowany do incoming)
+    for (int c = classes - 1; c >= 0 && shift[c] > 0; c--) {
+        size_t s = classStart[c], e = classStart[c + 1];
+        size_t moved = min(shift[c], e - s);
+        size_t dst = max(e, s + shift[c]);
+        for (size_t k = 0; k < moved; k++) particles[dst + k] = particles[s + k];
+    }
+    // Nowe czastki klasy c na koncu jej przesunietego zakresu
+    vector<size_t> next(classes);
+    for (int c = 0; c < classes; c++) next[c] = classStart[c + 1] + shift[c];
+    for (const auto& p : incoming) particles[next[p.sizeClass]++] = p;
+    for (int c = 0; c <= classes; c++) classStart[c] += shift[c];
+}
+
+// Po stabilnym usunieciu czastek kolejnosc klas zostaje, wystarczy policzyc zakresy
+void Cloud::rebuildClassRanges() {
+    int classes = grainSizes.classCount();
+    classStart.assign(classes + 1, 0);
+    for (const auto& p : particles) classStart[p.sizeClass + 1]++;
+    for (int c = 0; c < classes; c++) classStart[c + 1] += classStart[c];
+}
+
+bool Cloud::materialRange(MaterialType type, size_t& begin, size_t& end) const {
+    begin = end = 0;
+    int classes = grainSizes.classCount();
+    if (classStart.size() != (size_t)classes + 1 || classStart.back() != particles.size()) return false;
+    int m = static_cast<int>(type);
+    begin = classStart[m * GrainSizeModel::classesPerMaterial];
+    end = classStart[(m + 1) * GrainSizeModel::classesPerMaterial];
+    return true;
+}
+
 void Cloud::generateParticles(size_t N,
     double crater_x, double crater_y, double crater_z,
     double crater_radius,
     double min_speed, double max_speed,
-    double min_diameter, double max_diameter,
-    int choice)
+    int choice, double weight)
 {
     uniform_real_distribution<double> ang(0.0, 2.0 * M_PI);
     uniform_real_distribution<double> ang2(0.0, 0.05 * M_PI);
     uniform_real_distribution<double> r01(0.0, 1.0);
     uniform_real_distribution<double> spd(min_speed, max_speed);
-    uniform_real_distribution<double> diam(min_diameter, max_diameter);
 
-    this->particles.reserve(this->particles.size() + N);
+    // Bez reserve(size + N): dokladna rezerwacja przy kazdej emisji kopiowalaby
+    // cala chmure, push_back rosnie geometrycznie
+    size_t firstNew = particles.size();
 
     for (size_t i = 0; i < N; ++i) {
         double u = r01(rng());
@@ -48,8 +118,6 @@ void Cloud::generateParticles(size_t N,
         double vy = speed * sin(phi) * sin(theta);
         double vz = speed * cos(phi);
 
-        double d = diam(rng());
-
         MaterialType type;
         switch (choice) {
         case 0: type = MaterialType::H2O; break;
@@ -64,10 +132,76 @@ void Cloud::generateParticles(size_t N,
         case 9: type = MaterialType::VolcanicGlass; break;
         }
 
-        Materia m(px, py, pz, vx, vy, vz,
-            MaterialDensity[static_cast<int>(type)], d, type);
+        // Srednica z rozkladu uziarnienia materialu (losowanie klasy wg udzialu masowego)
+        int sizeClass = grainSizes.sampleClass(type, r01(rng()));
+        const SizeClass& sc = grainSizes.sizeClass(sizeClass);
+
+        Materia m(px, py, pz, vx, vy, vz, sc.density, sc.diameter, type);
+        m.sizeClass = (unsigned short)sizeClass;
+        m.weight = weight;
+
+        // Bomby: trajektoria z tablicy, punkt upadku wyznaczany przy pierwszym kroku
+        // (potrzebny DEM); wiatr z profilu na wysokosci startu
+        if (useBallisticTable && ballistics != nullptr && weatherSystem != nullptr &&
+            ballistics->hasClass(sizeClass)) {
+            AtmosphereSample atm = weatherSystem->atmosphereAt(pz);
+            BallisticFlight f;
+            if (ballistics->trajectory(sizeClass, px, py, pz, speed, phi, theta,
+                atm.wind_u, atm.wind_v, f.path)) {
+                f.landing.time = -1.0;
+                f.launchTime = simTime;
+                if (!freeFlights.empty()) {
+                    m.flight = freeFlights.back();
+                    freeFlights.pop_back();
+                    flights[m.flight] = f;
+                }
+                else {
+                    m.flight = (int)flights.size();
+                    flights.push_back(f);
+                }
+            }
+        }
         particles.push_back(m);
     }
+
+    insertGrouped(firstNew);
+}
+
+void Cloud::releaseFlight(Materia& p) {
+    freeFlights.push_back(p.flight);
+    p.flight = -1;
+}
+
+// Pozycja bomby z lamanej tablicowej; false, gdy lot trzeba policzyc krokowo
+bool Cloud::advanceFlight(Materia& p, double dt, const DEMLoader& dem) {
+    BallisticFlight& f = flights[p.flight];
+    if (f.landing.time < 0.0 && !BallisticTable::land(f.path, dem, f.landing)) {
+        releaseFlight(p);
+        return false;
+    }
+
+    double tau = simTime + dt - f.launchTime;
+    if (tau >= f.landing.time) {
+        // Upadek: czastka trafia do osadzenia w tym samym kroku
+        p.position_x = f.landing.x;
+        p.position_y = f.landing.y;
+        p.position_z = f.landing.z;
+        p.setVelocity(f.landing.vx, f.landing.vy, f.landing.vz);
+        releaseFlight(p);
+        return true;
+    }
+
+    const int last = BallisticTable::samples - 1;
+    double fk = tau / f.path.dt;
+    int k = min((int)fk, last - 1);
+    double a = fk - k;
+    p.position_x = f.path.x0 + f.path.x[k] + a * (f.path.x[k + 1] - f.path.x[k]);
+    p.position_y = f.path.y0 + f.path.y[k] + a * (f.path.y[k + 1] - f.path.y[k]);
+    p.position_z = f.path.z0 + f.path.z[k] + a * (f.path.z[k + 1] - f.path.z[k]);
+    p.setVelocity((f.path.x[k + 1] - f.path.x[k]) / f.path.dt,
+        (f.path.y[k + 1] - f.path.y[k]) / f.path.dt,
+        (f.path.z[k + 1] - f.path.z[k]) / f.path.dt);
+    return true;
 }
 
 void Cloud::update(double dt, double airDensity,
@@ -76,85 +210,169 @@ void Cloud::update(double dt, double airDensity,
     const DEMLoader& dem, double wind_w,
     double turbulence)
 {
-    uniform_real_distribution<double> turb(-1.0, 1.0);
+    normal_distribution<double> gauss(0.0, 1.0);
 
-    for (auto& p : particles) {
+    if (weatherSystem != nullptr) weatherSystem->advanceTo(simTime);
+    if (windField != nullptr) windField->advanceTo(simTime);
+    // Przeliczenie tylko przy nowej klatce pogodowej
+    if (terrainWind != nullptr && weatherSystem != nullptr) terrainWind->update(*weatherSystem);
+    if (plume != nullptr && weatherSystem != nullptr) plume->update(*weatherSystem);
 
-        double wu = wind_u;
-        double wv = wind_v;
-        double ww = wind_w;
+    // Zakresy klas nieaktualne (czastki dodane z zewnatrz) - przegrupowanie
+    int classes = grainSizes.classCount();
+    if (classStart.size() != (size_t)classes + 1 || classStart.back() != particles.size()) regroup();
 
-        if (weatherSystem != nullptr) {
-            double temp, pres, hum;
-            weatherSystem->getWeatherAtAltitude(p.position_z, wu, wv, temp, pres, hum);
-            airDensity = weatherSystem->CalculateAirDensity();
-            wu += weatherSystem->GenerateTurbulence() * 0.08;
-            wv += weatherSystem->GenerateTurbulence() * 0.08;
-            ww += weatherSystem->GenerateTurbulence() * 0.04;
-        }
-        else {
-            wu += turb(rng()) * turbulence * 0.3;
-            wv += turb(rng()) * turbulence * 0.3;
-            ww += turb(rng()) * turbulence * 0.2;
-        }
+    for (int c = 0; c < classes; c++) {
+        if (classStart[c] == classStart[c + 1]) continue;
+        // Stale klasy wyciagniete przed petle po jednorodnej partii czastek
+        const SizeClass& sc = grainSizes.sizeClass(c);
+        const physics::DragTable& drag = *sc.drag;
+        const double stokesRate = sc.stokesRate;
+        const double reynoldsFactor = sc.reynoldsFactor;
+        const double invDensity = sc.invDensity;
+        const double gravity = physics::gravityBoost * physics::g;
+
+        for (size_t i = classStart[c]; i < classStart[c + 1]; i++) {
+            Materia& p = particles[i];
+            if (p.flight >= 0 && advanceFlight(p, dt, dem)) continue;
+
+            double wu = wind_u;
+            double wv = wind_v;
+            double ww = wind_w;
+            // Gestosc powietrza dla tej czastki; parametr zostaje wartoscia domyslna
+            double rhoAir = airDensity;
 
-        double rel_vx = p.vel_x - wu;
-        double rel_vy = p.vel_y - wv;
-        double rel_vz = p.vel_z - ww;
+            // Pole siatkowe 4D ma pierwszenstwo; poza jego zasiegiem zostaje profil pionowy
+            double temp, pres;
+            double fu, fv, fw;
+            bool fromField = windField != nullptr &&
+                windField->sample(p.position_x, p.position_y, p.position_z, fu, fv, fw, temp, pres);
+            if (fromField) {
+                wu = fu;
+                wv = fv;
+                ww += fw;
+                rhoAir = pres / (287.05 * (temp + 273.15));
+            }
+
+            double sigmaH, sigmaW, tauH, tauW;
+            if (weatherSystem != nullptr) {
+                AtmosphereSample atm = weatherSystem->atmosphereAt(p.position_z);
+                if (!fromField) {
+                    wu = atm.wind_u;
+                    wv = atm.wind_v;
+                    rhoAir = atm.density;
+                    // Oplyw terenu: poprawka z pola diagnostycznego dodana do profilu
+                    double du, dv, dw;
+                    if (terrainWind != nullptr &&
+                        terrainWind->sample(p.position_x, p.position_y, p.position_z, du, dv, dw)) {
+                        wu += du;
+                        wv += dv;
+                        ww += dw;
+                    }
+                }
+                sigmaH = atm.sigma_h;
+                sigmaW = atm.sigma_w;
+                tauH = atm.tau_h;
+                tauW = atm.tau_w;
+            }
+            else {
+                sigmaH = turbulence * 0.3;
+                sigmaW = turbulence * 0.2;
+                tauH = 200.0;
+                tauW = 50.0;
+            }
+
+            // Turbulencja jako proces Ornsteina-Uhlenbecka niesiony przez czastke:
+            // dokladne rozwiazanie dla kroku dt, wiec wariancja i dyspersja
+            // nie zaleza od dlugosci kroku
+            double decayH = exp(-dt / tauH);
+            double decayW = exp(-dt / tauW);
+            double kickH = sigmaH * sqrt(1.0 - decayH * decayH);
+            double kickW = sigmaW * sqrt(1.0 - decayW * decayW);
+            p.turb_u = p.turb_u * decayH + kickH * gauss(rng());
+            p.turb_v = p.turb_v * decayH + kickH * gauss(rng());
+            p.turb_w = p.turb_w * decayW + kickW * gauss(rng());
+            wu += p.turb_u;
+            wv += p.turb_v;
+            ww += p.turb_w;
 
-        double Fx = 0.0, Fy = 0.0, Fz = 0.0;
-        physics::dragForceVector(rel_vx, rel_vy, rel_vz, p, airDensity, Fx, Fy, Fz);
+            // Wznoszenie w kolumnie erupcyjnej z tablicy modelu calkowego
+            double plumeW;
+            if (plume != nullptr && plume->sample(p.position_x, p.position_y, p.position_z, plumeW)) {
+                ww += plumeW;
+            }
 
-        double Fg = physics::sphereGravity(p);
-        double Fb = physics::sphereBuoyancyForce(p, airDensity);
+            double rel_vx = p.vel_x - wu;
+            double rel_vy = p.vel_y - wv;
+            double rel_vz = p.vel_z - ww;
 
-        double updraft = max(0.0, 1.0 - (p.position_z / 20000.0));
-        double F_updraft = updraft * 0.005 * airDensity;
+            // Przyspieszenia ze stalych klasy: opor -18 mu f(Re) / (rho d^2) v_rel,
+            // ciezar (ze wzmocnieniem 1.4) i wypor g rho_a / rho
+            double vrel = sqrt(rel_vx * rel_vx + rel_vy * rel_vy + rel_vz * rel_vz);
+            double k = -stokesRate * drag.lookup(rhoAir * vrel * reynoldsFactor);
+            double ax = k * rel_vx;
+            double ay = k * rel_vy;
+            double az = k * rel_vz - gravity + physics::g * rhoAir * invDensity;
 
-        double total_fx = Fx;
-        double total_fy = Fy;
-        double total_fz = -Fg*1.4 + Fb + Fz + F_updraft;
+            p.vel_x += ax * dt;
+            p.vel_y += ay * dt;
+            p.vel_z += az * dt;
 
-        double inv_m = 1.0 / (p.mass() + 1e-12);
-        double ax = total_fx * inv_m;
-        double ay = total_fy * inv_m;
-        double az = total_fz * inv_m;
+            double old_x = p.position_x;
+            double old_y = p.position_y;
+            double old_z = p.position_z;
 
-        p.vel_x += ax * dt;
-        p.vel_y += ay * dt;
-        p.vel_z += az * dt;
+            p.position_x += p.vel_x * dt;
+            p.position_y += p.vel_y * dt;
+            p.position_z += p.vel_z * dt;
 
-        p.position_x += p.vel_x * dt;
-        p.position_y += p.vel_y * dt;
-        p.position_z += p.vel_z * dt;
+            // Odcinek przebyty w kroku testowany jest w calosci (drzewo min/max DEM),
+            // wiec szybka czastka nie przeleci przez grzbiet przy duzym dt.
+            // Czastki wysoko nad terenem odpadaja juz na najwyzszym poziomie drzewa.
+            double tHit;
+            if (!dem.intersectSegment(old_x, old_y, old_z,
+                p.position_x, p.position_y, p.position_z, tHit)) continue;
 
-        if (p.vel_z > 0&&p.position_z<=dem.getGroundZ(p.position_x,p.position_y)) {
+            p.position_x = old_x + (p.position_x - old_x) * tHit;
+            p.position_y = old_y + (p.position_y - old_y) * tHit;
             double ground = dem.getGroundZ(p.position_x, p.position_y);
-            double hL = dem.getGroundZ(p.position_x - 1.0, p.position_y);
-            double hR = dem.getGroundZ(p.position_x + 1.0, p.position_y);
-            double hD = dem.getGroundZ(p.position_x, p.position_y - 1.0);
-            double hU = dem.getGroundZ(p.position_x, p.position_y + 1.0);
-            double nx = hL - hR;
-            double ny = hD - hU;
-            double nz = 2.0;
-            double len = sqrt(nx * nx + ny * ny + nz * nz);
-            if (len < 1e-9) len = 1.0;
-            nx /= len;
-            ny /= len;
-            nz /= len;
-            double dot = p.vel_x * nx + p.vel_y * ny + p.vel_z * nz;
-            p.vel_x = p.vel_x - 2.0 * dot * nx;
-            p.vel_y = p.vel_y - 2.0 * dot * ny;
-            p.vel_z = p.vel_z - 2.0 * dot * nz;
-            p.vel_x *= 0.55;
-            p.vel_y *= 0.55;
-            p.vel_z *= 0.55;
-            p.position_z = ground + 0.05;
+            if (isnan(ground)) ground = old_z + (p.position_z - old_z) * tHit;
+            p.position_z = ground;
+
+            if (p.vel_z > 0) {
+                double hL = dem.getGroundZ(p.position_x - 1.0, p.position_y);
+                double hR = dem.getGroundZ(p.position_x + 1.0, p.position_y);
+                double hD = dem.getGroundZ(p.position_x, p.position_y - 1.0);
+                double hU = dem.getGroundZ(p.position_x, p.position_y + 1.0);
+                double nx = hL - hR;
+                double ny = hD - hU;
+                double nz = 2.0;
+                double len = sqrt(nx * nx + ny * ny + nz * nz);
+                if (len < 1e-9) len = 1.0;
+                nx /= len;
+                ny /= len;
+                nz /= len;
+                double dot = p.vel_x * nx + p.vel_y * ny + p.vel_z * nz;
+                p.vel_x = p.vel_x - 2.0 * dot * nx;
+                p.vel_y = p.vel_y - 2.0 * dot * ny;
+                p.vel_z = p.vel_z - 2.0 * dot * nz;
+                p.vel_x *= 0.55;
+                p.vel_y *= 0.55;
+                p.vel_z *= 0.55;
+                p.position_z = ground + 0.05;
+            }
         }
     }
 
     auto it = remove_if(this->particles.begin(), this->particles.end(),
         [&](const Materia& p) {
+            if (p.position_z >= 200000) {
+                vec2.push_back(p);
+                return true;
+            }
+            if (!(p.position_z <= dem.maxHeightBound(p.position_x, p.position_y))) {
+                return false;
+            }
             double ground = dem.getGroundZ(p.position_x, p.position_y);
             if (p.position_z <= ground&&p.vel_z<=0) {
                 Materia g = p;
@@ -162,11 +380,28 @@ void Cloud::update(double dt, double airDensity,
                 vec.push_back(g);
                 return true;
             }
-            if (p.position_z >= 200000) {
-                return true;
-            }
             return false;
         });
 
     this->particles.erase(it, this->particles.end());
+    rebuildClassRanges();
+    simTime += dt;
+
+    // W trybie strumieniowym DEM doczytujemy w tle kafle pod miejscami,
+    // do ktorych zmierzaja czastki (korytarz pod pioropuszem)
+    if (dem.isStreaming()) {
+        const double horizon = 5.0; // [s]
+        // Co stride-ta czastka, z przesunieciem zmienianym co krok - kilka
+        // tysiecy punktow pokrywa korytarz chmury, a po stride krokach kazda
+        // czastka byla probkowana. Bufor zyje w chmurze, bez alokacji na krok.
+        const size_t maxPoints = 4096;
+        size_t stride = max<size_t>(1, particles.size() / maxPoints);
+        prefetchPhase = (prefetchPhase + 1) % stride;
+        prefetchPoints.clear();
+        for (size_t i = prefetchPhase; i < particles.size(); i += stride) {
+            const Materia& p = particles[i];
+            prefetchPoints.emplace_back(p.position_x + p.vel_x * horizon, p.position_y + p.vel_y * horizon);
+        }
+        dem.prefetch(prefetchPoints);
+    }
 }
@@ -6,18 +6,39 @@
 #include <limits>
 #include <iostream>
 #include <algorithm>
+#include <thread>
+#include <atomic>
 
 using namespace std;
 
+// log2(kPyramidCell): numer poziomu drzewa (wzy 2^l px) dla pyramid_[0]
+static const int kPyramidBaseLevel = 3;
+static_assert((1 << kPyramidBaseLevel) == DEMLoader::kPyramidCell, "kPyramidBaseLevel = log2(kPyramidCell)");
+
 DEMLoader::DEMLoader()
     : nx_(0), ny_(0), loaded_(false), hasNoData_(false), noDataVal_(0.0),
-    hasColors_(false) {
+    hasColors_(false), quantize_(false), qScale_(1.0), qOffset_(0.0), pyramidRevision_(0), streamDs_(nullptr), streamBand_(nullptr), tileSize_(0),
+    tilesX_(0), tilesY_(0), prefetchCall_(0) {
     for (int i = 0; i < 6; i++) gt_[i] = 0.0;
 }
 
-DEMLoader::~DEMLoader() {}
+DEMLoader::~DEMLoader() {
+    closeStream();
+}
+
+void DEMLoader::closeStream() {
+    // Najpierw cache (zatrzymuje wtek prefetch), dopiero potem uchwyt GDAL
+    tiles_.reset();
+    if (streamDs_) {
+        GDALClose(streamDs_);
+        streamDs_ = nullptr;
+        streamBand_ = nullptr;
+    }
+}
 
 bool DEMLoader::loadHeight(const string& path) {
+    closeStream();
+
     // Inicjalizacja biblioteki GDAL
     GDALAllRegister();
 
@@ -59,9 +80,19 @@ bool DEMLoader::loadHeight(const string& path) {
     }
 
     // Alokacja pamici i odczyt danych wysokociowych
-    data_.resize((size_t)nx_ * (size_t)ny_);
-    CPLErr err = heightBand->RasterIO(GF_Read, 0, 0, nx_, ny_,
-        data_.data(), nx_, ny_, GDT_Float32, 0, 0);
+    CPLErr err;
+    if (quantize_) {
+        data_.clear();
+        data_.shrink_to_fit();
+        err = readQuantized(heightBand) ? CE_None : CE_Failure;
+    }
+    else {
+        qdata_.clear();
+        qdata_.shrink_to_fit();
+        data_.resize((size_t)nx_ * (size_t)ny_);
+        err = heightBand->RasterIO(GF_Read, 0, 0, nx_, ny_,
+            data_.data(), nx_, ny_, GDT_Float32, 0, 0);
+    }
 
     if (err != CE_None) {
         cerr << "DEMLoader: blad RasterIO przy odczycie wysokosci\n";
@@ -71,11 +102,359 @@ bool DEMLoader::loadHeight(const string& path) {
 
     GDALClose(ds);
     loaded_ = true;
+    buildPyramid();
     cout << "DEMLoader: wczytano wysokosci z " << path << "\n";
     cout << "  Wymiary: " << nx_ << " x " << ny_ << "\n";
+    if (quantize_)
+        cout << "  Kwantyzacja 16-bit: krok " << qScale_ << " m, offset " << qOffset_ << " m\n";
+    return true;
+}
+
+void DEMLoader::setHeightQuantization(bool enabled) {
+    quantize_ = enabled;
+}
+
+bool DEMLoader::isQuantized() const {
+    return !qdata_.empty();
+}
+
+bool DEMLoader::readQuantized(GDALRasterBand* band) {
+    // Dwa przejcia pasami wierszy: najpierw zakres, potem kwantyzacja,
+    // eby nigdy nie trzyma penego rastra float w pamici
+    const int stripRows = 256;
+    vector<float> strip((size_t)nx_ * stripRows);
+
+    float lo = numeric_limits<float>::max();
+    float hi = -numeric_limits<float>::max();
+    for (int y0 = 0; y0 < ny_; y0 += stripRows) {
+        int rows = min(stripRows, ny_ - y0);
+        CPLErr err = band->RasterIO(GF_Read, 0, y0, nx_, rows,
+            strip.data(), nx_, rows, GDT_Float32, 0, 0);
+        if (err != CE_None) return false;
+        for (size_t i = 0; i < (size_t)nx_ * rows; i++) {
+            float v = strip[i];
+            if (hasNoData_ && v == (float)noDataVal_) continue;
+            lo = min(lo, v);
+            hi = max(hi, v);
+        }
+    }
+    if (lo > hi) { lo = 0.0f; hi = 0.0f; }
+
+    qOffset_ = lo;
+    qScale_ = max((double)(hi - lo) / (double)(kQuantNoData - 1), 1e-6);
+    double inv = 1.0 / qScale_;
+
+    qdata_.resize((size_t)nx_ * (size_t)ny_);
+    for (int y0 = 0; y0 < ny_; y0 += stripRows) {
+        int rows = min(stripRows, ny_ - y0);
+        CPLErr err = band->RasterIO(GF_Read, 0, y0, nx_, rows,
+            strip.data(), nx_, rows, GDT_Float32, 0, 0);
+        if (err != CE_None) return false;
+        uint16_t* out = qdata_.data() + (size_t)y0 * nx_;
+        for (size_t i = 0; i < (size_t)nx_ * rows; i++) {
+            float v = strip[i];
+            if (hasNoData_ && v == (float)noDataVal_) {
+                out[i] = kQuantNoData;
+                continue;
+            }
+            double code = floor((v - qOffset_) * inv + 0.5);
+            out[i] = (uint16_t)min(max(code, 0.0), (double)(kQuantNoData - 1));
+        }
+    }
+    return true;
+}
+
+bool DEMLoader::rasterSize(const string& path, int& w, int& h) {
+    GDALAllRegister();
+    GDALDataset* ds = (GDALDataset*)GDALOpen(path.c_str(), GA_ReadOnly);
+    if (!ds) return false;
+    w = ds->GetRasterXSize();
+    h = ds->GetRasterYSize();
+    GDALClose(ds);
+    return true;
+}
+
+// Rozmiar podgldu z zachowaniem proporcji
+static void previewSize(int nx, int ny, int maxSize, int& w, int& h) {
+    int longest = max(nx, ny);
+    if (longest <= maxSize) { w = nx; h = ny; return; }
+    w = max(1, (int)((long long)nx * maxSize / longest));
+    h = max(1, (int)((long long)ny * maxSize / longest));
+}
+
+bool DEMLoader::readHeightPreview(const string& path, int maxSize, vector<float>& heights, int& w, int& h) {
+    GDALAllRegister();
+    GDALDataset* ds = (GDALDataset*)GDALOpen(path.c_str(), GA_ReadOnly);
+    if (!ds) {
+        cerr << "DEMLoader: nie mozna otworzyc pliku wysokosci: " << path << "\n";
+        return false;
+    }
+    GDALRasterBand* band = ds->GetRasterBand(1);
+    previewSize(band->GetXSize(), band->GetYSize(), maxSize, w, h);
+    heights.resize((size_t)w * h);
+    CPLErr err = band->RasterIO(GF_Read, 0, 0, band->GetXSize(), band->GetYSize(),
+        heights.data(), w, h, GDT_Float32, 0, 0);
+    int hasNo = 0;
+    float nd = (float)band->GetNoDataValue(&hasNo);
+    GDALClose(ds);
+    if (err != CE_None) {
+        cerr << "DEMLoader: blad RasterIO przy odczycie podgladu wysokosci\n";
+        heights.clear();
+        return false;
+    }
+    if (hasNo) {
+        for (float& v : heights)
+            if (v == nd) v = numeric_limits<float>::quiet_NaN();
+    }
+    return true;
+}
+
+bool DEMLoader::readColorPreview(const string& path, int maxSize, vector<unsigned char>& rgba, int& w, int& h) {
+    GDALAllRegister();
+    GDALDataset* ds = (GDALDataset*)GDALOpen(path.c_str(), GA_ReadOnly);
+    if (!ds) {
+        cerr << "DEMLoader: nie mozna otworzyc pliku kolorow: " << path << "\n";
+        return false;
+    }
+    if (ds->GetRasterCount() < 3) {
+        cerr << "DEMLoader: plik kolorow ma za malo pasm (potrzeba minimum 3)\n";
+        GDALClose(ds);
+        return false;
+    }
+    int nx = ds->GetRasterXSize(), ny = ds->GetRasterYSize();
+    previewSize(nx, ny, maxSize, w, h);
+    rgba.assign((size_t)w * h * 4, 255);
+    // Alfa z pasma 4 tylko, gdy jest opisane jako alfa (jak w loadColors)
+    int bands = (ds->GetRasterCount() >= 4 &&
+        ds->GetRasterBand(4)->GetColorInterpretation() == GCI_AlphaBand) ? 4 : 3;
+    int bandMap[4] = { 1, 2, 3, 4 };
+    CPLErr err = ds->RasterIO(GF_Read, 0, 0, nx, ny, rgba.data(), w, h,
+        GDT_Byte, bands, bandMap, 4, (GSpacing)w * 4, 1);
+    GDALClose(ds);
+    if (err != CE_None) {
+        cerr << "DEMLoader: blad przy odczycie podgladu kolorow\n";
+        rgba.clear();
+        return false;
+    }
     return true;
 }
 
+bool DEMLoader::openStreaming(const string& path, int tileSize, size_t maxTiles) {
+    closeStream();
+    data_.clear();
+    data_.shrink_to_fit();
+    qdata_.clear();
+    qdata_.shrink_to_fit();
+
+    GDALAllRegister();
+
+    // Plik pozostaje otwarty przez cay czas ycia loadera
+    streamDs_ = (GDALDataset*)GDALOpen(path.c_str(), GA_ReadOnly);
+    if (!streamDs_) {
+        cerr << "DEMLoader: nie mozna otworzyc pliku wysokosci: " << path << "\n";
+        return false;
+    }
+    if (streamDs_->GetRasterCount() < 1) {
+        cerr << "DEMLoader: brak pasm w pliku wysokosci\n";
+        closeStream();
+        return false;
+    }
+
+    if (streamDs_->GetGeoTransform(gt_) != CE_None) {
+        for (int i = 0; i < 6; i++) gt_[i] = 0.0;
+    }
+
+    streamBand_ = streamDs_->GetRasterBand(1);
+    nx_ = streamBand_->GetXSize();
+    ny_ = streamBand_->GetYSize();
+
+    int hasNo = 0;
+    double nd = streamBand_->GetNoDataValue(&hasNo);
+    hasNoData_ = hasNo != 0;
+    noDataVal_ = hasNo ? nd : numeric_limits<double>::quiet_NaN();
+
+    // Jeli plik jest kafelkowany kwadratowymi blokami, kafel cache = blok GDAL,
+    // dziki czemu kady odczyt dekoduje dokadnie jeden blok
+    int bw = 0, bh = 0;
+    streamBand_->GetBlockSize(&bw, &bh);
+    tileSize_ = (bw == bh && bw >= 64) ? bw : max(16, tileSize);
+    tilesX_ = (nx_ + tileSize_ - 1) / tileSize_;
+    tilesY_ = (ny_ + tileSize_ - 1) / tileSize_;
+    prefetchStamp_.assign((size_t)tilesX_ * tilesY_, 0);
+    prefetchCall_ = 0;
+
+    // Piramida z zakresu caego rastra, bez czytania kafli
+    loaded_ = true;
+    buildPyramid();
+
+    tiles_.reset(new TileCache(maxTiles,
+        [this](int tx, int ty, TileCache::Tile& out) { return loadTile(tx, ty, out); }));
+
+    cout << "DEMLoader: otwarto strumieniowo " << path << "\n";
+    cout << "  Wymiary: " << nx_ << " x " << ny_ << ", kafle " << tileSize_ << " px, cache "
+        << tiles_->capacity() << " kafli\n";
+    return true;
+}
+
+bool DEMLoader::isStreaming() const {
+    return tiles_ != nullptr;
+}
+
+bool DEMLoader::loadTile(int tx, int ty, TileCache::Tile& out) {
+    // Wywoywane przez TileCache pod jego blokad IO
+    out.tx = tx;
+    out.ty = ty;
+    out.x0 = tx * tileSize_;
+    out.y0 = ty * tileSize_;
+    out.w = min(tileSize_, nx_ - out.x0);
+    out.h = min(tileSize_, ny_ - out.y0);
+    if (out.w <= 0 || out.h <= 0) return false;
+
+    out.data.resize((size_t)out.w * (size_t)out.h);
+    CPLErr err = streamBand_->RasterIO(GF_Read, out.x0, out.y0, out.w, out.h,
+        out.data.data(), out.w, out.h, GDT_Float32, 0, 0);
+    if (err != CE_None) return false;
+    addTileBounds(out);
+    return true;
+}
+
+void DEMLoader::addTileBounds(const TileCache::Tile& t) {
+    // Woane z wtku wczytujcego: liczy min/max wzw pod kaflem, a do
+    // piramidy trafiaj one dopiero w updatePyramid na wtku symulacji
+    if (pyramid_.empty() || tileRefined_.empty()) return;
+    const PyramidLevel& base = pyramid_[0];
+    const int cell = base.cell;
+    const float inf = numeric_limits<float>::infinity();
+
+    TileBounds b;
+    b.tile = t.ty * tilesX_ + t.tx;
+    b.i0 = max(0, (t.x0 - 1) / cell);
+    b.j0 = max(0, (t.y0 - 1) / cell);
+    int i1 = min(base.nx - 1, (t.x0 + t.w - 1) / cell);
+    int j1 = min(base.ny - 1, (t.y0 + t.h - 1) / cell);
+    b.ni = i1 - b.i0 + 1;
+    b.nj = j1 - b.j0 + 1;
+    if (b.ni <= 0 || b.nj <= 0) return;
+    b.minH.assign((size_t)b.ni * b.nj, inf);
+    b.maxH.assign((size_t)b.ni * b.nj, -inf);
+
+    for (int y = 0; y < t.h; y++) {
+        int py = t.y0 + y;
+        int nj1 = min(py / cell, base.ny - 1);
+        int nj0 = (py % cell == 0 && py > 0) ? py / cell - 1 : nj1;
+        for (int x = 0; x < t.w; x++) {
+            float v = t.data[(size_t)y * t.w + x];
+            if (hasNoData_ && v == (float)noDataVal_) continue;
+            int px = t.x0 + x;
+            int ni1 = min(px / cell, base.nx - 1);
+            int ni0 = (px % cell == 0 && px > 0) ? px / cell - 1 : ni1;
+            for (int j = max(nj0, b.j0); j <= min(nj1, j1); j++) {
+                for (int i = max(ni0, b.i0); i <= min(ni1, i1); i++) {
+                    size_t k = (size_t)(j - b.j0) * b.ni + (i - b.i0);
+                    b.minH[k] = min(b.minH[k], v);
+                    b.maxH[k] = max(b.maxH[k], v);
+                }
+            }
+        }
+    }
+
+    lock_guard<mutex> lock(boundsMutex_);
+    pendingBounds_.push_back(std::move(b));
+}
+
+void DEMLoader::updatePyramid() {
+    vector<TileBounds> pending;
+    {
+        lock_guard<mutex> lock(boundsMutex_);
+        pending.swap(pendingBounds_);
+    }
+    if (pending.empty() || pyramid_.empty()) return;
+
+    PyramidLevel& base = pyramid_[0];
+    const int cell = base.cell;
+    const float inf = numeric_limits<float>::infinity();
+    bool changed = false;
+    for (const TileBounds& b : pending) {
+        // Kafel usunity z cache i wczytany ponownie by ju policzony
+        if (tileRefined_[b.tile]) continue;
+        tileRefined_[b.tile] = 1;
+
+        for (int jj = 0; jj < b.nj; jj++) {
+            for (int ii = 0; ii < b.ni; ii++) {
+                int i = b.i0 + ii, j = b.j0 + jj;
+                float lo = b.minH[(size_t)jj * b.ni + ii];
+                float hi = b.maxH[(size_t)jj * b.ni + ii];
+                // Piksele wza [i*cell, (i+1)*cell] mog lee w 2 x 2 kaflach
+                int needX = min((i + 1) * cell, nx_ - 1) / tileSize_ - (i * cell) / tileSize_ + 1;
+                int needY = min((j + 1) * cell, ny_ - 1) / tileSize_ - (j * cell) / tileSize_ + 1;
+                size_t k = (size_t)j * base.nx + i;
+                if (needX * needY > 1) {
+                    auto it = partialNodes_.find(k);
+                    if (it == partialNodes_.end()) it = partialNodes_.emplace(k, PartialNode{ inf, -inf, 0 }).first;
+                    PartialNode& pn = it->second;
+                    pn.minH = min(pn.minH, lo);
+                    pn.maxH = max(pn.maxH, hi);
+                    if (++pn.tiles < needX * needY) continue;
+                    lo = pn.minH;
+                    hi = pn.maxH;
+                    partialNodes_.erase(it);
+                }
+                base.minH[k] = lo;
+                base.maxH[k] = hi;
+                base.exact[k] = 1;
+                refreshAncestors(i, j);
+                changed = true;
+            }
+        }
+    }
+    if (changed) pyramidRevision_++;
+}
+
+void DEMLoader::refreshAncestors(int i, int j) {
+    for (size_t l = 1; l < pyramid_.size(); l++) {
+        const PyramidLevel& c = pyramid_[l - 1];
+        PyramidLevel& p = pyramid_[l];
+        i /= 2;
+        j /= 2;
+        float lo = numeric_limits<float>::infinity();
+        float hi = -numeric_limits<float>::infinity();
+        unsigned char exact = 1;
+        for (int cj = 2 * j; cj < min(2 * j + 2, c.ny); cj++) {
+            for (int ci = 2 * i; ci < min(2 * i + 2, c.nx); ci++) {
+                lo = min(lo, c.minH[(size_t)cj * c.nx + ci]);
+                hi = max(hi, c.maxH[(size_t)cj * c.nx + ci]);
+                exact &= c.exact[(size_t)cj * c.nx + ci];
+            }
+        }
+        size_t k = (size_t)j * p.nx + i;
+        if (p.minH[k] == lo && p.maxH[k] == hi && p.exact[k] == exact) break;
+        p.minH[k] = lo;
+        p.maxH[k] = hi;
+        p.exact[k] = exact;
+    }
+}
+
+void DEMLoader::prefetch(const vector<pair<double, double>>& geoPoints) const {
+    if (!tiles_) return;
+
+    // Znacznik zamiast zbioru kafli; po przekrceniu licznika czyszczenie tablicy
+    if (++prefetchCall_ == 0) {
+        fill(prefetchStamp_.begin(), prefetchStamp_.end(), 0u);
+        prefetchCall_ = 1;
+    }
+    for (const auto& gp : geoPoints) {
+        double px, py;
+        if (!geoToPixel(gp.first, gp.second, px, py)) continue;
+        if (px < 0 || py < 0 || px >= nx_ || py >= ny_) continue;
+        int tx = (int)px / tileSize_;
+        int ty = (int)py / tileSize_;
+        unsigned& stamp = prefetchStamp_[(size_t)ty * tilesX_ + tx];
+        if (stamp == prefetchCall_) continue;
+        stamp = prefetchCall_;
+        tiles_->request(tx, ty);
+    }
+}
+
 bool DEMLoader::loadColors(const string& path) {
     // Inicjalizacja biblioteki GDAL
     GDALAllRegister();
@@ -127,41 +506,71 @@ bool DEMLoader::loadColors(const string& path) {
     cout << "DEMLoader: typ pasma G = " << GDALGetDataTypeName(gBand->GetRasterDataType()) << "\n";
     cout << "DEMLoader: typ pasma B = " << GDALGetDataTypeName(bBand->GetRasterDataType()) << "\n";
 
-    // Alokacja pamici dla kolorw
+    // Pasmo 4 idzie do alfy tylko wtedy, gdy GDAL opisuje je jako alf
+    // (np. ortofotomapa RGB+NIR ma w nim podczerwie) - inaczej alfa = 255
+    int bandsToRead = (bandCount >= 4 &&
+        ds->GetRasterBand(4)->GetColorInterpretation() == GCI_AlphaBand) ? 4 : 3;
+
+    GDALClose(ds);
+
+    // Jeden bufor RGBA z przeplotem pikseli: GDAL zapisuje pasma bezporednio
+    // w docelowe miejsca (odstp piksela 4, wiersza 4*nx, pasma 1), bez
+    // buforw porednich. Bufor idzie potem prosto do glTexImage2D.
+    colors_.clear();
+    colors_.shrink_to_fit();
     colors_.resize((size_t)nx_ * (size_t)ny_);
+    unsigned char* rgba = reinterpret_cast<unsigned char*>(colors_.data());
+
+    // Pasy wierszy czytane rwnolegle; kady wtek ma wasny uchwyt GDAL,
+    // bo jeden GDALDataset nie moe by uywany wspbienie
+    const int stripRows = 128;
+    int strips = (ny_ + stripRows - 1) / stripRows;
+    int nThreads = (int)min<unsigned>(max(1u, thread::hardware_concurrency()), (unsigned)strips);
+    atomic<int> nextStrip(0);
+    atomic<bool> failed(false);
 
-    // Bufory dla kadego kanau
-    vector<unsigned char> rBuf((size_t)nx_ * (size_t)ny_);
-    vector<unsigned char> gBuf((size_t)nx_ * (size_t)ny_);
-    vector<unsigned char> bBuf((size_t)nx_ * (size_t)ny_);
-
-    // Odczyt kanaw
-    CPLErr errR = rBand->RasterIO(GF_Read, 0, 0, nx_, ny_,
-        rBuf.data(), nx_, ny_, GDT_Byte, 0, 0);
-    CPLErr errG = gBand->RasterIO(GF_Read, 0, 0, nx_, ny_,
-        gBuf.data(), nx_, ny_, GDT_Byte, 0, 0);
-    CPLErr errB = bBand->RasterIO(GF_Read, 0, 0, nx_, ny_,
-        bBuf.data(), nx_, ny_, GDT_Byte, 0, 0);
-
-    if (errR == CE_None && errG == CE_None && errB == CE_None) {
-        for (size_t i = 0; i < colors_.size(); i++) {
-            colors_[i] = { rBuf[i], gBuf[i], bBuf[i] };
+    auto worker = [&]() {
+        GDALDataset* wds = (GDALDataset*)GDALOpen(path.c_str(), GA_ReadOnly);
+        if (!wds) { failed = true; return; }
+        int bandMap[4] = { 1, 2, 3, 4 };
+        for (int s = nextStrip++; s < strips && !failed; s = nextStrip++) {
+            int y0 = s * stripRows;
+            int rows = min(stripRows, ny_ - y0);
+            unsigned char* dst = rgba + (size_t)y0 * nx_ * 4;
+            CPLErr err = wds->RasterIO(GF_Read, 0, y0, nx_, rows, dst, nx_, rows,
+                GDT_Byte, bandsToRead, bandMap, 4, (GSpacing)nx_ * 4, 1);
+            if (err != CE_None) { failed = true; break; }
+            if (bandsToRead == 3) {
+                // Kana alfa uzupeniany w tym samym pasie, pki jest w cache
+                for (size_t i = 3; i < (size_t)nx_ * rows * 4; i += 4) dst[i] = 255;
+            }
         }
-        hasColors_ = true;
-        cout << "DEMLoader: wczytano kolory z " << path << "\n";
-        cout << "  Probka: R=" << (int)rBuf[0] << " G=" << (int)gBuf[0] << " B=" << (int)bBuf[0] << "\n";
-    }
-    else {
+        GDALClose(wds);
+    };
+
+    vector<thread> pool;
+    for (int t = 1; t < nThreads; t++) pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool) t.join();
+
+    if (failed) {
         cerr << "DEMLoader: blad przy odczycie kolorow\n";
-        GDALClose(ds);
+        colors_.clear();
         return false;
     }
 
-    GDALClose(ds);
+    hasColors_ = true;
+    cout << "DEMLoader: wczytano kolory z " << path << "\n";
+    cout << "  Probka: R=" << (int)colors_[0].r << " G=" << (int)colors_[0].g << " B=" << (int)colors_[0].b << "\n";
+
     loaded_ = true;
     return true;
 }
 
+const unsigned char* DEMLoader::rgbaData() const {
+    return hasColors_ ? reinterpret_cast<const unsigned char*>(colors_.data()) : nullptr;
+}
+
 bool DEMLoader::load(const string& path) {
     // Dla kompatybilnoci wstecznej - prbuje zgadn co to za plik
     GDALAllRegister();
@@ -183,6 +592,26 @@ bool DEMLoader::load(const string& path) {
     return false;
 }
 
+bool DEMLoader::adoptColors(DEMLoader& other) {
+    if (!other.hasColors_) return false;
+    if (loaded_ && (other.nx_ != nx_ || other.ny_ != ny_)) {
+        cerr << "DEMLoader: wymiary pliku kolorow (" << other.nx_ << "x" << other.ny_
+            << ") nie zgadzaja sie z wysokosciami (" << nx_ << "x" << ny_ << ")\n";
+        return false;
+    }
+    if (!loaded_) {
+        nx_ = other.nx_;
+        ny_ = other.ny_;
+        for (int i = 0; i < 6; i++) gt_[i] = other.gt_[i];
+    }
+    colors_.swap(other.colors_);
+    hasColors_ = true;
+    other.colors_.clear();
+    other.colors_.shrink_to_fit();
+    other.hasColors_ = false;
+    return true;
+}
+
 int DEMLoader::width() const {
     return nx_;
 }
@@ -223,6 +652,33 @@ bool DEMLoader::geoToPixel(double gx, double gy, double& px, double& py) const {
     return true;
 }
 
+double DEMLoader::rawHeight(int x, int y, shared_ptr<const TileCache::Tile>& tile) const {
+    if (x < 0 || x >= nx_ || y < 0 || y >= ny_)
+        return numeric_limits<double>::quiet_NaN();
+    float v;
+    if (tiles_) {
+        // Ostatnio uyty kafel pamita woajcy, wic kolejne prbki
+        // z tego samego kafla kosztuj jedno zapytanie do cache
+        if (!tile || x < tile->x0 || x >= tile->x0 + tile->w ||
+            y < tile->y0 || y >= tile->y0 + tile->h) {
+            tile = tiles_->get(x / tileSize_, y / tileSize_);
+            if (!tile) return numeric_limits<double>::quiet_NaN();
+        }
+        v = tile->at(x, y);
+    }
+    else if (!qdata_.empty()) {
+        uint16_t code = qdata_[(size_t)y * nx_ + x];
+        if (code == kQuantNoData) return numeric_limits<double>::quiet_NaN();
+        return qOffset_ + qScale_ * code;
+    }
+    else {
+        v = data_[(size_t)y * nx_ + x];
+    }
+    if (hasNoData_ && v == (float)noDataVal_)
+        return numeric_limits<double>::quiet_NaN();
+    return (double)v;
+}
+
 double DEMLoader::bilinearInterp(double px, double py) const {
     if (!loaded_) return numeric_limits<double>::quiet_NaN();
 
@@ -231,14 +687,22 @@ double DEMLoader::bilinearInterp(double px, double py) const {
     double fx = px - x0;
     double fy = py - y0;
 
-    auto sample = [&](int x, int y) -> double {
-        if (x < 0 || x >= nx_ || y < 0 || y >= ny_)
-            return numeric_limits<double>::quiet_NaN();
-        float v = data_[y * nx_ + x];
-        if (hasNoData_ && v == (float)noDataVal_)
-            return numeric_limits<double>::quiet_NaN();
-        return (double)v;
-        };
+    if (!qdata_.empty() && x0 >= 0 && y0 >= 0 && x0 + 1 < nx_ && y0 + 1 < ny_) {
+        // Interpolacja bezporednio na kodach 16-bit; dekwantyzacja to jedno
+        // mnoenie z dodawaniem na kocu zamiast czterech
+        const uint16_t* r0 = qdata_.data() + (size_t)y0 * nx_ + x0;
+        const uint16_t* r1 = r0 + nx_;
+        uint16_t c00 = r0[0], c10 = r0[1], c01 = r1[0], c11 = r1[1];
+        if (c00 != kQuantNoData && c10 != kQuantNoData &&
+            c01 != kQuantNoData && c11 != kQuantNoData) {
+            double q0 = c00 + (c10 - c00) * fx;
+            double q1 = c01 + (c11 - c01) * fx;
+            return qOffset_ + qScale_ * (q0 + (q1 - q0) * fy);
+        }
+    }
+
+    shared_ptr<const TileCache::Tile> tile;
+    auto sample = [&](int x, int y) { return rawHeight(x, y, tile); };
 
     double v00 = sample(x0, y0);
     double v10 = sample(x0 + 1, y0);
@@ -258,7 +722,7 @@ double DEMLoader::bilinearInterp(double px, double py) const {
 }
 
 double DEMLoader::getGroundZ(double geoX, double geoY) const {
-    if (!loaded_ || data_.empty()) return numeric_limits<double>::quiet_NaN();
+    if (!loaded_ || (data_.empty() && qdata_.empty() && !tiles_)) return numeric_limits<double>::quiet_NaN();
 
     double px, py;
     if (!geoToPixel(geoX, geoY, px, py))
@@ -270,6 +734,159 @@ double DEMLoader::getGroundZ(double geoX, double geoY) const {
     return bilinearInterp(px, py);
 }
 
+bool DEMLoader::intersectSegment(double x0, double y0, double z0,
+    double x1, double y1, double z1, double& tHit) const {
+    if (pyramid_.empty()) {
+        // Bez piramidy zostaje test punktu kocowego
+        double g = getGroundZ(x1, y1);
+        if (z1 <= g) { tHit = 1.0; return true; }
+        return false;
+    }
+
+    SegmentQuery q;
+    if (!geoToPixel(x0, y0, q.px0, q.py0) || !geoToPixel(x1, y1, q.px1, q.py1))
+        return false;
+    q.z0 = z0;
+    q.dz = z1 - z0;
+    q.dpx = q.px1 - q.px0;
+    q.dpy = q.py1 - q.py0;
+
+    int top = kPyramidBaseLevel + (int)pyramid_.size() - 1;
+    if (intersectNode(q, top, 0, 0, 0.0, 1.0, tHit)) return true;
+
+    // Drzewo obejmuje komrki midzy rodkami pikseli; w ppikselowym pasie
+    // przy krawdzi rastra getGroundZ uywa najbliszego ssiada - tam wystarcza
+    // test koca odcinka i bisekcja. Odcinek z oboma kocami w obszarze drzewa
+    // nie dotyka pasa, wic chybienie w drzewie jest ostateczne (bez getGroundZ,
+    // a w trybie strumieniowym bez wczytywania kafla).
+    auto inTree = [&](double px, double py) {
+        return px >= 0.0 && py >= 0.0 && px <= nx_ - 1 && py <= ny_ - 1;
+    };
+    if (inTree(q.px0, q.py0) && inTree(q.px1, q.py1)) return false;
+    auto below = [&](double t) {
+        return z0 + q.dz * t <= getGroundZ(x0 + (x1 - x0) * t, y0 + (y1 - y0) * t);
+    };
+    if (!below(1.0)) return false;
+    double lo = 0.0, hi = 1.0;
+    for (int k = 0; k < 30; k++) {
+        double mid = 0.5 * (lo + hi);
+        if (below(mid)) hi = mid; else lo = mid;
+    }
+    tHit = hi;
+    return true;
+}
+
+bool DEMLoader::clipToRect(const SegmentQuery& q, double xa, double xb, double ya, double yb,
+    double& t0, double& t1) const {
+    // Przycicie odcinka (w pikselach) do prostokta metod slabw
+    auto slab = [&](double p0, double d, double lo, double hi) {
+        if (fabs(d) < 1e-15) return p0 >= lo && p0 <= hi;
+        double ta = (lo - p0) / d;
+        double tb = (hi - p0) / d;
+        if (ta > tb) swap(ta, tb);
+        t0 = max(t0, ta);
+        t1 = min(t1, tb);
+        return t0 <= t1;
+    };
+    return slab(q.px0, q.dpx, xa, xb) && slab(q.py0, q.dpy, ya, yb);
+}
+
+bool DEMLoader::intersectNode(const SegmentQuery& q, int level, int i, int j,
+    double t0, double t1, double& tHit) const {
+    if (level == 0) return intersectCell(q, i, j, t0, t1, tHit);
+
+    // Wze poziomu l ma 2^l komrek bilinearnych; dzieci (poziom l-1)
+    // sprawdzamy w kolejnoci wejcia odcinka, wic pierwsze trafienie jest najwczeniejsze.
+    // Wzy drobniejsze ni kPyramidCell nie maj min/max - dzielone s bez odrzucania.
+    if (level >= kPyramidBaseLevel) {
+        const PyramidLevel& lvl = pyramid_[level - kPyramidBaseLevel];
+        if (i >= lvl.nx || j >= lvl.ny) return false;
+
+        // Wze z przyblionym max (niewczytane kafle) nie odrzuca - schodzimy
+        // do komrek, ktre czytaj prawdziwe wysokoci
+        size_t k = (size_t)j * lvl.nx + i;
+        double zmin = q.z0 + q.dz * (q.dz < 0 ? t1 : t0);
+        if (lvl.exact[k] && zmin > lvl.maxH[k]) return false;
+    }
+
+    struct Child { int i, j; double t0, t1; };
+    Child ch[4];
+    int n = 0;
+    int half = 1 << (level - 1);
+    int maxCell = nx_ - 2, maxCellY = ny_ - 2;
+    for (int cj = 2 * j; cj < 2 * j + 2; cj++) {
+        for (int ci = 2 * i; ci < 2 * i + 2; ci++) {
+            double xa = (double)ci * half, ya = (double)cj * half;
+            if (xa > maxCell || ya > maxCellY) continue;
+            double xb = min((double)(ci + 1) * half, (double)(nx_ - 1));
+            double yb = min((double)(cj + 1) * half, (double)(ny_ - 1));
+            double c0 = t0, c1 = t1;
+            if (!clipToRect(q, xa, xb, ya, yb, c0, c1)) continue;
+            ch[n++] = { ci, cj, c0, c1 };
+        }
+    }
+    sort(ch, ch + n, [](const Child& a, const Child& b) { return a.t0 < b.t0; });
+    for (int k = 0; k < n; k++) {
+        if (intersectNode(q, level - 1, ch[k].i, ch[k].j, ch[k].t0, ch[k].t1, tHit))
+            return true;
+    }
+    return false;
+}
+
+bool DEMLoader::intersectCell(const SegmentQuery& q, int cx, int cy,
+    double t0, double t1, double& tHit) const {
+    shared_ptr<const TileCache::Tile> tile;
+    double h00 = rawHeight(cx, cy, tile);
+    double h10 = rawHeight(cx + 1, cy, tile);
+    double h01 = rawHeight(cx, cy + 1, tile);
+    double h11 = rawHeight(cx + 1, cy + 1, tile);
+
+    auto f = [&](double t) {
+        return q.z0 + q.dz * t - bilinearInterp(q.px0 + q.dpx * t, q.py0 + q.dpy * t);
+    };
+
+    if (isnan(h00) || isnan(h10) || isnan(h01) || isnan(h11)) {
+        // Komrka przy NoData: getGroundZ przechodzi na najbliszego ssiada,
+        // wic zostaje sprawdzenie koca przedziau
+        if (f(t1) <= 0.0) { tHit = t1; return true; }
+        return false;
+    }
+
+    // Wzdu prostej wysoko bilinearna jest kwadratowa w t, a z liniowa,
+    // wic punkt przecicia wynika z rwnania kwadratowego
+    double u0 = q.px0 - cx, v0 = q.py0 - cy;
+    double a = h00, b = h10 - h00, c = h01 - h00, d = h00 - h10 - h01 + h11;
+    double A = a + b * u0 + c * v0 + d * u0 * v0;
+    double B = b * q.dpx + c * q.dpy + d * (u0 * q.dpy + v0 * q.dpx);
+    double C = d * q.dpx * q.dpy;
+
+    // g(t) = z(t) - h(t) = g0 + g1 t + g2 t^2
+    double g0 = q.z0 - A, g1 = q.dz - B, g2 = -C;
+    auto g = [&](double t) { return g0 + (g1 + g2 * t) * t; };
+
+    if (g(t0) <= 0.0) { tHit = t0; return true; }
+
+    double best = numeric_limits<double>::infinity();
+    if (fabs(g2) < 1e-12) {
+        if (fabs(g1) > 1e-15) best = -g0 / g1;
+    }
+    else {
+        double disc = g1 * g1 - 4.0 * g2 * g0;
+        if (disc >= 0.0) {
+            double sq = sqrt(disc);
+            double r1 = (-g1 - sq) / (2.0 * g2);
+            double r2 = (-g1 + sq) / (2.0 * g2);
+            if (r1 > r2) swap(r1, r2);
+            best = (r1 >= t0) ? r1 : r2;
+        }
+    }
+    if (best >= t0 && best <= t1) {
+        tHit = best;
+        return true;
+    }
+    return false;
+}
+
 bool DEMLoader::getGroundColor(double geoX, double geoY, unsigned char& r,
     unsigned char& g, unsigned char& b) const {
     if (!loaded_ || !hasColors_) return false;
@@ -287,6 +904,12 @@ bool DEMLoader::getGroundColor(double geoX, double geoY, unsigned char& r,
 }
 
 pair<double, double> DEMLoader::getHeightRange() const {
+    if (!pyramid_.empty()) {
+        // Najwyszy poziom piramidy ma jeden wze obejmujcy cay raster
+        const PyramidLevel& top = pyramid_.back();
+        return { (double)top.minH[0], (double)top.maxH[0] };
+    }
+
     if (!loaded_ || data_.empty())
         return { numeric_limits<double>::quiet_NaN(), numeric_limits<double>::quiet_NaN() };
 
@@ -302,6 +925,137 @@ pair<double, double> DEMLoader::getHeightRange() const {
     return { minH, maxH };
 }
 
+void DEMLoader::buildPyramid() {
+    pyramid_.clear();
+    tileRefined_.clear();
+    partialNodes_.clear();
+    {
+        lock_guard<mutex> lock(boundsMutex_);
+        pendingBounds_.clear();
+    }
+    pyramidRevision_++;
+    if (nx_ < 2 || ny_ < 2) return;
+
+    const float inf = numeric_limits<float>::infinity();
+    const int cell = kPyramidCell;
+
+    PyramidLevel base;
+    base.cell = cell;
+    base.nx = (nx_ - 1 + cell - 1) / cell;
+    base.ny = (ny_ - 1 + cell - 1) / cell;
+    size_t baseN = (size_t)base.nx * base.ny;
+
+    if (streamDs_) {
+        // Zakres caego rastra z metadanych albo przyblionych statystyk
+        // (podgldy GDAL), bez czytania kafli - tylko do LOD terenu. Przyblienie
+        // moe zaniy szczyty, wic wzy nie s dokadne (exact = 0) i kolizje
+        // nad nimi liczone s z wysokoci, dopki kafle si nie wczytaj.
+        double mm[2];
+        int okMin = 0, okMax = 0;
+        mm[0] = streamBand_->GetMinimum(&okMin);
+        mm[1] = streamBand_->GetMaximum(&okMax);
+        if (!okMin || !okMax) {
+            if (streamBand_->ComputeRasterMinMax(TRUE, mm) != CE_None) {
+                cerr << "DEMLoader: brak statystyk rastra - liczenie pelnego zakresu\n";
+                streamBand_->ComputeRasterMinMax(FALSE, mm);
+            }
+            mm[1] += 0.02 * (mm[1] - mm[0]);
+        }
+        base.minH.assign(baseN, (float)mm[0]);
+        base.maxH.assign(baseN, (float)mm[1]);
+        base.exact.assign(baseN, 0);
+        tileRefined_.assign((size_t)tilesX_ * tilesY_, 0);
+    }
+    else {
+        // Piksel na granicy wzw naley do obu, bo interpolacja w obu
+        // wzach z niego korzysta
+        base.minH.assign(baseN, inf);
+        base.maxH.assign(baseN, -inf);
+        base.exact.assign(baseN, 1);
+        shared_ptr<const TileCache::Tile> none;
+        for (int y = 0; y < ny_; y++) {
+            int j1 = min(y / cell, base.ny - 1);
+            int j0 = (y % cell == 0 && y > 0) ? y / cell - 1 : j1;
+            for (int x = 0; x < nx_; x++) {
+                double h = rawHeight(x, y, none);
+                if (isnan(h)) continue;
+                float v = (float)h;
+                int i1 = min(x / cell, base.nx - 1);
+                int i0 = (x % cell == 0 && x > 0) ? x / cell - 1 : i1;
+                for (int j = j0; j <= j1; j++) {
+                    for (int i = i0; i <= i1; i++) {
+                        size_t k = (size_t)j * base.nx + i;
+                        base.minH[k] = min(base.minH[k], v);
+                        base.maxH[k] = max(base.maxH[k], v);
+                    }
+                }
+            }
+        }
+    }
+    pyramid_.push_back(std::move(base));
+    buildUpperLevels();
+}
+
+void DEMLoader::buildUpperLevels() {
+    // Wysze poziomy: min/max z czterech dzieci, a do jednego wza
+    const float inf = numeric_limits<float>::infinity();
+    while (pyramid_.back().nx > 1 || pyramid_.back().ny > 1) {
+        const PyramidLevel& c = pyramid_.back();
+        PyramidLevel p;
+        p.cell = c.cell * 2;
+        p.nx = (c.nx + 1) / 2;
+        p.ny = (c.ny + 1) / 2;
+        size_t n = (size_t)p.nx * p.ny;
+        p.minH.assign(n, inf);
+        p.maxH.assign(n, -inf);
+        p.exact.assign(n, 1);
+        for (int j = 0; j < p.ny; j++) {
+            for (int i = 0; i < p.nx; i++) {
+                size_t k = (size_t)j * p.nx + i;
+                for (int cj = 2 * j; cj < min(2 * j + 2, c.ny); cj++) {
+                    for (int ci = 2 * i; ci < min(2 * i + 2, c.nx); ci++) {
+                        size_t ck = (size_t)cj * c.nx + ci;
+                        p.minH[k] = min(p.minH[k], c.minH[ck]);
+                        p.maxH[k] = max(p.maxH[k], c.maxH[ck]);
+                        p.exact[k] &= c.exact[ck];
+                    }
+                }
+            }
+        }
+        pyramid_.push_back(std::move(p));
+    }
+}
+
+int DEMLoader::pyramidLevels() const {
+    return (int)pyramid_.size();
+}
+
+const DEMLoader::PyramidLevel& DEMLoader::pyramidLevel(int level) const {
+    return pyramid_[level];
+}
+
+unsigned DEMLoader::pyramidRevision() const {
+    return pyramidRevision_;
+}
+
+double DEMLoader::maxHeightBound(double geoX, double geoY) const {
+    if (pyramid_.empty()) return getGroundZ(geoX, geoY);
+
+    double px, py;
+    if (!geoToPixel(geoX, geoY, px, py))
+        return numeric_limits<double>::quiet_NaN();
+    if (px < -0.5 || py < -0.5 || px > nx_ - 0.5 || py > ny_ - 0.5)
+        return numeric_limits<double>::quiet_NaN();
+
+    // Wzy kPyramidCell px: do drobne, by ograniczenie byo ciasne przy ziemi
+    const PyramidLevel& lvl = pyramid_[0];
+    int i = min(max((int)floor(px) / lvl.cell, 0), lvl.nx - 1);
+    int j = min(max((int)floor(py) / lvl.cell, 0), lvl.ny - 1);
+    size_t k = (size_t)j * lvl.nx + i;
+    if (!lvl.exact[k]) return numeric_limits<double>::infinity();
+    return lvl.maxH[k];
+}
+
 double DEMLoader::pixelSizeX() const {
     return gt_[1];
 }
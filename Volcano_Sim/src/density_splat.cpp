@@ -0,0 +1,276 @@
+#include "../include/density_splat.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+using namespace std;
+
+namespace {
+
+// Prostokat na caly ekran z wierzcholkow glBegin; glebokosc z kubelka,
+// zeby teren zaslanial czastki za zboczem
+const char* kSplatVertex = R"(
+#version 120
+varying vec2 uv;
+void main() {
+    uv = gl_Vertex.xy * 0.5 + 0.5;
+    gl_Position = vec4(gl_Vertex.xy, 0.0, 1.0);
+}
+)";
+
+const char* kSplatFragment = R"(
+#version 120
+uniform sampler2D density;
+uniform sampler2D depth;
+varying vec2 uv;
+void main() {
+    vec4 c = texture2D(density, uv);
+    if (c.a <= 0.0) discard;
+    gl_FragDepth = texture2D(depth, uv).r;
+    gl_FragColor = c;
+}
+)";
+
+// Czastek na watek, ponizej ktorej dodatkowy watek sie nie oplaca
+const size_t kParticlesPerThread = 20000;
+
+} // namespace
+
+DensitySplat::DensitySplat()
+    : bw_(0), bh_(0), colorTexture_(0), depthTexture_(0), textureW_(0), textureH_(0),
+    program_(0), locColor_(-1), locDepth_(-1),
+    splatting_(false), pointLimit_(maxPointCount), splatted_(0) {
+}
+
+DensitySplat::~DensitySplat() {
+    release();
+}
+
+void DensitySplat::release() {
+    if (gl::isLoaded()) {
+        if (colorTexture_) glDeleteTextures(1, &colorTexture_);
+        if (depthTexture_) glDeleteTextures(1, &depthTexture_);
+        if (program_) gl::DeleteProgram(program_);
+    }
+    colorTexture_ = depthTexture_ = 0;
+    textureW_ = textureH_ = 0;
+    program_ = 0;
+    histogram_.clear();
+    projected_.clear();
+    sorted_.clear();
+}
+
+bool DensitySplat::build() {
+    if (!gl::isLoaded()) return false;
+    release();
+
+    program_ = gl::buildProgram("DensitySplat", kSplatVertex, kSplatFragment, nullptr);
+    if (!program_) return false;
+    locColor_ = gl::GetUniformLocation(program_, "density");
+    locDepth_ = gl::GetUniformLocation(program_, "depth");
+
+    glGenTextures(1, &colorTexture_);
+    glBindTexture(GL_TEXTURE_2D, colorTexture_);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glGenTextures(1, &depthTexture_);
+    glBindTexture(GL_TEXTURE_2D, depthTexture_);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return true;
+}
+
+bool DensitySplat::chooseSplats(size_t particleCount, double frameMs) {
+    if (mode == Mode::Points) splatting_ = false;
+    else if (mode == Mode::Splats) splatting_ = true;
+    else if (particleCount < minSplatCount) splatting_ = false;
+    else if (particleCount >= min(pointLimit_, maxPointCount)) splatting_ = true;
+    else if (!splatting_ && frameMs > frameBudgetMs) {
+        // Punkty nie mieszcza sie w budzecie - zapamietaj liczbe, przy ktorej to nastapilo
+        splatting_ = true;
+        pointLimit_ = particleCount;
+    }
+    else if (splatting_ && particleCount < pointLimit_ * 8 / 10) {
+        splatting_ = false;
+    }
+    return splatting_;
+}
+
+void DensitySplat::resize(int width, int height) {
+    bw_ = max(1, (width + binPixels - 1) / binPixels);
+    bh_ = max(1, (height + binPixels - 1) / binPixels);
+    rgba_.resize((size_t)bw_ * bh_ * 4);
+    depth_.resize((size_t)bw_ * bh_);
+}
+
+void DensitySplat::draw(const vector<Materia>& particles, unsigned materialMask,
+    const glm::mat4& proj, const glm::mat4& view, int viewportWidth, int viewportHeight,
+    float zScale, float baseZ) {
+    splatted_ = 0;
+    if (!isBuilt() || viewportWidth <= 0 || viewportHeight <= 0) return;
+    resize(viewportWidth, viewportHeight);
+
+    size_t n = particles.size();
+    int nThreads = (int)min<size_t>(max(1u, thread::hardware_concurrency()), max<size_t>(1, n / kParticlesPerThread));
+    auto parallel = [nThreads](auto&& job) {
+        vector<thread> pool;
+        for (int t = 1; t < nThreads; t++) pool.emplace_back(job, t);
+        job(0);
+        for (auto& th : pool) th.join();
+    };
+    size_t bins = (size_t)bw_ * bh_;
+    histogram_.resize(bins);
+    projected_.resize(nThreads);
+    // Kilka pasow na watek, zeby nierowna gestosc rozlozyla sie na watki
+    int nBands = min(bh_, nThreads * 4);
+    auto bandOfRow = [&](int row) { return (int)((long long)row * nBands / bh_); };
+    auto firstRow = [&](int band) { return (int)(((long long)band * bh_ + nBands - 1) / nBands); };
+
+    float palette[10][3];
+    for (int i = 0; i < 10; i++)
+        for (int c = 0; c < 3; c++) palette[i][c] = ParticleColor[i][c] / 255.0f;
+    glm::mat4 mvp = proj * view;
+    float fw = (float)bw_, fh = (float)bh_;
+
+    // Faza 1: kazdy watek rzutuje swoj fragment czastek i zlicza je w pasach
+    vector<size_t> bandCount((size_t)nThreads * nBands, 0);
+    auto project = [&](int t) {
+        vector<Splat>& out = projected_[t];
+        out.clear();
+        size_t* count = &bandCount[(size_t)t * nBands];
+        size_t begin = n * t / nThreads, end = n * (t + 1) / nThreads;
+        for (size_t k = begin; k < end; k++) {
+            const Materia& p = particles[k];
+            int type = static_cast<int>(p.type);
+            if (!((materialMask >> type) & 1u)) continue;
+            glm::vec4 clip = mvp * glm::vec4((float)p.position_x, (float)p.position_y,
+                ((float)p.position_z - baseZ) * zScale, 1.0f);
+            if (clip.w <= 0.0f) continue;
+            float inv = 1.0f / clip.w;
+            float sx = (clip.x * inv * 0.5f + 0.5f) * fw;
+            float sy = (clip.y * inv * 0.5f + 0.5f) * fh;
+            float depth = clip.z * inv * 0.5f + 0.5f;
+            if (!(sx >= 0.0f && sx < fw && sy >= 0.0f && sy < fh && depth >= 0.0f && depth <= 1.0f)) continue;
+
+            int row = (int)sy;
+            out.push_back(Splat{ (uint32_t)((size_t)row * bw_ + (int)sx), (float)p.weight, depth, type });
+            count[bandOfRow(row)]++;
+        }
+    };
+    parallel(project);
+
+    // Faza 2: watki przenosza swoje czastki w miejsca ich pasow
+    vector<size_t> offset((size_t)nThreads * nBands);
+    vector<size_t> bandStart(nBands + 1);
+    size_t total = 0;
+    for (int band = 0; band < nBands; band++) {
+        bandStart[band] = total;
+        for (int t = 0; t < nThreads; t++) {
+            offset[(size_t)t * nBands + band] = total;
+            total += bandCount[(size_t)t * nBands + band];
+        }
+    }
+    bandStart[nBands] = total;
+    sorted_.resize(total);
+    auto scatter = [&](int t) {
+        size_t* off = &offset[(size_t)t * nBands];
+        for (const Splat& s : projected_[t])
+            sorted_[off[bandOfRow((int)(s.bin / bw_))]++] = s;
+    };
+    parallel(scatter);
+
+    // Faza 3: pas liczy jeden watek, wprost we wspolnym histogramie
+    atomic<int> nextBand(0);
+    vector<float> maxCount(nThreads, 0.0f);
+    auto accumulate = [&](int t) {
+        for (int band = nextBand++; band < nBands; band = nextBand++) {
+            size_t binBegin = (size_t)firstRow(band) * bw_, binEnd = (size_t)firstRow(band + 1) * bw_;
+            fill(histogram_.begin() + binBegin, histogram_.begin() + binEnd, Bin{ 0.0f, 0.0f, 0.0f, 0.0f, 1.0f });
+            for (size_t i = bandStart[band]; i < bandStart[band + 1]; i++) {
+                // Superczastka liczy sie za tyle czastek, ile reprezentuje
+                const Splat& s = sorted_[i];
+                Bin& b = histogram_[s.bin];
+                b.count += s.weight;
+                b.r += palette[s.type][0] * s.weight;
+                b.g += palette[s.type][1] * s.weight;
+                b.b += palette[s.type][2] * s.weight;
+                b.depth = min(b.depth, s.depth);
+            }
+            for (size_t i = binBegin; i < binEnd; i++)
+                maxCount[t] = max(maxCount[t], histogram_[i].count);
+        }
+    };
+    parallel(accumulate);
+
+    // Kolor kubelka = sredni kolor materialow, alfa rosnie z logarytmem gestosci
+    float peak = *max_element(maxCount.begin(), maxCount.end());
+    float logPeak = log(1.0f + max(peak, 1.0f));
+    const vector<Bin>& hist = histogram_;
+    for (size_t i = 0; i < bins; i++) {
+        const Bin& b = hist[i];
+        unsigned char* c = &rgba_[i * 4];
+        if (b.count <= 0.0f) {
+            c[0] = c[1] = c[2] = c[3] = 0;
+        }
+        else {
+            float inv = 1.0f / b.count;
+            float alpha = 0.3f + 0.7f * log(1.0f + b.count) / logPeak;
+            c[0] = (unsigned char)(255.0f * b.r * inv);
+            c[1] = (unsigned char)(255.0f * b.g * inv);
+            c[2] = (unsigned char)(255.0f * b.b * inv);
+            c[3] = (unsigned char)(255.0f * min(alpha, 1.0f));
+        }
+        depth_[i] = b.depth;
+    }
+    splatted_ = total;
+
+    glBindTexture(GL_TEXTURE_2D, colorTexture_);
+    if (textureW_ != bw_ || textureH_ != bh_) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, bw_, bh_, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba_.data());
+        glBindTexture(GL_TEXTURE_2D, depthTexture_);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, bw_, bh_, 0, GL_RED, GL_FLOAT, depth_.data());
+        textureW_ = bw_;
+        textureH_ = bh_;
+    }
+    else {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, bw_, bh_, GL_RGBA, GL_UNSIGNED_BYTE, rgba_.data());
+        glBindTexture(GL_TEXTURE_2D, depthTexture_);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, bw_, bh_, GL_RED, GL_FLOAT, depth_.data());
+    }
+
+    glPushAttrib(GL_ENABLE_BIT | GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+    glDisable(GL_LIGHTING);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LEQUAL);
+    glDepthMask(GL_FALSE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    gl::UseProgram(program_);
+    gl::Uniform1i(locColor_, 0);
+    gl::Uniform1i(locDepth_, 1);
+    gl::ActiveTexture(GL_TEXTURE0 + 1);
+    glBindTexture(GL_TEXTURE_2D, depthTexture_);
+    gl::ActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, colorTexture_);
+
+    glBegin(GL_QUADS);
+    glVertex2f(-1.0f, -1.0f);
+    glVertex2f(1.0f, -1.0f);
+    glVertex2f(1.0f, 1.0f);
+    glVertex2f(-1.0f, 1.0f);
+    glEnd();
+
+    gl::UseProgram(0);
+    gl::ActiveTexture(GL_TEXTURE0 + 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    gl::ActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPopAttrib();
+}
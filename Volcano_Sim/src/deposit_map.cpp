@@ -0,0 +1,133 @@
+#include "../include/deposit_map.h"
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+DepositMap::DepositMap()
+    : w_(0), h_(0), cellPixels_(1), minX_(0.0), minY_(0.0), cellW_(1.0), cellH_(1.0), invArea_(1.0),
+    maxLoad_(0.0), blocksX_(0), blocksY_(0),
+    texture_(0), texMap_{ 0.0f, 0.0f, 1.0f, 1.0f } {
+}
+
+DepositMap::~DepositMap() {
+    release();
+}
+
+void DepositMap::release() {
+    if (texture_) glDeleteTextures(1, &texture_);
+    texture_ = 0;
+    load_.clear();
+    load_.shrink_to_fit();
+    dirty_.clear();
+    dirtyList_.clear();
+    w_ = h_ = 0;
+    maxLoad_ = 0.0;
+}
+
+bool DepositMap::build(const DEMLoader& dem, int maxTextureSize) {
+    release();
+    if (!dem.isLoaded() || dem.width() < 2 || dem.height() < 2) return false;
+
+    // Komorki miedzy wezlami rastra, jak siatka terenu: (nx - 1) x (ny - 1) pikseli
+    int cellsX = dem.width() - 1;
+    int cellsY = dem.height() - 1;
+    cellPixels_ = max(1, (max(cellsX, cellsY) + maxTextureSize - 1) / maxTextureSize);
+    w_ = (cellsX + cellPixels_ - 1) / cellPixels_;
+    h_ = (cellsY + cellPixels_ - 1) / cellPixels_;
+
+    const double* gt = dem.geoTransform();
+    cellW_ = gt[1] * cellPixels_;
+    cellH_ = fabs(gt[5]) * cellPixels_;
+    minX_ = gt[0];
+    minY_ = gt[3] + dem.height() * gt[5];
+    invArea_ = 1.0 / (cellW_ * cellH_);
+    load_.assign((size_t)w_ * h_, 0.0f);
+    blocksX_ = (w_ + dirtyBlock - 1) / dirtyBlock;
+    blocksY_ = (h_ + dirtyBlock - 1) / dirtyBlock;
+    dirty_.assign((size_t)blocksX_ * blocksY_, 0);
+    dirtyList_.clear();
+
+    texMap_[0] = (float)minX_;
+    texMap_[1] = (float)minY_;
+    texMap_[2] = (float)(1.0 / (w_ * cellW_));
+    texMap_[3] = (float)(1.0 / (h_ * cellH_));
+
+    glGenTextures(1, &texture_);
+    glBindTexture(GL_TEXTURE_2D, texture_);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, w_, h_, 0, GL_RED, GL_FLOAT, load_.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+    if (glGetError() != GL_NO_ERROR) {
+        cerr << "DepositMap: nie mozna utworzyc tekstury " << w_ << " x " << h_ << " (GL_R32F)\n";
+        release();
+        return false;
+    }
+
+    cout << "DepositMap: " << w_ << " x " << h_ << " komorek po " << cellPixels_ << " px\n";
+    return true;
+}
+
+void DepositMap::clear() {
+    if (!isBuilt()) return;
+    fill(load_.begin(), load_.end(), 0.0f);
+    maxLoad_ = 0.0;
+    dirtyList_.clear();
+    for (int b = 0; b < blocksX_ * blocksY_; b++) {
+        dirty_[b] = 1;
+        dirtyList_.push_back(b);
+    }
+}
+
+bool DepositMap::cellOf(double x, double y, int& i, int& j) const {
+    double fx = (x - minX_) / cellW_;
+    double fy = (y - minY_) / cellH_;
+    if (!(fx >= 0.0 && fy >= 0.0 && fx < w_ && fy < h_)) return false;
+    i = (int)fx;
+    j = (int)fy;
+    return true;
+}
+
+void DepositMap::add(const Materia& p) {
+    int i, j;
+    if (!isBuilt() || !cellOf(p.position_x, p.position_y, i, j)) return;
+
+    float& cell = load_[(size_t)j * w_ + i];
+    cell += (float)(p.mass() * p.weight * invArea_);
+    maxLoad_ = max(maxLoad_, (double)cell);
+
+    int b = (j / dirtyBlock) * blocksX_ + i / dirtyBlock;
+    if (!dirty_[b]) {
+        dirty_[b] = 1;
+        dirtyList_.push_back(b);
+    }
+}
+
+void DepositMap::upload() {
+    if (!isBuilt() || dirtyList_.empty()) return;
+
+    // Wiersze bloku leza w load_ co w_ elementow - wysylane bez kopiowania
+    glBindTexture(GL_TEXTURE_2D, texture_);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, w_);
+    for (int b : dirtyList_) {
+        int i0 = (b % blocksX_) * dirtyBlock;
+        int j0 = (b / blocksX_) * dirtyBlock;
+        int bw = min(dirtyBlock, w_ - i0);
+        int bh = min(dirtyBlock, h_ - j0);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, i0, j0, bw, bh, GL_RED, GL_FLOAT, &load_[(size_t)j0 * w_ + i0]);
+        dirty_[b] = 0;
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    dirtyList_.clear();
+}
+
+double DepositMap::loadAt(double x, double y) const {
+    int i, j;
+    if (!isBuilt() || !cellOf(x, y, i, j)) return 0.0;
+    return load_[(size_t)j * w_ + i];
+}
@@ -33,28 +33,45 @@ namespace physics {
         return 0.5 * airDensity * v_rel * v_rel * Cd * area;
     }
 
-    double dragMagnitude(double v_rel, const Materia& m, double airDensity) {
-        double d = m.diameter;
-        double rho_air = airDensity;
-        double Re = (rho_air * fabs(v_rel) * d) / airViscosity + 1e-12;
-        if (Re < 1.0) {
-            return stokesDragMagnitude(v_rel, m);
-        }
-        else {
-            return quadraticDragMagnitude(v_rel, m, airDensity);
+    double ganserDragCoefficient(double Re, double sphericity) {
+        // Wspolczynniki ksztaltu: K1 (zakres Stokesa), K2 (zakres Newtona)
+        double K1 = 1.0 / (1.0 / 3.0 + 2.0 / (3.0 * sqrt(sphericity)));
+        double K2 = pow(10.0, 1.8148 * pow(-log10(sphericity), 0.5743));
+        double ReK = Re * K1 * K2;
+        return 24.0 / (Re * K1) * (1.0 + 0.1118 * pow(ReK, 0.6567)) +
+            0.4305 * K2 / (1.0 + 3305.0 / ReK);
+    }
+
+    void DragTable::build(double sphericity) {
+        for (int i = 0; i < size; i++) {
+            double Re = exp2(log2ReMin + (log2ReMax - log2ReMin) * i / (size - 1));
+            f[i] = ganserDragCoefficient(Re, sphericity) * Re / 24.0;
         }
     }
 
+    const DragTable& dragTable(MaterialType type) {
+        // Tablice budowane raz, przy pierwszym uzyciu (inicjalizacja statyczna jest watkowo bezpieczna)
+        static const struct Tables {
+            DragTable t[10];
+            Tables() {
+                for (int i = 0; i < 10; i++) t[i].build(MaterialSphericity[i]);
+            }
+        } tables;
+        return tables.t[static_cast<int>(type)];
+    }
+
+    double dragMagnitude(double v_rel, const Materia& m, double airDensity) {
+        double Re = airDensity * fabs(v_rel) * m.diameter / airViscosity;
+        return 3.0 * M_PI * airViscosity * m.diameter * fabs(v_rel) * dragTable(m.type).lookup(Re);
+    }
+
     void dragForceVector(double rel_vx, double rel_vy, double rel_vz, const Materia& m, double airDensity,
         double& out_fx, double& out_fy, double& out_fz) {
         double vrel = sqrt(rel_vx * rel_vx + rel_vy * rel_vy + rel_vz * rel_vz);
-        if (vrel < 1e-12) {
-            out_fx = out_fy = out_fz = 0.0;
-            return;
-        }
-        double mag = dragMagnitude(vrel, m, airDensity);
-        out_fx = -mag * (rel_vx / vrel);
-        out_fy = -mag * (rel_vy / vrel);
-        out_fz = -mag * (rel_vz / vrel);
+        double Re = airDensity * vrel * m.diameter / airViscosity;
+        double k = -3.0 * M_PI * airViscosity * m.diameter * dragTable(m.type).lookup(Re);
+        out_fx = k * rel_vx;
+        out_fy = k * rel_vy;
+        out_fz = k * rel_vz;
     }
 }
\ No newline at end of file
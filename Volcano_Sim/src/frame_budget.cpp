@@ -0,0 +1,74 @@
+#include "../include/frame_budget.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace {
+
+// Waga nowej probki w srednich wykladniczych (~10 klatek pamieci)
+const double kSmoothing = 0.1;
+// Symulacja dostaje co najmniej taka czesc klatki, nawet gdy rysowanie zjada wiecej
+const double kMinSimShare = 0.2;
+// Ponizej tylu czastek koszt kroku to glownie narzut - nie uczymy sie z niego
+const size_t kMinMeasuredParticles = 200;
+
+} // namespace
+
+FrameBudget::FrameBudget(double stepDt)
+    : dt_(stepDt), renderMs_(0.0), simMs_(0.0), perParticleMs_(0.0),
+    budget_(2.0e6), substeps_(1), measured_(false) {
+}
+
+void FrameBudget::update(double simMs, double frameMs, size_t airborne, int steps) {
+    if (steps <= 0) return;
+    double render = max(0.0, frameMs - simMs);
+    double stepMs = simMs / steps;
+    if (!measured_) {
+        renderMs_ = render;
+        simMs_ = simMs;
+        measured_ = true;
+    }
+    else {
+        renderMs_ += kSmoothing * (render - renderMs_);
+        simMs_ += kSmoothing * (simMs - simMs_);
+    }
+    if (airborne >= kMinMeasuredParticles) {
+        double perParticle = stepMs / (double)airborne;
+        perParticleMs_ = perParticleMs_ > 0.0 ? perParticleMs_ + kSmoothing * (perParticle - perParticleMs_) : perParticle;
+    }
+
+    double target = max(1.0, (double)targetFrameMs);
+    double simAvailable = max(target - renderMs_, target * kMinSimShare);
+    int wanted = (int)lround(targetSimRatio * target / (1000.0 * dt_));
+    wanted = max(1, min(wanted, maxSubsteps));
+    if (perParticleMs_ <= 0.0) {
+        substeps_ = wanted;
+        return;
+    }
+
+    // Limit czastek przy pelnej liczbie krokow; w dol od razu, w gore powoli,
+    // zeby emisja nie oscylowala wokol granicy
+    double limit = simAvailable / (wanted * perParticleMs_);
+    budget_ = limit < budget_ ? limit : budget_ + kSmoothing * (limit - budget_);
+    budget_ = max(minParticles, min(budget_, maxParticles));
+
+    // Chmura ponad budzetem (czastek w locie nie usuwamy) - mniej krokow na klatke
+    double fit = simAvailable / (perParticleMs_ * max<size_t>(airborne, 1));
+    substeps_ = max(1, min(wanted, (int)fit));
+}
+
+int FrameBudget::emitCount(int requested, size_t airborne, double& weight) const {
+    weight = 1.0;
+    if (!adaptive || requested <= 0) return requested;
+    double fraction = (budget_ - (double)airborne) / requested;
+    fraction = max(0.0, min(fraction, 1.0));
+    int count = max(1, (int)lround(requested * fraction));
+    weight = (double)requested / count;
+    return count;
+}
+
+int FrameBudget::idleMs(double frameMs) const {
+    if (!adaptive) return 33;
+    return max(1, (int)(targetFrameMs - frameMs));
+}
@@ -0,0 +1,186 @@
+#include "../include/gl_loader.h"
+#include <iostream>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+namespace gl {
+    void (GL_LOADER_CALL* GenBuffers)(GLsizei, GLuint*) = nullptr;
+    void (GL_LOADER_CALL* DeleteBuffers)(GLsizei, const GLuint*) = nullptr;
+    void (GL_LOADER_CALL* BindBuffer)(GLenum, GLuint) = nullptr;
+    void (GL_LOADER_CALL* BufferData)(GLenum, SizeiPtr, const void*, GLenum) = nullptr;
+    void (GL_LOADER_CALL* BufferSubData)(GLenum, IntPtr, SizeiPtr, const void*) = nullptr;
+
+    GLuint(GL_LOADER_CALL* CreateShader)(GLenum) = nullptr;
+    void (GL_LOADER_CALL* DeleteShader)(GLuint) = nullptr;
+    void (GL_LOADER_CALL* ShaderSource)(GLuint, GLsizei, const Char* const*, const GLint*) = nullptr;
+    void (GL_LOADER_CALL* CompileShader)(GLuint) = nullptr;
+    void (GL_LOADER_CALL* GetShaderiv)(GLuint, GLenum, GLint*) = nullptr;
+    void (GL_LOADER_CALL* GetShaderInfoLog)(GLuint, GLsizei, GLsizei*, Char*) = nullptr;
+    GLuint(GL_LOADER_CALL* CreateProgram)() = nullptr;
+    void (GL_LOADER_CALL* DeleteProgram)(GLuint) = nullptr;
+    void (GL_LOADER_CALL* AttachShader)(GLuint, GLuint) = nullptr;
+    void (GL_LOADER_CALL* BindAttribLocation)(GLuint, GLuint, const Char*) = nullptr;
+    void (GL_LOADER_CALL* LinkProgram)(GLuint) = nullptr;
+    void (GL_LOADER_CALL* GetProgramiv)(GLuint, GLenum, GLint*) = nullptr;
+    void (GL_LOADER_CALL* GetProgramInfoLog)(GLuint, GLsizei, GLsizei*, Char*) = nullptr;
+    void (GL_LOADER_CALL* UseProgram)(GLuint) = nullptr;
+
+    GLint(GL_LOADER_CALL* GetUniformLocation)(GLuint, const Char*) = nullptr;
+    void (GL_LOADER_CALL* Uniform1i)(GLint, GLint) = nullptr;
+    void (GL_LOADER_CALL* Uniform1f)(GLint, GLfloat) = nullptr;
+    void (GL_LOADER_CALL* Uniform3f)(GLint, GLfloat, GLfloat, GLfloat) = nullptr;
+    void (GL_LOADER_CALL* Uniform4f)(GLint, GLfloat, GLfloat, GLfloat, GLfloat) = nullptr;
+    void (GL_LOADER_CALL* Uniform3fv)(GLint, GLsizei, const GLfloat*) = nullptr;
+
+    void (GL_LOADER_CALL* EnableVertexAttribArray)(GLuint) = nullptr;
+    void (GL_LOADER_CALL* DisableVertexAttribArray)(GLuint) = nullptr;
+    void (GL_LOADER_CALL* VertexAttribPointer)(GLuint, GLint, GLenum, GLboolean, GLsizei, const void*) = nullptr;
+    void (GL_LOADER_CALL* ActiveTexture)(GLenum) = nullptr;
+    void (GL_LOADER_CALL* MultiDrawArrays)(GLenum, const GLint*, const GLsizei*, GLsizei) = nullptr;
+
+    void (GL_LOADER_CALL* BufferStorage)(GLenum, SizeiPtr, const void*, GLbitfield) = nullptr;
+    void* (GL_LOADER_CALL* MapBufferRange)(GLenum, IntPtr, SizeiPtr, GLbitfield) = nullptr;
+    GLboolean(GL_LOADER_CALL* UnmapBuffer)(GLenum) = nullptr;
+    Sync(GL_LOADER_CALL* FenceSync)(GLenum, GLbitfield) = nullptr;
+    GLenum(GL_LOADER_CALL* ClientWaitSync)(Sync, GLbitfield, Uint64) = nullptr;
+    void (GL_LOADER_CALL* DeleteSync)(Sync) = nullptr;
+
+    static bool loaded = false;
+    static bool persistent = false;
+
+    template <typename T>
+    static bool resolve(T& fn, const char* name) {
+        fn = reinterpret_cast<T>(glfwGetProcAddress(name));
+        if (fn == nullptr) cerr << "GL: brak funkcji " << name << "\n";
+        return fn != nullptr;
+    }
+
+    template <typename T>
+    static bool resolveOptional(T& fn, const char* name) {
+        fn = reinterpret_cast<T>(glfwGetProcAddress(name));
+        return fn != nullptr;
+    }
+
+    // Sterownik moze zwrocic wskaznik do funkcji, ktorej nie obsluguje,
+    // wiec o buforach trwalych decyduje wersja kontekstu lub rozszerzenie
+    static bool supportsBufferStorage() {
+        const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+        int major = 0, minor = 0;
+        if (version && sscanf(version, "%d.%d", &major, &minor) == 2 &&
+            (major > 4 || (major == 4 && minor >= 4))) return true;
+        const char* extensions = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+        return extensions && strstr(extensions, "GL_ARB_buffer_storage") != nullptr;
+    }
+
+    bool load() {
+        bool ok = true;
+        ok &= resolve(GenBuffers, "glGenBuffers");
+        ok &= resolve(DeleteBuffers, "glDeleteBuffers");
+        ok &= resolve(BindBuffer, "glBindBuffer");
+        ok &= resolve(BufferData, "glBufferData");
+        ok &= resolve(BufferSubData, "glBufferSubData");
+
+        ok &= resolve(CreateShader, "glCreateShader");
+        ok &= resolve(DeleteShader, "glDeleteShader");
+        ok &= resolve(ShaderSource, "glShaderSource");
+        ok &= resolve(CompileShader, "glCompileShader");
+        ok &= resolve(GetShaderiv, "glGetShaderiv");
+        ok &= resolve(GetShaderInfoLog, "glGetShaderInfoLog");
+        ok &= resolve(CreateProgram, "glCreateProgram");
+        ok &= resolve(DeleteProgram, "glDeleteProgram");
+        ok &= resolve(AttachShader, "glAttachShader");
+        ok &= resolve(BindAttribLocation, "glBindAttribLocation");
+        ok &= resolve(LinkProgram, "glLinkProgram");
+        ok &= resolve(GetProgramiv, "glGetProgramiv");
+        ok &= resolve(GetProgramInfoLog, "glGetProgramInfoLog");
+        ok &= resolve(UseProgram, "glUseProgram");
+
+        ok &= resolve(GetUniformLocation, "glGetUniformLocation");
+        ok &= resolve(Uniform1i, "glUniform1i");
+        ok &= resolve(Uniform1f, "glUniform1f");
+        ok &= resolve(Uniform3f, "glUniform3f");
+        ok &= resolve(Uniform4f, "glUniform4f");
+        ok &= resolve(Uniform3fv, "glUniform3fv");
+
+        ok &= resolve(EnableVertexAttribArray, "glEnableVertexAttribArray");
+        ok &= resolve(DisableVertexAttribArray, "glDisableVertexAttribArray");
+        ok &= resolve(VertexAttribPointer, "glVertexAttribPointer");
+        ok &= resolve(ActiveTexture, "glActiveTexture");
+        ok &= resolve(MultiDrawArrays, "glMultiDrawArrays");
+
+        bool storage = resolveOptional(BufferStorage, "glBufferStorage");
+        storage &= resolveOptional(MapBufferRange, "glMapBufferRange");
+        storage &= resolveOptional(UnmapBuffer, "glUnmapBuffer");
+        storage &= resolveOptional(FenceSync, "glFenceSync");
+        storage &= resolveOptional(ClientWaitSync, "glClientWaitSync");
+        storage &= resolveOptional(DeleteSync, "glDeleteSync");
+
+        loaded = ok;
+        persistent = ok && storage && supportsBufferStorage();
+        return ok;
+    }
+
+    bool isLoaded() {
+        return loaded;
+    }
+
+    bool hasPersistentMapping() {
+        return persistent;
+    }
+
+    static GLuint compile(const char* name, GLenum type, const char* source) {
+        GLuint shader = CreateShader(type);
+        ShaderSource(shader, 1, &source, nullptr);
+        CompileShader(shader);
+        GLint status = 0;
+        GetShaderiv(shader, GL_COMPILE_STATUS, &status);
+        if (!status) {
+            GLint length = 0;
+            GetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+            vector<Char> log(length > 0 ? length : 1, '\0');
+            GetShaderInfoLog(shader, (GLsizei)log.size(), nullptr, log.data());
+            cerr << name << ": blad kompilacji shadera\n" << log.data() << "\n";
+            DeleteShader(shader);
+            return 0;
+        }
+        return shader;
+    }
+
+    GLuint buildProgram(const char* name, const char* vertexSource, const char* fragmentSource,
+        const char* const* attributes) {
+        if (!loaded) return 0;
+        GLuint vs = compile(name, GL_VERTEX_SHADER, vertexSource);
+        GLuint fs = compile(name, GL_FRAGMENT_SHADER, fragmentSource);
+        if (!vs || !fs) {
+            if (vs) DeleteShader(vs);
+            if (fs) DeleteShader(fs);
+            return 0;
+        }
+
+        GLuint program = CreateProgram();
+        AttachShader(program, vs);
+        AttachShader(program, fs);
+        for (GLuint i = 0; attributes != nullptr && attributes[i] != nullptr; i++) {
+            BindAttribLocation(program, i, attributes[i]);
+        }
+        LinkProgram(program);
+        DeleteShader(vs);
+        DeleteShader(fs);
+
+        GLint status = 0;
+        GetProgramiv(program, GL_LINK_STATUS, &status);
+        if (!status) {
+            GLint length = 0;
+            GetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+            vector<Char> log(length > 0 ? length : 1, '\0');
+            GetProgramInfoLog(program, (GLsizei)log.size(), nullptr, log.data());
+            cerr << name << ": blad linkowania programu\n" << log.data() << "\n";
+            DeleteProgram(program);
+            return 0;
+        }
+        return program;
+    }
+}
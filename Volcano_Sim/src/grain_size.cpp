@@ -0,0 +1,94 @@
+#include "../include/grain_size.h"
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+double diameterFromPhi(double phi) {
+    return 1e-3 * exp2(-phi);
+}
+
+// Udzial masowy frakcji drobniejszych niz phi
+double finerThan(const GrainSizeDistribution& d, double phi) {
+    if (d.kind == GrainSizeDistribution::LogNormal) {
+        return 0.5 * erfc((phi - d.phiMean) / (d.phiSigma * sqrt(2.0)));
+    }
+    // Rosin-Rammler: F(D) = 1 - exp(-(D / lambda)^k) to udzial drobniejszych niz D
+    double ratio = diameterFromPhi(phi) / diameterFromPhi(d.phiMean);
+    return 1.0 - exp(-pow(ratio, d.phiSigma));
+}
+
+} // namespace
+
+GrainSizeModel::GrainSizeModel()
+    : classes_(materialCount * classesPerMaterial),
+    cumulative_(materialCount * classesPerMaterial) {
+    // Gazy: male pakiety ~1 mm jak dotad; piroklasty wg typowych zakresow frakcji
+    GrainSizeDistribution gas{ GrainSizeDistribution::LogNormal, 0.0, 0.5, -1.0, 1.0 };
+    GrainSizeDistribution ash{ GrainSizeDistribution::LogNormal, 3.0, 1.5, -1.0, 8.0 };
+    GrainSizeDistribution lapilli{ GrainSizeDistribution::LogNormal, -3.5, 1.0, -6.0, -1.0 };
+    GrainSizeDistribution bomb{ GrainSizeDistribution::LogNormal, -7.0, 0.7, -9.0, -6.0 };
+    GrainSizeDistribution glass{ GrainSizeDistribution::RosinRammler, 2.0, 1.2, -1.0, 7.0 };
+
+    for (int m = 0; m < materialCount; m++) dist_[m] = gas;
+    dist_[static_cast<int>(MaterialType::VolcanicAsh)] = ash;
+    dist_[static_cast<int>(MaterialType::Lapilli)] = lapilli;
+    dist_[static_cast<int>(MaterialType::VolcanicBomb)] = bomb;
+    dist_[static_cast<int>(MaterialType::VolcanicGlass)] = glass;
+
+    for (int m = 0; m < materialCount; m++) rebuild(static_cast<MaterialType>(m));
+}
+
+void GrainSizeModel::setDistribution(MaterialType type, const GrainSizeDistribution& dist) {
+    dist_[static_cast<int>(type)] = dist;
+    rebuild(type);
+}
+
+const GrainSizeDistribution& GrainSizeModel::distribution(MaterialType type) const {
+    return dist_[static_cast<int>(type)];
+}
+
+void GrainSizeModel::rebuild(MaterialType type) {
+    int m = static_cast<int>(type);
+    const GrainSizeDistribution& d = dist_[m];
+    double density = MaterialDensity[m];
+    double width = (d.phiMax - d.phiMin) / classesPerMaterial;
+
+    // Udzialy w przedzialach phi, znormalizowane do zakresu [phiMin, phiMax]
+    double fractions[classesPerMaterial];
+    double total = 0.0;
+    for (int k = 0; k < classesPerMaterial; k++) {
+        double a = d.phiMin + k * width;
+        fractions[k] = max(0.0, finerThan(d, a) - finerThan(d, a + width));
+        total += fractions[k];
+    }
+
+    double cumulative = 0.0;
+    for (int k = 0; k < classesPerMaterial; k++) {
+        SizeClass& c = classes_[m * classesPerMaterial + k];
+        c.type = type;
+        c.phi = d.phiMin + (k + 0.5) * width;
+        c.diameter = diameterFromPhi(c.phi);
+        c.massFraction = total > 0.0 ? fractions[k] / total : 1.0 / classesPerMaterial;
+        c.density = density;
+        c.invDensity = 1.0 / density;
+        c.stokesRate = 18.0 * physics::airViscosity / (density * c.diameter * c.diameter);
+        c.reynoldsFactor = c.diameter / physics::airViscosity;
+        c.drag = &physics::dragTable(type);
+
+        cumulative += c.massFraction;
+        cumulative_[m * classesPerMaterial + k] = cumulative;
+    }
+    cumulative_[m * classesPerMaterial + classesPerMaterial - 1] = 1.0;
+}
+
+int GrainSizeModel::sampleClass(MaterialType type, double u) const {
+    int m = static_cast<int>(type);
+    auto first = cumulative_.begin() + m * classesPerMaterial;
+    auto last = first + classesPerMaterial;
+    auto it = upper_bound(first, last, u);
+    if (it == last) --it;
+    return (int)(it - cumulative_.begin());
+}
@@ -0,0 +1,388 @@
+#include "../include/headless_renderer.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <glm/gtc/matrix_transform.hpp>
+#include <gdal_priv.h>
+
+using namespace std;
+
+bool CameraPath::load(const string& path) {
+    ifstream in(path);
+    if (!in) {
+        cerr << "CameraPath: nie mozna otworzyc " << path << "\n";
+        return false;
+    }
+    keys.clear();
+    string line;
+    while (getline(in, line)) {
+        size_t hash = line.find('#');
+        if (hash != string::npos) line.erase(hash);
+        istringstream ss(line);
+        Key k;
+        double degrees;
+        if (!(ss >> k.time >> degrees >> k.radius >> k.height)) continue;
+        k.angle = degrees * 3.14159265358979323846 / 180.0;
+        keys.push_back(k);
+    }
+    sort(keys.begin(), keys.end(), [](const Key& a, const Key& b) { return a.time < b.time; });
+    if (keys.empty()) {
+        cerr << "CameraPath: brak klatek kluczowych w " << path << "\n";
+        return false;
+    }
+    cout << "CameraPath: " << keys.size() << " klatek kluczowych z " << path << "\n";
+    return true;
+}
+
+void CameraPath::setOrbit(double radius, double height, double period) {
+    keys.clear();
+    for (int i = 0; i <= 4; i++) {
+        Key k;
+        k.time = period * i / 4.0;
+        k.angle = 2.0 * 3.14159265358979323846 * i / 4.0;
+        k.radius = radius;
+        k.height = height;
+        keys.push_back(k);
+    }
+}
+
+CameraPath::Key CameraPath::at(double time) const {
+    if (keys.empty()) return Key();
+    if (time <= keys.front().time) return keys.front();
+    if (time >= keys.back().time) return keys.back();
+    auto hi = upper_bound(keys.begin(), keys.end(), time,
+        [](double t, const Key& k) { return t < k.time; });
+    const Key& b = *hi;
+    const Key& a = *(hi - 1);
+    double f = (b.time > a.time) ? (time - a.time) / (b.time - a.time) : 0.0;
+    Key k;
+    k.time = time;
+    k.angle = a.angle + f * (b.angle - a.angle);
+    k.radius = a.radius + f * (b.radius - a.radius);
+    k.height = a.height + f * (b.height - a.height);
+    return k;
+}
+
+void SceneSnapshot::capture(int frameIndex, double simTime, const vector<Materia>& airborne,
+    const vector<Materia>& onGround) {
+    frame = frameIndex;
+    time = simTime;
+    particles.resize(airborne.size() * 4);
+    for (size_t i = 0; i < airborne.size(); i++) {
+        const Materia& p = airborne[i];
+        float* out = &particles[i * 4];
+        out[0] = (float)p.position_x;
+        out[1] = (float)p.position_y;
+        out[2] = (float)p.position_z;
+        out[3] = (float)static_cast<int>(p.type);
+    }
+    landed.resize(onGround.size() * 3);
+    for (size_t i = 0; i < onGround.size(); i++) {
+        const Materia& p = onGround[i];
+        landed[i * 3] = (float)p.position_x;
+        landed[i * 3 + 1] = (float)p.position_y;
+        landed[i * 3 + 2] = (float)p.position_z;
+    }
+}
+
+HeadlessRenderer::HeadlessRenderer()
+    : meshW_(0), meshH_(0), stopping_(false), running_(false), framesWritten_(0) {
+}
+
+HeadlessRenderer::~HeadlessRenderer() {
+    finish();
+}
+
+bool HeadlessRenderer::start(const DEMLoader& dem, const CameraPath& camera, const Settings& settings) {
+    finish();
+    if (!dem.isLoaded() || dem.width() < 2 || dem.height() < 2) return false;
+    if (settings.width <= 0 || settings.height <= 0) return false;
+    settings_ = settings;
+    camera_ = camera;
+    buildMesh(dem);
+
+    stopping_ = false;
+    running_ = true;
+    framesWritten_ = 0;
+    thread_ = thread(&HeadlessRenderer::worker, this);
+    cout << "HeadlessRenderer: " << settings_.width << " x " << settings_.height << ", siatka "
+        << meshW_ << " x " << meshH_ << ", klatki do " << settings_.outputDir << "\n";
+    return true;
+}
+
+void HeadlessRenderer::buildMesh(const DEMLoader& dem) {
+    int nx = dem.width(), ny = dem.height();
+    const double* gt = dem.geoTransform();
+    double px = gt[1], py = fabs(gt[5]);
+    double minX = gt[0], minY = gt[3] + ny * gt[5];
+    auto [minH, maxH] = dem.getHeightRange();
+    double range = maxH - minH > 0.0 ? maxH - minH : 1.0;
+    const unsigned char* rgba = dem.rgbaData();
+
+    // Co step pikseli, zeby duze DEM-y nie dominowaly czasu klatki; ostatni wezel na brzegu
+    int step = max(1, (max(nx, ny) - 1 + settings_.meshSize - 2) / max(1, settings_.meshSize - 1));
+    meshW_ = (nx - 1 + step - 1) / step + 1;
+    meshH_ = (ny - 1 + step - 1) / step + 1;
+    auto column = [&](int a) { return min(a * step, nx - 1); };
+    auto row = [&](int b) { return min(b * step, ny - 1); };
+
+    vector<float> height((size_t)meshW_ * meshH_);
+    for (int b = 0; b < meshH_; b++) {
+        for (int a = 0; a < meshW_; a++) {
+            double z = dem.getGroundZ(minX + column(a) * px, minY + row(b) * py);
+            height[(size_t)b * meshW_ + a] = (float)(isnan(z) ? minH : z);
+        }
+    }
+
+    // Wspolrzedne wzgledem krateru - float nie traci precyzji przy duzych X/Y UTM
+    float zScale = settings_.zScale;
+    glm::vec3 light(0.0f, 0.0f, (float)((settings_.craterZ - settings_.baseZ) * zScale + 6000.0));
+    meshPos_.resize(height.size());
+    meshColor_.resize(height.size());
+    for (int b = 0; b < meshH_; b++) {
+        for (int a = 0; a < meshW_; a++) {
+            size_t k = (size_t)b * meshW_ + a;
+            float z = height[k];
+            glm::vec3 p((float)(minX + column(a) * px - settings_.craterX),
+                (float)(minY + row(b) * py - settings_.craterY),
+                (float)((z - settings_.baseZ) * zScale));
+            meshPos_[k] = p;
+
+            int a0 = max(a - 1, 0), a1 = min(a + 1, meshW_ - 1);
+            int b0 = max(b - 1, 0), b1 = min(b + 1, meshH_ - 1);
+            float dx = (float)((column(a1) - column(a0)) * px);
+            float dy = (float)((row(b1) - row(b0)) * py);
+            float gx = dx > 0.0f ? (height[(size_t)b * meshW_ + a1] - height[(size_t)b * meshW_ + a0]) / dx : 0.0f;
+            float gy = dy > 0.0f ? (height[(size_t)b1 * meshW_ + a] - height[(size_t)b0 * meshW_ + a]) / dy : 0.0f;
+            glm::vec3 n = glm::normalize(glm::vec3(-gx * zScale, -gy * zScale, 1.0f));
+            float diffuse = max(glm::dot(n, glm::normalize(light - p)), 0.0f);
+
+            glm::vec3 base;
+            if (rgba) {
+                const unsigned char* c = &rgba[((size_t)(ny - 1 - row(b)) * nx + column(a)) * 4];
+                base = glm::vec3(c[0], c[1], c[2]) / 255.0f;
+            }
+            else {
+                base = glm::vec3((float)((z - minH) / range));
+            }
+            meshColor_[k] = glm::min(base * (0.25f + 0.9f * diffuse), glm::vec3(1.0f));
+        }
+    }
+}
+
+void HeadlessRenderer::submit(SceneSnapshot&& snapshot) {
+    unique_lock<mutex> lock(mutex_);
+    if (!running_) return;
+    changed_.wait(lock, [this] { return queue_.size() < settings_.queueLimit; });
+    queue_.push_back(move(snapshot));
+    changed_.notify_all();
+}
+
+void HeadlessRenderer::finish() {
+    {
+        lock_guard<mutex> lock(mutex_);
+        if (!running_) return;
+        stopping_ = true;
+    }
+    changed_.notify_all();
+    thread_.join();
+    running_ = false;
+    cout << "HeadlessRenderer: zapisano " << framesWritten_ << " klatek\n";
+}
+
+void HeadlessRenderer::worker() {
+    vector<unsigned char> rgb;
+    for (;;) {
+        SceneSnapshot snapshot;
+        {
+            unique_lock<mutex> lock(mutex_);
+            changed_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (queue_.empty()) return;
+            snapshot = move(queue_.front());
+            queue_.pop_front();
+        }
+        changed_.notify_all();
+
+        renderFrame(snapshot, rgb);
+        char name[32];
+        snprintf(name, sizeof(name), "%05d.png", snapshot.frame);
+        string path = settings_.outputDir + "/" + settings_.prefix + name;
+        if (writePNG(path, rgb, settings_.width, settings_.height)) framesWritten_++;
+    }
+}
+
+void HeadlessRenderer::renderFrame(const SceneSnapshot& snapshot, vector<unsigned char>& rgb) const {
+    int w = settings_.width, h = settings_.height;
+    rgb.resize((size_t)w * h * 3);
+    vector<float> depth((size_t)w * h, 1.0f);
+    for (size_t i = 0; i < (size_t)w * h; i++) {
+        rgb[i * 3] = 153;
+        rgb[i * 3 + 1] = 204;
+        rgb[i * 3 + 2] = 255;
+    }
+    Target target{ w, h, &rgb, &depth };
+
+    // Kamera jak w podgladzie, w ukladzie wzgledem krateru
+    CameraPath::Key key = camera_.at(snapshot.time);
+    float craterZ = (float)((settings_.craterZ - settings_.baseZ) * settings_.zScale);
+    glm::vec3 eye((float)(cos(key.angle) * key.radius), (float)(sin(key.angle) * key.radius), craterZ + (float)key.height);
+    glm::mat4 proj = glm::perspective(glm::radians(settings_.fovDeg), (float)w / (float)h, 5.0f, 500000.0f);
+    glm::mat4 view = glm::lookAt(eye, glm::vec3(0.0f, 0.0f, craterZ), glm::vec3(0.0f, 0.0f, 1.0f));
+    glm::mat4 mvp = proj * view;
+
+    vector<Vertex> vertices(meshPos_.size());
+    for (size_t k = 0; k < meshPos_.size(); k++) {
+        vertices[k].clip = mvp * glm::vec4(meshPos_[k], 1.0f);
+        vertices[k].color = meshColor_[k];
+    }
+    for (int b = 0; b + 1 < meshH_; b++) {
+        for (int a = 0; a + 1 < meshW_; a++) {
+            const Vertex& v00 = vertices[(size_t)b * meshW_ + a];
+            const Vertex& v10 = vertices[(size_t)b * meshW_ + a + 1];
+            const Vertex& v11 = vertices[(size_t)(b + 1) * meshW_ + a + 1];
+            const Vertex& v01 = vertices[(size_t)(b + 1) * meshW_ + a];
+            rasterize(target, v00, v10, v11);
+            rasterize(target, v00, v11, v01);
+        }
+    }
+
+    float cx = (float)settings_.craterX, cy = (float)settings_.craterY;
+    float baseZ = (float)settings_.baseZ, zScale = settings_.zScale;
+    glm::vec3 black(0.0f);
+    for (size_t i = 0; i + 3 <= snapshot.landed.size(); i += 3) {
+        const float* p = &snapshot.landed[i];
+        drawPoint(target, mvp, p[0] - cx, p[1] - cy, (p[2] - baseZ) * zScale, black, 4);
+    }
+    for (size_t i = 0; i + 4 <= snapshot.particles.size(); i += 4) {
+        const float* p = &snapshot.particles[i];
+        int type = min(max((int)p[3], 0), 9);
+        glm::vec3 color(ParticleColor[type][0] / 255.0f, ParticleColor[type][1] / 255.0f, ParticleColor[type][2] / 255.0f);
+        drawPoint(target, mvp, p[0] - cx, p[1] - cy, (p[2] - baseZ) * zScale, color, 3);
+    }
+}
+
+void HeadlessRenderer::rasterize(const Target& target, Vertex a, Vertex b, Vertex c) const {
+    // Caly trojkat poza jedna z bocznych plaszczyzn - pomijany
+    auto outside = [&](int axis, float sign) {
+        return sign * a.clip[axis] > a.clip.w && sign * b.clip[axis] > b.clip.w && sign * c.clip[axis] > c.clip.w;
+    };
+    if (outside(0, 1.0f) || outside(0, -1.0f) || outside(1, 1.0f) || outside(1, -1.0f) || outside(2, 1.0f)) return;
+
+    // Obcinanie plaszczyzna bliska (z >= -w); wielokat do 4 wierzcholkow
+    Vertex in[3] = { a, b, c };
+    Vertex out[4];
+    int n = 0;
+    for (int i = 0; i < 3; i++) {
+        const Vertex& p = in[i];
+        const Vertex& q = in[(i + 1) % 3];
+        float dp = p.clip.z + p.clip.w;
+        float dq = q.clip.z + q.clip.w;
+        if (dp >= 0.0f) out[n++] = p;
+        if ((dp >= 0.0f) != (dq >= 0.0f)) {
+            float t = dp / (dp - dq);
+            out[n].clip = p.clip + t * (q.clip - p.clip);
+            out[n].color = p.color + t * (q.color - p.color);
+            n++;
+        }
+    }
+    for (int i = 1; i + 1 < n; i++) drawTriangle(target, out[0], out[i], out[i + 1]);
+}
+
+void HeadlessRenderer::drawTriangle(const Target& target, const Vertex& a, const Vertex& b, const Vertex& c) const {
+    // Do pikseli ekranu (wiersz 0 u gory, jak w PNG) i glebokosci okna [0, 1]
+    glm::vec3 s[3];
+    const Vertex* v[3] = { &a, &b, &c };
+    for (int i = 0; i < 3; i++) {
+        float inv = 1.0f / v[i]->clip.w;
+        s[i] = glm::vec3((v[i]->clip.x * inv * 0.5f + 0.5f) * target.width,
+            (0.5f - v[i]->clip.y * inv * 0.5f) * target.height,
+            v[i]->clip.z * inv * 0.5f + 0.5f);
+    }
+    float area = (s[1].x - s[0].x) * (s[2].y - s[0].y) - (s[2].x - s[0].x) * (s[1].y - s[0].y);
+    if (fabs(area) < 1e-12f) return;
+    float invArea = 1.0f / area;
+
+    int x0 = max(0, (int)floor(min({ s[0].x, s[1].x, s[2].x })));
+    int x1 = min(target.width - 1, (int)ceil(max({ s[0].x, s[1].x, s[2].x })));
+    int y0 = max(0, (int)floor(min({ s[0].y, s[1].y, s[2].y })));
+    int y1 = min(target.height - 1, (int)ceil(max({ s[0].y, s[1].y, s[2].y })));
+
+    for (int y = y0; y <= y1; y++) {
+        float py = y + 0.5f;
+        for (int x = x0; x <= x1; x++) {
+            float px = x + 0.5f;
+            float w0 = ((s[1].x - px) * (s[2].y - py) - (s[2].x - px) * (s[1].y - py)) * invArea;
+            float w1 = ((s[2].x - px) * (s[0].y - py) - (s[0].x - px) * (s[2].y - py)) * invArea;
+            float w2 = 1.0f - w0 - w1;
+            if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) continue;
+
+            float z = w0 * s[0].z + w1 * s[1].z + w2 * s[2].z;
+            size_t idx = (size_t)y * target.width + x;
+            if (z >= (*target.depth)[idx] || z < 0.0f) continue;
+            (*target.depth)[idx] = z;
+            glm::vec3 color = w0 * a.color + w1 * b.color + w2 * c.color;
+            unsigned char* out = &(*target.rgb)[idx * 3];
+            out[0] = (unsigned char)(255.0f * color.r);
+            out[1] = (unsigned char)(255.0f * color.g);
+            out[2] = (unsigned char)(255.0f * color.b);
+        }
+    }
+}
+
+void HeadlessRenderer::drawPoint(const Target& target, const glm::mat4& mvp, float x, float y, float z,
+    const glm::vec3& color, int size) const {
+    glm::vec4 clip = mvp * glm::vec4(x, y, z, 1.0f);
+    if (clip.w <= 0.0f) return;
+    float inv = 1.0f / clip.w;
+    float sx = (clip.x * inv * 0.5f + 0.5f) * target.width;
+    float sy = (0.5f - clip.y * inv * 0.5f) * target.height;
+    float depth = clip.z * inv * 0.5f + 0.5f;
+    if (depth < 0.0f || depth > 1.0f) return;
+
+    // Kwadrat size x size pikseli jak glPointSize
+    int x0 = (int)floor(sx - size * 0.5f + 0.5f);
+    int y0 = (int)floor(sy - size * 0.5f + 0.5f);
+    unsigned char r = (unsigned char)(255.0f * color.r);
+    unsigned char g = (unsigned char)(255.0f * color.g);
+    unsigned char b = (unsigned char)(255.0f * color.b);
+    for (int py = max(y0, 0); py < min(y0 + size, target.height); py++) {
+        for (int px = max(x0, 0); px < min(x0 + size, target.width); px++) {
+            size_t idx = (size_t)py * target.width + px;
+            if (depth >= (*target.depth)[idx]) continue;
+            (*target.depth)[idx] = depth;
+            unsigned char* out = &(*target.rgb)[idx * 3];
+            out[0] = r;
+            out[1] = g;
+            out[2] = b;
+        }
+    }
+}
+
+bool HeadlessRenderer::writePNG(const string& path, const vector<unsigned char>& rgb, int width, int height) {
+    if (rgb.size() < (size_t)width * height * 3) return false;
+    GDALAllRegister();
+    GDALDriver* mem = GetGDALDriverManager()->GetDriverByName("MEM");
+    GDALDriver* png = GetGDALDriverManager()->GetDriverByName("PNG");
+    if (!mem || !png) {
+        cerr << "HeadlessRenderer: brak sterownika GDAL MEM lub PNG\n";
+        return false;
+    }
+
+    // Bufor przeplatany RGB jako trzy pasma zbioru w pamieci, potem kopia do PNG
+    GDALDataset* ds = mem->Create("", width, height, 3, GDT_Byte, nullptr);
+    if (!ds) return false;
+    int bands[3] = { 1, 2, 3 };
+    CPLErr err = ds->RasterIO(GF_Write, 0, 0, width, height, (void*)rgb.data(), width, height, GDT_Byte,
+        3, bands, 3, (GSpacing)width * 3, 1);
+    GDALDataset* out = err == CE_None ? png->CreateCopy(path.c_str(), ds, FALSE, nullptr, nullptr, nullptr) : nullptr;
+    GDALClose(ds);
+    if (!out) {
+        cerr << "HeadlessRenderer: nie mozna zapisac " << path << "\n";
+        return false;
+    }
+    GDALClose(out);
+    return true;
+}
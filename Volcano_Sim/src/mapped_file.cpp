@@ -0,0 +1,127 @@
+#include "../include/mapped_file.h"
+#include <iostream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const string& path) {
+    close();
+
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        cerr << "MappedFile: nie mozna otworzyc pliku: " << path << "\n";
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize)) {
+        CloseHandle(file);
+        cerr << "MappedFile: nie mozna odczytac rozmiaru pliku: " << path << "\n";
+        return false;
+    }
+    if (fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        opened_ = true;
+        return true;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        CloseHandle(file);
+        cerr << "MappedFile: blad mapowania pliku: " << path << "\n";
+        return false;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        cerr << "MappedFile: blad mapowania pliku: " << path << "\n";
+        return false;
+    }
+
+    file_ = file;
+    mapping_ = mapping;
+    data_ = static_cast<const char*>(view);
+    size_ = (size_t)fileSize.QuadPart;
+    opened_ = true;
+    return true;
+}
+
+void MappedFile::close() {
+    if (data_) UnmapViewOfFile(data_);
+    if (mapping_) CloseHandle(mapping_);
+    if (file_) CloseHandle(file_);
+    data_ = nullptr;
+    mapping_ = nullptr;
+    file_ = nullptr;
+    size_ = 0;
+    opened_ = false;
+}
+
+#else
+
+bool MappedFile::open(const string& path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        cerr << "MappedFile: nie mozna otworzyc pliku: " << path << "\n";
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        cerr << "MappedFile: nie mozna odczytac rozmiaru pliku: " << path << "\n";
+        return false;
+    }
+    if (st.st_size == 0) {
+        ::close(fd);
+        opened_ = true;
+        return true;
+    }
+
+    void* view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // Deskryptor nie jest potrzebny po utworzeniu mapowania
+    ::close(fd);
+    if (view == MAP_FAILED) {
+        cerr << "MappedFile: blad mapowania pliku: " << path << "\n";
+        return false;
+    }
+    madvise(view, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    data_ = static_cast<const char*>(view);
+    size_ = (size_t)st.st_size;
+    opened_ = true;
+    return true;
+}
+
+void MappedFile::close() {
+    if (data_) munmap(const_cast<char*>(data_), size_);
+    data_ = nullptr;
+    size_ = 0;
+    opened_ = false;
+}
+
+#endif
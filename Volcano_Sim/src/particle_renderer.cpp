@@ -0,0 +1,316 @@
+#include "../include/particle_renderer.h"
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+using namespace std;
+
+namespace {
+
+const char* kParticleVertex = R"(
+#version 120
+attribute vec4 particle;    // x, y, surowa wysokosc, material
+uniform float zScale;
+uniform float baseZ;
+uniform vec3 colors[11];
+varying vec3 color;
+void main() {
+    color = colors[int(particle.w + 0.5)];
+    gl_PointSize = particle.w > 9.5 ? 4.0 : 3.0;
+    gl_Position = gl_ModelViewProjectionMatrix * vec4(particle.xy, (particle.z - baseZ) * zScale, 1.0);
+}
+)";
+
+// Czastek na watek, ponizej ktorej dodatkowy watek sie nie oplaca
+const size_t kParticlesPerThread = 20000;
+
+const char* kParticleFragment = R"(
+#version 120
+varying vec3 color;
+void main() {
+    gl_FragColor = vec4(color, 1.0);
+}
+)";
+
+} // namespace
+
+ParticleRenderer::ParticleRenderer()
+    : program_(0), buffer_(0), capacity_(0), mapped_(nullptr), fences_{}, region_(0),
+    gridMin_{ 0.0f, 0.0f }, gridInv_{ 0.0f, 0.0f },
+    threads_(1), total_(0), drawn_(0), culled_(0),
+    locZScale_(-1), locBaseZ_(-1), locColors_(-1) {
+}
+
+ParticleRenderer::~ParticleRenderer() {
+    release();
+}
+
+void ParticleRenderer::release() {
+    if (gl::isLoaded()) {
+        releaseBuffer();
+        if (program_) gl::DeleteProgram(program_);
+    }
+    program_ = 0;
+    buffer_ = 0;
+    mapped_ = nullptr;
+    capacity_ = 0;
+    staging_.clear();
+    staging_.shrink_to_fit();
+    binOf_.clear();
+    binOf_.shrink_to_fit();
+}
+
+bool ParticleRenderer::build(size_t initialCapacity) {
+    if (!gl::isLoaded()) return false;
+    release();
+
+    const char* attributes[] = { "particle", nullptr };
+    program_ = gl::buildProgram("ParticleRenderer", kParticleVertex, kParticleFragment, attributes);
+    if (!program_) return false;
+    locZScale_ = gl::GetUniformLocation(program_, "zScale");
+    locBaseZ_ = gl::GetUniformLocation(program_, "baseZ");
+    locColors_ = gl::GetUniformLocation(program_, "colors");
+
+    // Paleta stala: ParticleColor (0-255) i czern dla czastek na ziemi
+    GLfloat colors[(landedMaterial + 1) * 3] = {};
+    for (int i = 0; i < landedMaterial; i++) {
+        for (int c = 0; c < 3; c++) colors[i * 3 + c] = ParticleColor[i][c] / 255.0f;
+    }
+    gl::UseProgram(program_);
+    gl::Uniform3fv(locColors_, landedMaterial + 1, colors);
+    gl::UseProgram(0);
+
+    if (!allocate(max(initialCapacity, (size_t)1024))) {
+        release();
+        return false;
+    }
+    cout << "ParticleRenderer: " << (isPersistent() ? "bufor trwale mapowany x3" : "bufor osierocany (brak GL 4.4)")
+        << ", " << capacity_ << " czastek na region\n";
+    return true;
+}
+
+bool ParticleRenderer::allocate(size_t capacity) {
+    releaseBuffer();
+    capacity_ = capacity;
+    region_ = 0;
+    gl::GenBuffers(1, &buffer_);
+    gl::BindBuffer(GL_ARRAY_BUFFER, buffer_);
+
+    if (gl::hasPersistentMapping()) {
+        gl::SizeiPtr size = (gl::SizeiPtr)(regions * capacity_ * sizeof(ParticleVertex));
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        gl::BufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+        mapped_ = static_cast<ParticleVertex*>(gl::MapBufferRange(GL_ARRAY_BUFFER, 0, size, flags));
+        if (mapped_ == nullptr) {
+            // Bufor z glBufferStorage ma niezmienny rozmiar - nowy do trybu osierocania
+            cerr << "ParticleRenderer: nie mozna zmapowac bufora, przejscie na glBufferSubData\n";
+            gl::DeleteBuffers(1, &buffer_);
+            gl::GenBuffers(1, &buffer_);
+            gl::BindBuffer(GL_ARRAY_BUFFER, buffer_);
+        }
+    }
+    if (mapped_ == nullptr) {
+        gl::BufferData(GL_ARRAY_BUFFER, (gl::SizeiPtr)(capacity_ * sizeof(ParticleVertex)), nullptr, GL_STREAM_DRAW);
+    }
+    gl::BindBuffer(GL_ARRAY_BUFFER, 0);
+    return buffer_ != 0;
+}
+
+void ParticleRenderer::releaseBuffer() {
+    for (int r = 0; r < regions; r++) waitRegion(r);
+    if (buffer_) {
+        if (mapped_) {
+            gl::BindBuffer(GL_ARRAY_BUFFER, buffer_);
+            gl::UnmapBuffer(GL_ARRAY_BUFFER);
+            gl::BindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        gl::DeleteBuffers(1, &buffer_);
+    }
+    buffer_ = 0;
+    mapped_ = nullptr;
+}
+
+void ParticleRenderer::waitRegion(int region) {
+    gl::Sync& fence = fences_[region];
+    if (fence == nullptr) return;
+    // Zwykle region jest wolny od dwoch klatek; czekanie tylko przy zatorze GPU
+    GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    for (;;) {
+        GLenum result = gl::ClientWaitSync(fence, flags, 1000000);
+        if (result != GL_TIMEOUT_EXPIRED) break;
+        flags = 0;
+    }
+    gl::DeleteSync(fence);
+    fence = nullptr;
+}
+
+template <typename Job>
+void ParticleRenderer::parallel(Job&& job) const {
+    vector<thread> pool;
+    for (int t = 1; t < threads_; t++) pool.emplace_back(job, t);
+    job(0);
+    for (auto& th : pool) th.join();
+}
+
+// Czastki [total * t / threads, total * (t + 1) / threads) w kolejnosci zakresow
+template <typename Fn>
+void ParticleRenderer::forThreadRange(const vector<Batch>& batches, int t, Fn&& fn) const {
+    size_t begin = total_ * t / threads_, end = total_ * (t + 1) / threads_;
+    size_t offset = 0, k = begin;
+    for (const auto& b : batches) {
+        size_t bEnd = offset + b.count;
+        for (; k < end && k < bEnd; k++) fn(k, b.particles[k - offset], b.landed);
+        offset = bEnd;
+        if (k >= end) break;
+    }
+}
+
+size_t ParticleRenderer::binParticles(const vector<Batch>& batches, const glm::mat4& viewProj,
+    float zScale, float baseZ) {
+    binOf_.resize(total_);
+    binCount_.assign((size_t)threads_ * bins, 0);
+    binBox_.assign((size_t)threads_ * bins, BinBox{ { HUGE_VALF, HUGE_VALF, HUGE_VALF }, { -HUGE_VALF, -HUGE_VALF, -HUGE_VALF } });
+    visible_.assign(bins, 0);
+
+    // Zliczanie: kazdy watek we wlasnych licznikach i prostopadloscianach
+    parallel([&](int t) {
+        size_t* count = &binCount_[(size_t)t * bins];
+        BinBox* box = &binBox_[(size_t)t * bins];
+        forThreadRange(batches, t, [&](size_t k, const Materia& p, bool) {
+            float x = (float)p.position_x, y = (float)p.position_y;
+            float z = ((float)p.position_z - baseZ) * zScale;
+            // Czastki spoza siatki w skrajnych kubelkach - tylko wieksze prostopadlosciany
+            int bx = (int)max(0.0f, min((x - gridMin_[0]) * gridInv_[0], (float)(binGrid - 1)));
+            int by = (int)max(0.0f, min((y - gridMin_[1]) * gridInv_[1], (float)(binGrid - 1)));
+            int b = by * binGrid + bx;
+            binOf_[k] = (uint16_t)b;
+            count[b]++;
+            BinBox& bb = box[b];
+            bb.min[0] = min(bb.min[0], x); bb.max[0] = max(bb.max[0], x);
+            bb.min[1] = min(bb.min[1], y); bb.max[1] = max(bb.max[1], y);
+            bb.min[2] = min(bb.min[2], z); bb.max[2] = max(bb.max[2], z);
+        });
+    });
+
+    // Plaszczyzny piramidy widzenia (Gribb, Hartmann), jak przy kaflach terenu
+    glm::vec4 row[4];
+    for (int r = 0; r < 4; r++) row[r] = glm::vec4(viewProj[0][r], viewProj[1][r], viewProj[2][r], viewProj[3][r]);
+    glm::vec4 planes[6] = { row[3] + row[0], row[3] - row[0], row[3] + row[1],
+        row[3] - row[1], row[3] + row[2], row[3] - row[2] };
+
+    // Widoczne kubelki dostaja kolejne pozycje w buforze; w kubelku watki po kolei
+    size_t cursor = 0;
+    culled_ = 0;
+    float lo[2] = { HUGE_VALF, HUGE_VALF }, hi[2] = { -HUGE_VALF, -HUGE_VALF };
+    for (int b = 0; b < bins; b++) {
+        BinBox box = binBox_[b];
+        size_t n = binCount_[b];
+        for (int t = 1; t < threads_; t++) {
+            const BinBox& o = binBox_[(size_t)t * bins + b];
+            for (int c = 0; c < 3; c++) {
+                box.min[c] = min(box.min[c], o.min[c]);
+                box.max[c] = max(box.max[c], o.max[c]);
+            }
+            n += binCount_[(size_t)t * bins + b];
+        }
+        if (n == 0) continue;
+        for (int c = 0; c < 2; c++) {
+            lo[c] = min(lo[c], box.min[c]);
+            hi[c] = max(hi[c], box.max[c]);
+        }
+
+        bool inside = true;
+        for (const auto& p : planes) {
+            glm::vec3 pv(p.x >= 0 ? box.max[0] : box.min[0], p.y >= 0 ? box.max[1] : box.min[1],
+                p.z >= 0 ? box.max[2] : box.min[2]);
+            if (p.x * pv.x + p.y * pv.y + p.z * pv.z + p.w < 0.0f) { inside = false; break; }
+        }
+        if (!inside) {
+            culled_ += n;
+            continue;
+        }
+        visible_[b] = 1;
+        for (int t = 0; t < threads_; t++) {
+            size_t& c = binCount_[(size_t)t * bins + b];
+            size_t start = cursor;
+            cursor += c;
+            c = start;
+        }
+    }
+
+    // Zasieg chmury zmienia sie powoli - siatka na nastepna klatke
+    for (int c = 0; c < 2; c++) {
+        if (lo[c] > hi[c]) continue;
+        gridMin_[c] = lo[c];
+        gridInv_[c] = binGrid / max(hi[c] - lo[c], 1.0f);
+    }
+    return cursor;
+}
+
+void ParticleRenderer::writeVisible(const vector<Batch>& batches, ParticleVertex* out) {
+    parallel([&](int t) {
+        size_t* next = &binCount_[(size_t)t * bins];
+        forThreadRange(batches, t, [&](size_t k, const Materia& p, bool landed) {
+            int b = binOf_[k];
+            if (!visible_[b]) return;
+            float material = landed ? (float)landedMaterial : (float)static_cast<int>(p.type);
+            out[next[b]++] = { (float)p.position_x, (float)p.position_y, (float)p.position_z, material };
+        });
+    });
+}
+
+void ParticleRenderer::draw(const vector<Batch>& batches, const glm::mat4& viewProj, float zScale, float baseZ) {
+    drawn_ = culled_ = 0;
+    if (!isBuilt()) return;
+    total_ = 0;
+    for (const auto& b : batches) total_ += b.count;
+    if (total_ == 0) return;
+    threads_ = (int)min<size_t>(max(1u, thread::hardware_concurrency()), max<size_t>(1, total_ / kParticlesPerThread));
+
+    size_t count = binParticles(batches, viewProj, zScale, baseZ);
+    drawn_ = count;
+    if (count == 0) return;
+
+    if (count > capacity_) {
+        // Nowy bufor z zapasem, zeby nie powiekszac go co klatke przy rosnacej chmurze
+        if (!allocate(max(count, capacity_ + capacity_ / 2))) return;
+    }
+
+    // Region, ktorego GPU juz nie czyta (persistent) albo swiezo osierocony bufor
+    ParticleVertex* out;
+    size_t first = 0;
+    if (mapped_) {
+        region_ = (region_ + 1) % regions;
+        waitRegion(region_);
+        first = (size_t)region_ * capacity_;
+        out = mapped_ + first;
+    }
+    else {
+        staging_.resize(count);
+        out = staging_.data();
+    }
+    writeVisible(batches, out);
+
+    gl::BindBuffer(GL_ARRAY_BUFFER, buffer_);
+    if (!mapped_) {
+        gl::SizeiPtr size = (gl::SizeiPtr)(capacity_ * sizeof(ParticleVertex));
+        gl::BufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        gl::BufferSubData(GL_ARRAY_BUFFER, 0, (gl::SizeiPtr)(count * sizeof(ParticleVertex)), staging_.data());
+    }
+
+    gl::UseProgram(program_);
+    gl::Uniform1f(locZScale_, zScale);
+    gl::Uniform1f(locBaseZ_, baseZ);
+    glEnable(GL_VERTEX_PROGRAM_POINT_SIZE);
+    gl::EnableVertexAttribArray(0);
+    gl::VertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleVertex), (const void*)0);
+    glDrawArrays(GL_POINTS, (GLint)first, (GLsizei)count);
+
+    if (mapped_) fences_[region_] = gl::FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    gl::DisableVertexAttribArray(0);
+    glDisable(GL_VERTEX_PROGRAM_POINT_SIZE);
+    gl::BindBuffer(GL_ARRAY_BUFFER, 0);
+    gl::UseProgram(0);
+}
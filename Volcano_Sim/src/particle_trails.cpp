@@ -0,0 +1,241 @@
+#include "../include/particle_trails.h"
+#include <iostream>
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+const char* kTrailVertex = R"(
+#version 120
+attribute vec4 point;       // x, y, surowa wysokosc, numer probki
+attribute float material;
+uniform float zScale;
+uniform float baseZ;
+uniform float newest;
+uniform float history;
+uniform vec3 colors[10];
+varying vec4 color;
+void main() {
+    float age = newest - point.w;
+    color = vec4(colors[int(material + 0.5)], clamp(1.0 - age / history, 0.0, 1.0));
+    gl_Position = gl_ModelViewProjectionMatrix * vec4(point.xy, (point.z - baseZ) * zScale, 1.0);
+}
+)";
+
+const char* kTrailFragment = R"(
+#version 120
+varying vec4 color;
+void main() {
+    gl_FragColor = color;
+}
+)";
+
+} // namespace
+
+ParticleTrails::ParticleTrails()
+    : maxTrails_(0), history_(0), mapped_(nullptr), sample_(0), head_(0), sinceSample_(0.0),
+    candidates_(0), paused_(true), dirty_(false), program_(0), buffer_(0),
+    locZScale_(-1), locBaseZ_(-1), locNewest_(-1), locHistory_(-1), locColors_(-1) {
+}
+
+ParticleTrails::~ParticleTrails() {
+    release();
+}
+
+void ParticleTrails::release() {
+    if (gl::isLoaded()) {
+        if (buffer_) {
+            if (mapped_) {
+                gl::BindBuffer(GL_ARRAY_BUFFER, buffer_);
+                gl::UnmapBuffer(GL_ARRAY_BUFFER);
+                gl::BindBuffer(GL_ARRAY_BUFFER, 0);
+            }
+            gl::DeleteBuffers(1, &buffer_);
+        }
+        if (program_) gl::DeleteProgram(program_);
+    }
+    buffer_ = 0;
+    program_ = 0;
+    mapped_ = nullptr;
+    maxTrails_ = history_ = 0;
+    slots_.clear();
+    freeSlots_.clear();
+    staging_.clear();
+    staging_.shrink_to_fit();
+    firsts_.clear();
+    counts_.clear();
+}
+
+bool ParticleTrails::build(int maxTrails, int historyLength) {
+    if (!gl::isLoaded() || maxTrails <= 0 || historyLength < 2) return false;
+    release();
+
+    const char* attributes[] = { "point", "material", nullptr };
+    program_ = gl::buildProgram("ParticleTrails", kTrailVertex, kTrailFragment, attributes);
+    if (!program_) return false;
+    locZScale_ = gl::GetUniformLocation(program_, "zScale");
+    locBaseZ_ = gl::GetUniformLocation(program_, "baseZ");
+    locNewest_ = gl::GetUniformLocation(program_, "newest");
+    locHistory_ = gl::GetUniformLocation(program_, "history");
+    locColors_ = gl::GetUniformLocation(program_, "colors");
+
+    GLfloat colors[10 * 3];
+    for (int i = 0; i < 10; i++) {
+        for (int c = 0; c < 3; c++) colors[i * 3 + c] = ParticleColor[i][c] / 255.0f;
+    }
+    gl::UseProgram(program_);
+    gl::Uniform3fv(locColors_, 10, colors);
+    gl::UseProgram(0);
+
+    maxTrails_ = maxTrails;
+    history_ = historyLength;
+    slots_.assign(maxTrails_, Slot{ 0, 0, 0, false });
+    // Wolne od konca, zeby zajete byly najnizsze sloty (krotszy zakres do wysylki)
+    freeSlots_.resize(maxTrails_);
+    for (int i = 0; i < maxTrails_; i++) freeSlots_[i] = maxTrails_ - 1 - i;
+    firsts_.resize(maxTrails_);
+    counts_.resize(maxTrails_);
+    sample_ = 0;
+    head_ = 0;
+    sinceSample_ = 0.0;
+    paused_ = true;
+
+    size_t vertices = (size_t)maxTrails_ * 2 * history_;
+    gl::SizeiPtr size = (gl::SizeiPtr)(vertices * sizeof(TrailVertex));
+    gl::GenBuffers(1, &buffer_);
+    gl::BindBuffer(GL_ARRAY_BUFFER, buffer_);
+    if (gl::hasPersistentMapping()) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        gl::BufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+        mapped_ = static_cast<TrailVertex*>(gl::MapBufferRange(GL_ARRAY_BUFFER, 0, size, flags));
+        if (mapped_ == nullptr) {
+            cerr << "ParticleTrails: nie mozna zmapowac bufora, przejscie na glBufferSubData\n";
+            gl::DeleteBuffers(1, &buffer_);
+            gl::GenBuffers(1, &buffer_);
+            gl::BindBuffer(GL_ARRAY_BUFFER, buffer_);
+        }
+    }
+    if (mapped_ == nullptr) {
+        gl::BufferData(GL_ARRAY_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+        staging_.resize(vertices);
+    }
+    gl::BindBuffer(GL_ARRAY_BUFFER, 0);
+
+    cout << "ParticleTrails: " << maxTrails_ << " sladow x " << history_ << " probek ("
+        << (mapped_ ? "bufor trwale mapowany" : "glBufferSubData") << ")\n";
+    return true;
+}
+
+void ParticleTrails::record(vector<Materia>& particles, double dt) {
+    if (!isBuilt() || !enabled) {
+        paused_ = true;
+        return;
+    }
+    if (paused_) {
+        // Przerwa w zapisie - stare probki nie lacza sie z nowymi
+        for (auto& s : slots_) s.count = 0;
+        sinceSample_ = sampleInterval;
+        paused_ = false;
+    }
+    else {
+        sinceSample_ += dt;
+    }
+    if (sinceSample_ < sampleInterval) return;
+    // Reszta przechodzi na nastepna probke, ale najwyzej jeden odstep, zeby
+    // dlugi krok nie wymuszal serii probek w kolejnych wywolaniach
+    sinceSample_ = min(sinceSample_ - sampleInterval, sampleInterval);
+
+    sample_++;
+    head_ = (head_ + 1) % history_;
+    TrailVertex* base = mapped_ ? mapped_ : staging_.data();
+    int every = max(1, sampleEvery);
+
+    // Zapis w miejscu: dwa wierzcholki na slad. Bez fence'a GPU moze jeszcze
+    // czytac poprzednia klatke, ale nadpisywany jest wtedy tylko najstarszy,
+    // prawie przezroczysty wierzcholek sladu.
+    for (auto& p : particles) {
+        if (p.trail == -1) {
+            p.trail = notSampled;
+            if (candidates_++ % every == 0 && !freeSlots_.empty()) {
+                p.trail = freeSlots_.back();
+                freeSlots_.pop_back();
+                slots_[p.trail] = Slot{ 0, static_cast<int>(p.type), sample_, true };
+            }
+        }
+        if (p.trail < 0) continue;
+        if (p.trail >= maxTrails_ || !slots_[p.trail].used) {
+            // Slot z poprzedniego build() albo juz oddany - nie dzielic go z inna czastka
+            p.trail = notSampled;
+            continue;
+        }
+
+        Slot& s = slots_[p.trail];
+        s.lastSeen = sample_;
+        s.count = min(s.count + 1, history_);
+        TrailVertex v = { (float)p.position_x, (float)p.position_y, (float)p.position_z,
+            (float)sample_, (float)s.material };
+        TrailVertex* ring = base + (size_t)p.trail * 2 * history_;
+        ring[head_] = v;
+        ring[head_ + history_] = v;
+    }
+
+    // Czastki, ktore opadly lub opuscily chmure, oddaja slot
+    for (int i = 0; i < maxTrails_; i++) {
+        Slot& s = slots_[i];
+        if (s.used && s.lastSeen != sample_) {
+            s.used = false;
+            freeSlots_.push_back(i);
+        }
+    }
+    dirty_ = true;
+}
+
+void ParticleTrails::draw(unsigned materialMask, float zScale, float baseZ) {
+    if (!isBuilt() || !enabled) return;
+
+    // Ostatnie count probek slotu: od head - count + 1 do head + history (najnowsza)
+    GLsizei strips = 0;
+    int lastSlot = -1;
+    for (int i = 0; i < maxTrails_; i++) {
+        const Slot& s = slots_[i];
+        if (!s.used || s.count < 2 || !((materialMask >> s.material) & 1u)) continue;
+        firsts_[strips] = (GLint)((size_t)i * 2 * history_ + head_ + history_ - s.count + 1);
+        counts_[strips] = (GLsizei)s.count;
+        strips++;
+        lastSlot = i;
+    }
+    if (strips == 0) return;
+
+    gl::BindBuffer(GL_ARRAY_BUFFER, buffer_);
+    if (!mapped_ && dirty_) {
+        size_t used = (size_t)(lastSlot + 1) * 2 * history_;
+        gl::BufferSubData(GL_ARRAY_BUFFER, 0, (gl::SizeiPtr)(used * sizeof(TrailVertex)), staging_.data());
+    }
+    dirty_ = false;
+
+    glPushAttrib(GL_ENABLE_BIT | GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT | GL_LINE_BIT);
+    glDisable(GL_LIGHTING);
+    glEnable(GL_DEPTH_TEST);
+    glDepthMask(GL_FALSE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glLineWidth(1.5f);
+
+    gl::UseProgram(program_);
+    gl::Uniform1f(locZScale_, zScale);
+    gl::Uniform1f(locBaseZ_, baseZ);
+    gl::Uniform1f(locNewest_, (float)sample_);
+    gl::Uniform1f(locHistory_, (float)history_);
+    gl::EnableVertexAttribArray(0);
+    gl::EnableVertexAttribArray(1);
+    gl::VertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(TrailVertex), (const void*)0);
+    gl::VertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(TrailVertex), (const void*)(4 * sizeof(float)));
+    gl::MultiDrawArrays(GL_LINE_STRIP, firsts_.data(), counts_.data(), strips);
+
+    gl::DisableVertexAttribArray(0);
+    gl::DisableVertexAttribArray(1);
+    gl::BindBuffer(GL_ARRAY_BUFFER, 0);
+    gl::UseProgram(0);
+    glPopAttrib();
+}
@@ -0,0 +1,162 @@
+#include "../include/plume_model.h"
+#include "../include/formulas.h"
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace {
+
+const double kAirHeatCapacity = 998.0;      // C_a [J/(kg K)]
+const double kSolidHeatCapacity = 1100.0;   // piroklasty
+const double kVapourHeatCapacity = 1617.0;  // para wodna
+const double kAirGasConstant = 287.05;
+const double kVapourGasConstant = 461.5;
+
+struct PlumeState {
+    double Q, M, E;     // strumienie masy, pedu, entalpii (bez czynnika pi)
+};
+
+} // namespace
+
+PlumeModel::PlumeModel()
+    : dirty_(true), solvedVersion_(0), columnTop_(0.0), neutralHeight_(0.0), collapsed_(false) {
+}
+
+void PlumeModel::setSource(const Source& source) {
+    source_ = source;
+    dirty_ = true;
+}
+
+bool PlumeModel::update(const Weather& weather) {
+    if (!dirty_ && solvedVersion_ == weather.tableVersion()) return false;
+    solve(weather);
+    return true;
+}
+
+void PlumeModel::solve(const Weather& weather) {
+    const double g = physics::g;
+    const double n0 = 1.0 - source_.gasFraction;     // udzial piroklastow u wylotu
+    const double C0 = n0 * kSolidHeatCapacity + source_.gasFraction * kVapourHeatCapacity;
+
+    AtmosphereSample a0 = weather.atmosphereAt(source_.z);
+    double rhoGas0 = a0.pressure / (kVapourGasConstant * source_.temperature);
+    double beta0 = 1.0 / (source_.gasFraction / rhoGas0 + n0 / source_.magmaDensity);
+    double b0 = source_.radius;
+    double U0 = source_.velocity;
+    double Q0 = beta0 * b0 * b0 * U0;
+
+    // Zmienne kolumny z wektora strumieni: domieszka powietrza zmienia pojemnosc
+    // cieplna i stala gazowa, piroklasty nie sa porywane
+    auto derive = [&](const PlumeState& s, const AtmosphereSample& a,
+        double& U, double& b, double& beta) {
+        U = s.M / s.Q;
+        double C = kAirHeatCapacity + (C0 - kAirHeatCapacity) * Q0 / s.Q;
+        double T = s.E / (s.Q * C);
+        double solids = n0 * Q0 / s.Q;
+        double gasMass = s.Q - n0 * Q0;
+        double Rg = kAirGasConstant + (kVapourGasConstant - kAirGasConstant) *
+            (source_.gasFraction * Q0) / max(gasMass, 1e-12);
+        double rhoGas = a.pressure / (Rg * T);
+        beta = 1.0 / ((1.0 - solids) / rhoGas + solids / source_.magmaDensity);
+        b = sqrt(s.Q / (beta * U));
+    };
+
+    auto rhs = [&](const PlumeState& s, double z, PlumeState& d) {
+        AtmosphereSample a = weather.atmosphereAt(z);
+        double U, b, beta;
+        derive(s, a, U, b, beta);
+        double Va = sqrt((double)a.wind_u * a.wind_u + (double)a.wind_v * a.wind_v);
+        double Ta = a.temperature + 273.15;
+        d.Q = 2.0 * a.density * b * (ks * U + kw * Va);
+        d.M = g * (a.density - beta) * b * b;
+        d.E = kAirHeatCapacity * Ta * d.Q - g * s.Q;
+    };
+
+    w_.clear();
+    b_.clear();
+    axisX_.clear();
+    axisY_.clear();
+    collapsed_ = false;
+    neutralHeight_ = source_.z;
+
+    // RK2 (punkt srodkowy) z krokiem 1 m; do tablicy co tableStep
+    const double h = 1.0;
+    PlumeState s{ Q0, Q0 * U0, Q0 * C0 * source_.temperature };
+    double z = source_.z;
+    double ax = 0.0, ay = 0.0;
+    bool buoyant = false;
+    double nextSample = source_.z;
+    const double maxHeight = 60000.0;
+
+    while (z < source_.z + maxHeight) {
+        AtmosphereSample a = weather.atmosphereAt(z);
+        double U, b, beta;
+        derive(s, a, U, b, beta);
+
+        if (z >= nextSample) {
+            w_.push_back((float)U);
+            b_.push_back((float)b);
+            axisX_.push_back((float)ax);
+            axisY_.push_back((float)ay);
+            nextSample += tableStep;
+        }
+
+        if (beta < a.density) buoyant = true;
+        else if (buoyant && neutralHeight_ == source_.z) neutralHeight_ = z;
+
+        PlumeState k1, k2, mid;
+        rhs(s, z, k1);
+        mid = PlumeState{ s.Q + 0.5 * h * k1.Q, s.M + 0.5 * h * k1.M, s.E + 0.5 * h * k1.E };
+        if (mid.M <= 0.0) break;
+        rhs(mid, z + 0.5 * h, k2);
+        PlumeState next{ s.Q + h * k2.Q, s.M + h * k2.M, s.E + h * k2.E };
+        if (next.M <= 0.0) break;
+
+        // Os kolumny dryfuje z wiatrem: przesuniecie poziome na metr wznoszenia = V_a / U
+        ax += a.wind_u / U * h;
+        ay += a.wind_v / U * h;
+        s = next;
+        z += h;
+    }
+
+    columnTop_ = z;
+    if (!buoyant) {
+        // Strumien nie osiagnal wypornosci: kolumna zapada sie (przeplyw piroklastyczny)
+        collapsed_ = true;
+        neutralHeight_ = z;
+    }
+    else if (neutralHeight_ == source_.z) {
+        neutralHeight_ = z;
+    }
+
+    dirty_ = false;
+    solvedVersion_ = weather.tableVersion();
+    cout << "PlumeModel: wysokosc kolumny " << columnTop_ - source_.z << " m nad kraterem"
+        << ", poziom neutralny " << neutralHeight_ - source_.z << " m"
+        << (collapsed_ ? " (kolumna zapada sie)" : "") << "\n";
+}
+
+bool PlumeModel::sample(double x, double y, double z, double& w) const {
+    if (w_.empty()) return false;
+    double fk = (z - source_.z) / tableStep;
+    if (fk < 0.0 || fk > (double)(w_.size() - 1)) return false;
+
+    size_t k = min((size_t)fk, w_.size() - 1);
+    size_t k1 = min(k + 1, w_.size() - 1);
+    double t = fk - (double)k;
+    double U = w_[k] + t * (w_[k1] - w_[k]);
+    double b = b_[k] + t * (b_[k1] - b_[k]);
+    double cx = source_.x + axisX_[k] + t * (axisX_[k1] - axisX_[k]);
+    double cy = source_.y + axisY_[k] + t * (axisY_[k1] - axisY_[k]);
+
+    double dx = x - cx;
+    double dy = y - cy;
+    double r2 = (dx * dx + dy * dy) / (b * b);
+    if (r2 > 4.0) return false;
+
+    // Gauss 2U exp(-2 r^2 / b^2) ma ten sam strumien objetosci co top-hat U na promieniu b
+    w = 2.0 * U * exp(-2.0 * r2);
+    return true;
+}
@@ -0,0 +1,125 @@
+#include "../include/scenario.h"
+#include "../include/deposit_map.h"
+#include "../include/particle_trails.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+using namespace std;
+
+Scenario::LoadTasks Scenario::addLoadTasks(StartupTasks& tasks, Weather& weather, const string& weatherCSV,
+    DEMLoader& dem, const string& heightPath, TerrainWind& terrainWind) {
+    LoadTasks ids;
+    ids.weather = tasks.add("Profil pogody", [&weather, weatherCSV]() {
+        return weather.loadWeatherProfile(weatherCSV);
+    });
+    ids.height = tasks.add("Wysokosci DEM", [&dem, heightPath]() {
+        int demW = 0, demH = 0;
+        bool demStreaming = DEMLoader::rasterSize(heightPath, demW, demH) &&
+            (long long)demW * demH > demStreamingThreshold;
+        return demStreaming ? dem.openStreaming(heightPath) : dem.loadHeight(heightPath);
+    });
+    ids.wind = tasks.add("Siatka oplywu", [&dem, &terrainWind]() {
+        return dem.isLoaded() && terrainWind.build(dem);
+    }, { ids.height });
+    return ids;
+}
+
+Weather Scenario::defaultWeather() {
+    return Weather(0, 2.0, 1.0, 15.0, 101300, 50, 0.1);
+}
+
+Scenario::Scenario(DEMLoader& dem, Weather& weather)
+    : dem_(dem), weather_(weather), emitted_(0), landedWeight_(0.0), overflowWeight_(0.0) {
+    const double* gt = dem.geoTransform();
+    minX = gt[0];
+    maxY = gt[3];
+    maxX = gt[0] + dem.width() * gt[1];
+    minY = gt[3] + dem.height() * gt[5];
+    craterX = (minX + maxX) * 0.5;
+    craterY = (minY + maxY) * 0.5;
+
+    // Zakres wysokosci ze szczytu piramidy DEM - bez skanowania calego rastra
+    auto range = dem.getHeightRange();
+    minElev = range.first;
+    maxElev = range.second;
+    craterZ = dem.getGroundZ(craterX, craterY);
+    if (isnan(craterZ)) craterZ = (minElev + maxElev) * 0.5;
+
+    weather_.updateForAltitude(craterZ);
+}
+
+void Scenario::start(const EruptionParams& params, Cloud& cloud, PlumeModel& plume, BallisticTable& ballistics) {
+    params_ = params;
+    if (params_.particleCount == 0) params_.particleCount = rand() % 1000 + 2000;
+    emitted_ = 0;
+    landedWeight_ = overflowWeight_ = 0.0;
+
+    weather_.turbulence = params_.turbulence;
+    weather_.wind_u = params_.windSpeed * 0.8;
+    weather_.wind_v = params_.windSpeed * 0.6;
+    weather_.bakeAltitudeTable();
+
+    // Kolumna erupcyjna rozwiazywana przy zmianie zrodla lub klatki pogody
+    PlumeModel::Source vent;
+    vent.x = craterX;
+    vent.y = craterY;
+    vent.z = craterZ;
+    vent.radius = params_.craterRadius;
+    vent.velocity = 0.5 * (params_.minSpeed + params_.maxSpeed);
+    plume.setSource(vent);
+    cloud.setPlume(&plume);
+
+    // Start bomb 20 m nad kraterem (jak w generateParticles), lot do najnizszego punktu DEM
+    double launchZ = craterZ + 20.0;
+    if (ballistics.build(cloud.grainSizes, weather_, launchZ, launchZ - minElev + 100.0)) {
+        cloud.setBallisticTable(&ballistics);
+    }
+}
+
+void Scenario::step(Cloud& cloud, const FrameBudget& budget, double dt,
+    ParticleTrails* trails, DepositMap* deposit) {
+    // Emisja na krok symulacji, wiec jej tempo w czasie symulacji nie zalezy
+    // od liczby krokow na klatke; emitted_ liczy czastki rzeczywiste
+    int particlesPerStep = rand() % 30 + 10;
+    int particlesToAdd = min(particlesPerStep, params_.particleCount - emitted_);
+    if (particlesToAdd > 0) {
+        double weight;
+        int superParticles = budget.emitCount(particlesToAdd, cloud.particles.size(), weight);
+        cloud.generateParticles(superParticles, craterX, craterY, craterZ,
+            params_.craterRadius, params_.minSpeed, params_.maxSpeed, rand() % 10, weight);
+        emitted_ += particlesToAdd;
+    }
+
+    size_t landedBefore = particlesOnEarth.size();
+    size_t overflowBefore = particlesOverflow.size();
+    cloud.update(dt, weather_.CalculateAirDensity(), params_.windSpeed * 0.8, params_.windSpeed * 0.6,
+        particlesOnEarth, particlesOverflow, dem_, 0.0, params_.turbulence * 0.5);
+    // Kafle DEM wczytane w kroku zawezaja piramide (tryb strumieniowy)
+    dem_.updatePyramid();
+    if (trails) trails->record(cloud.particles, dt);
+
+    // Wczesniej opadle czastki juz sprawdzone - tylko nowe z tego kroku
+    for (auto it = particlesOnEarth.begin() + landedBefore; it != particlesOnEarth.end();) {
+        bool out = (it->position_x < minX || it->position_x > maxX ||
+            it->position_y < minY || it->position_y > maxY);
+        double gz = dem_.getGroundZ(it->position_x, it->position_y);
+        if (out || isnan(gz)) {
+            particlesOverflow.push_back(*it);
+            it = particlesOnEarth.erase(it);
+        }
+        else {
+            it->position_z = gz;
+            if (deposit) deposit->add(*it);
+            ++it;
+        }
+    }
+    for (size_t i = landedBefore; i < particlesOnEarth.size(); i++) landedWeight_ += particlesOnEarth[i].weight;
+    for (size_t i = overflowBefore; i < particlesOverflow.size(); i++) overflowWeight_ += particlesOverflow[i].weight;
+}
+
+double Scenario::airborneParticles(const Cloud& cloud) {
+    double sum = 0.0;
+    for (const auto& p : cloud.particles) sum += p.weight;
+    return sum;
+}
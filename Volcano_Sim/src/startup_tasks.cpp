@@ -0,0 +1,70 @@
+#include "../include/startup_tasks.h"
+#include <chrono>
+
+using namespace std;
+
+StartupTasks::~StartupTasks() {
+    wait();
+}
+
+int StartupTasks::add(const string& name, function<bool()> job, vector<int> after) {
+    Task t;
+    t.name = name;
+    t.job = move(job);
+    t.after = move(after);
+    tasks_.push_back(move(t));
+    return (int)tasks_.size() - 1;
+}
+
+void StartupTasks::poll() {
+    for (auto& t : tasks_) {
+        if (t.state != State::Running) continue;
+        if (t.result.wait_for(chrono::seconds(0)) != future_status::ready) continue;
+        t.state = t.result.get() ? State::Done : State::Failed;
+    }
+
+    for (auto& t : tasks_) {
+        if (t.state != State::Waiting) continue;
+        bool ready = true;
+        for (int p : t.after) {
+            State s = tasks_[p].state;
+            if (s == State::Waiting || s == State::Running) { ready = false; break; }
+        }
+        if (!ready) continue;
+
+        // Czas mierzony na watku zadania, bez opoznienia petli okna
+        Task* task = &t;
+        t.state = State::Running;
+        t.result = async(launch::async, [task]() {
+            auto start = chrono::steady_clock::now();
+            bool ok = task->job();
+            task->seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            return ok;
+        });
+    }
+}
+
+void StartupTasks::wait() {
+    while (!finished()) {
+        poll();
+        for (auto& t : tasks_) {
+            if (t.state == State::Running) t.result.wait();
+        }
+    }
+}
+
+bool StartupTasks::finished() const {
+    for (const auto& t : tasks_) {
+        if (t.state == State::Waiting || t.state == State::Running) return false;
+    }
+    return true;
+}
+
+float StartupTasks::progress() const {
+    if (tasks_.empty()) return 1.0f;
+    int done = 0;
+    for (const auto& t : tasks_) {
+        if (t.state == State::Done || t.state == State::Failed) done++;
+    }
+    return (float)done / (float)tasks_.size();
+}
@@ -0,0 +1,449 @@
+#include "../include/terrain_renderer.h"
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <glm/gtc/matrix_transform.hpp>
+
+using namespace std;
+
+namespace {
+
+// Oswietlenie jak w potoku stalym: otoczenie 0.25, rozproszenie 0.9
+const char* kTerrainVertex = R"(
+#version 120
+attribute vec3 position;    // x, y, surowa wysokosc
+attribute vec2 gradient;    // dz/dx, dz/dy terenu
+uniform float zScale;
+uniform float baseZ;
+uniform vec4 texMap;
+uniform vec3 lightPos;
+uniform vec4 depositTexMap;
+varying vec2 uv;
+varying vec2 depositUV;
+varying vec3 normal;
+varying vec3 toLight;
+void main() {
+    vec3 p = vec3(position.xy, (position.z - baseZ) * zScale);
+    normal = vec3(-gradient * zScale, 1.0);
+    toLight = lightPos - p;
+    uv = vec2((position.x - texMap.x) * texMap.z, 1.0 - (position.y - texMap.y) * texMap.w);
+    depositUV = (position.xy - depositTexMap.xy) * depositTexMap.zw;
+    gl_Position = gl_ModelViewProjectionMatrix * vec4(p, 1.0);
+}
+)";
+
+const char* kTerrainFragment = R"(
+#version 120
+uniform sampler2D colorMap;
+uniform sampler2D depositMap;
+uniform float depositScale;     // 1 / maksymalne obciazenie; 0 = bez nakladki
+varying vec2 uv;
+varying vec2 depositUV;
+varying vec3 normal;
+varying vec3 toLight;
+vec3 depositRamp(float t) {
+    vec3 low = vec3(0.15, 0.35, 0.95);
+    vec3 mid = vec3(1.0, 0.85, 0.1);
+    vec3 high = vec3(0.8, 0.05, 0.05);
+    return t < 0.5 ? mix(low, mid, t * 2.0) : mix(mid, high, t * 2.0 - 1.0);
+}
+void main() {
+    float diffuse = max(dot(normalize(normal), normalize(toLight)), 0.0);
+    vec4 c = texture2D(colorMap, uv);
+    if (depositScale > 0.0) {
+        // Skala logarytmiczna: widac zarowno cienki popiol, jak i okolice krateru
+        float load = texture2D(depositMap, depositUV).r * depositScale;
+        float t = clamp(log(1.0 + 1000.0 * load) / log(1001.0), 0.0, 1.0);
+        float alpha = smoothstep(0.0, 0.05, t) * (0.4 + 0.5 * t);
+        c.rgb = mix(c.rgb, depositRamp(t), alpha);
+    }
+    gl_FragColor = vec4(c.rgb * (0.25 + 0.9 * diffuse), c.a);
+}
+)";
+
+struct TerrainVertex {
+    float x, y, z;
+    float gx, gy;
+};
+
+// Pasek trojkatow dolaczany do bufora przez dwa wierzcholki zdegenerowane
+void appendStrip(vector<GLuint>& out, const vector<GLuint>& strip) {
+    if (strip.empty()) return;
+    if (!out.empty()) {
+        out.push_back(out.back());
+        out.push_back(strip.front());
+    }
+    out.insert(out.end(), strip.begin(), strip.end());
+}
+
+} // namespace
+
+TerrainRenderer::TerrainRenderer()
+    : dem_(nullptr), nx_(0), ny_(0), tileCells_(0), minX_(0.0), minY_(0.0), px_(1.0), py_(1.0),
+    minElev_(0.0f), indexBuffer_{}, indexCount_{}, vertexCount_{}, residentVertices_(0), frame_(0), pyramidRevision_(0),
+    drawnChunks_(0), drawnVertices_(0),
+    deposit_(nullptr),
+    program_(0), locZScale_(-1), locBaseZ_(-1), locTexMap_(-1), locLight_(-1), locColorMap_(-1),
+    locDepositMap_(-1), locDepositTexMap_(-1), locDepositScale_(-1),
+    texMap_{ 0.0f, 0.0f, 1.0f, 1.0f } {
+}
+
+TerrainRenderer::~TerrainRenderer() {
+    release();
+}
+
+void TerrainRenderer::release() {
+    if (gl::isLoaded()) {
+        for (auto& c : chunks_) {
+            for (int k = 0; k < levels; k++) {
+                if (c.buffer[k]) gl::DeleteBuffers(1, &c.buffer[k]);
+            }
+        }
+        for (int k = 0; k < levels; k++) {
+            if (indexBuffer_[k]) gl::DeleteBuffers(1, &indexBuffer_[k]);
+            indexBuffer_[k] = 0;
+        }
+        if (program_) gl::DeleteProgram(program_);
+    }
+    chunks_.clear();
+    program_ = 0;
+    residentVertices_ = 0;
+}
+
+float TerrainRenderer::nodeHeight(int i, int j) const {
+    // Wezly w punktach rastra od (minX, minY), jak przy rysowaniu glBegin;
+    // poza rastrem powtarzany jest brzeg
+    i = min(max(i, 0), nx_ - 1);
+    j = min(max(j, 0), ny_ - 1);
+    double z = dem_->getGroundZ(minX_ + i * px_, minY_ + j * py_);
+    return (float)(isnan(z) ? minElev_ : z);
+}
+
+bool TerrainRenderer::build(const DEMLoader& dem, int tileCells) {
+    if (!gl::isLoaded() || !dem.isLoaded()) return false;
+    release();
+
+    const char* attributes[] = { "position", "gradient", nullptr };
+    program_ = gl::buildProgram("TerrainRenderer", kTerrainVertex, kTerrainFragment, attributes);
+    if (!program_) return false;
+    locZScale_ = gl::GetUniformLocation(program_, "zScale");
+    locBaseZ_ = gl::GetUniformLocation(program_, "baseZ");
+    locTexMap_ = gl::GetUniformLocation(program_, "texMap");
+    locLight_ = gl::GetUniformLocation(program_, "lightPos");
+    locColorMap_ = gl::GetUniformLocation(program_, "colorMap");
+    locDepositMap_ = gl::GetUniformLocation(program_, "depositMap");
+    locDepositTexMap_ = gl::GetUniformLocation(program_, "depositTexMap");
+    locDepositScale_ = gl::GetUniformLocation(program_, "depositScale");
+
+    dem_ = &dem;
+    pyramidRevision_ = dem.pyramidRevision();
+    nx_ = dem.width();
+    ny_ = dem.height();
+    const double* gt = dem.geoTransform();
+    px_ = gt[1];
+    py_ = fabs(gt[5]);
+    minX_ = gt[0];
+    minY_ = gt[3] + ny_ * gt[5];
+    minElev_ = (float)dem.getHeightRange().first;
+    tileCells_ = max(tileCells, 1 << (levels - 1));
+
+    // Wspolne bufory indeksow: siatka poziomu k ma n = tileCells / 2^k + 1 wezlow
+    // na bok, za nia 4 x n wierzcholkow fartucha (dol, gora, lewo, prawo)
+    for (int k = 0; k < levels; k++) {
+        int n = (tileCells_ >> k) + 1;
+        auto grid = [n](int i, int j) { return (GLuint)(j * n + i); };
+        auto skirt = [n](int edge, int t) { return (GLuint)(n * n + edge * n + t); };
+
+        vector<GLuint> indices;
+        vector<GLuint> strip;
+        for (int j = 0; j + 1 < n; j++) {
+            strip.clear();
+            for (int i = 0; i < n; i++) {
+                strip.push_back(grid(i, j));
+                strip.push_back(grid(i, j + 1));
+            }
+            appendStrip(indices, strip);
+        }
+        for (int edge = 0; edge < 4; edge++) {
+            strip.clear();
+            for (int t = 0; t < n; t++) {
+                GLuint top = edge == 0 ? grid(t, 0) : edge == 1 ? grid(t, n - 1) :
+                    edge == 2 ? grid(0, t) : grid(n - 1, t);
+                strip.push_back(top);
+                strip.push_back(skirt(edge, t));
+            }
+            appendStrip(indices, strip);
+        }
+
+        gl::GenBuffers(1, &indexBuffer_[k]);
+        gl::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer_[k]);
+        gl::BufferData(GL_ELEMENT_ARRAY_BUFFER, (gl::SizeiPtr)(indices.size() * sizeof(GLuint)),
+            indices.data(), GL_STATIC_DRAW);
+        indexCount_[k] = (GLsizei)indices.size();
+        vertexCount_[k] = (GLsizei)(n * n + 4 * n);
+    }
+    gl::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    int tilesX = (nx_ - 1 + tileCells_ - 1) / tileCells_;
+    int tilesY = (ny_ - 1 + tileCells_ - 1) / tileCells_;
+    chunks_.resize((size_t)max(tilesX, 1) * max(tilesY, 1));
+    for (int ty = 0; ty < max(tilesY, 1); ty++) {
+        for (int tx = 0; tx < max(tilesX, 1); tx++) {
+            Chunk& c = chunks_[(size_t)ty * max(tilesX, 1) + tx];
+            c.i0 = tx * tileCells_;
+            c.j0 = ty * tileCells_;
+            c.minX = (float)(minX_ + c.i0 * px_);
+            c.minY = (float)(minY_ + c.j0 * py_);
+            c.maxX = (float)(minX_ + min(c.i0 + tileCells_, nx_ - 1) * px_);
+            c.maxY = (float)(minY_ + min(c.j0 + tileCells_, ny_ - 1) * py_);
+            for (int k = 0; k < levels; k++) {
+                c.buffer[k] = 0;
+                c.lastUsed[k] = 0;
+            }
+            estimateErrors(c);
+        }
+    }
+
+    // Wspolrzedne tekstury jak przy rysowaniu glBegin: u = x / (nx - 1)
+    texMap_[0] = (float)minX_;
+    texMap_[1] = (float)minY_;
+    texMap_[2] = (float)(1.0 / (max(nx_ - 1, 1) * px_));
+    texMap_[3] = (float)(1.0 / (max(ny_ - 1, 1) * py_));
+
+    cout << "TerrainRenderer: " << tilesX << " x " << tilesY << " kafli po " << tileCells_
+        << " px, " << levels << " poziomow LOD\n";
+    return true;
+}
+
+void TerrainRenderer::estimateErrors(Chunk& c) const {
+    // Bledy z piramidy min/max DEM: siatka poziomu k interpoluje wezly co 2^k px,
+    // wiec w bloku 2^k x 2^k nie odchodzi od terenu dalej niz rozrzut wysokosci
+    // bloku. Blad poziomu to polowa najwiekszego rozrzutu w kaflu; dla blokow
+    // mniejszych niz wezly piramidy rozrzut jest skalowany liniowo z rozmiarem.
+    // Poziom 0 jest dokladny.
+    c.minZ = numeric_limits<float>::max();
+    c.maxZ = -numeric_limits<float>::max();
+    for (int k = 0; k < levels; k++) c.error[k] = 0.0f;
+
+    int pyramidLevels = dem_->pyramidLevels();
+    if (pyramidLevels == 0) {
+        c.minZ = c.maxZ = minElev_;
+        for (int k = 1; k < levels; k++) c.error[k] = numeric_limits<float>::max();
+        c.skirt = 0.0f;
+        return;
+    }
+
+    // Piksele kafla; wezel siatki (i, j) od minY to wiersz rastra ny - 1 - j (raster od polnocy)
+    int x0 = c.i0, x1 = min(c.i0 + tileCells_, nx_ - 1);
+    int y0 = ny_ - 1 - min(c.j0 + tileCells_, ny_ - 1), y1 = ny_ - 1 - c.j0;
+    // Najwiekszy rozrzut min/max w wezlach poziomu piramidy pod kaflem
+    auto spread = [&](const DEMLoader::PyramidLevel& L, bool bounds) {
+        float s = 0.0f;
+        for (int nj = min(y0 / L.cell, L.ny - 1); nj <= min(y1 / L.cell, L.ny - 1); nj++) {
+            for (int ni = min(x0 / L.cell, L.nx - 1); ni <= min(x1 / L.cell, L.nx - 1); ni++) {
+                size_t idx = (size_t)nj * L.nx + ni;
+                if (L.minH[idx] > L.maxH[idx]) continue;
+                s = max(s, L.maxH[idx] - L.minH[idx]);
+                if (bounds) {
+                    c.minZ = min(c.minZ, L.minH[idx]);
+                    c.maxZ = max(c.maxZ, L.maxH[idx]);
+                }
+            }
+        }
+        return s;
+    };
+
+    const DEMLoader::PyramidLevel& base = dem_->pyramidLevel(0);
+    float baseSpread = spread(base, true);
+    if (c.minZ > c.maxZ) c.minZ = c.maxZ = minElev_;
+    // Wezly poza rastrem (brak danych) rysowane sa na minElev
+    c.minZ = min(c.minZ, minElev_);
+
+    int l = 0;
+    for (int k = 1; k < levels; k++) {
+        int s = 1 << k;
+        float err;
+        if (s < base.cell) {
+            err = 0.5f * baseSpread * (float)s / (float)base.cell;
+        }
+        else {
+            while (l + 1 < pyramidLevels && dem_->pyramidLevel(l).cell < s) l++;
+            err = 0.5f * spread(dem_->pyramidLevel(l), false);
+        }
+        c.error[k] = max(err, c.error[k - 1]);
+    }
+
+    // Szczelina miedzy sasiadami to co najwyzej suma ich bledow
+    c.skirt = 2.0f * c.error[levels - 1] + (float)max(px_, py_);
+}
+
+bool TerrainRenderer::buildLevel(Chunk& c, int level) {
+    int s = 1 << level;
+    int n = (tileCells_ >> level) + 1;
+
+    // Wysokosci z obwodka jednego wezla do gradientu
+    int m = n + 2;
+    vector<float> h((size_t)m * m);
+    for (int b = 0; b < m; b++)
+        for (int a = 0; a < m; a++)
+            h[(size_t)b * m + a] = nodeHeight(c.i0 + (a - 1) * s, c.j0 + (b - 1) * s);
+    auto H = [&](int a, int b) { return h[(size_t)(b + 1) * m + (a + 1)]; };
+
+    vector<TerrainVertex> vertices((size_t)vertexCount_[level]);
+    for (int b = 0; b < n; b++) {
+        for (int a = 0; a < n; a++) {
+            TerrainVertex& v = vertices[(size_t)b * n + a];
+            int i = min(c.i0 + a * s, nx_ - 1);
+            int j = min(c.j0 + b * s, ny_ - 1);
+            v.x = (float)(minX_ + i * px_);
+            v.y = (float)(minY_ + j * py_);
+            v.z = H(a, b);
+            v.gx = (float)((H(a + 1, b) - H(a - 1, b)) / (2.0 * s * px_));
+            v.gy = (float)((H(a, b + 1) - H(a, b - 1)) / (2.0 * s * py_));
+        }
+    }
+    for (int edge = 0; edge < 4; edge++) {
+        for (int t = 0; t < n; t++) {
+            int a = edge == 0 || edge == 1 ? t : edge == 2 ? 0 : n - 1;
+            int b = edge == 2 || edge == 3 ? t : edge == 0 ? 0 : n - 1;
+            TerrainVertex v = vertices[(size_t)b * n + a];
+            v.z -= c.skirt;
+            vertices[(size_t)n * n + edge * n + t] = v;
+        }
+    }
+
+    gl::GenBuffers(1, &c.buffer[level]);
+    gl::BindBuffer(GL_ARRAY_BUFFER, c.buffer[level]);
+    gl::BufferData(GL_ARRAY_BUFFER, (gl::SizeiPtr)(vertices.size() * sizeof(TerrainVertex)),
+        vertices.data(), GL_STATIC_DRAW);
+    residentVertices_ += vertices.size();
+    return true;
+}
+
+void TerrainRenderer::evict() {
+    if (residentVertices_ <= maxResidentVertices) return;
+
+    // Najdawniej uzywane bufory spoza biezacej klatki
+    vector<pair<unsigned, pair<size_t, int>>> resident;
+    for (size_t i = 0; i < chunks_.size(); i++) {
+        for (int k = 0; k < levels; k++) {
+            if (chunks_[i].buffer[k] && chunks_[i].lastUsed[k] != frame_)
+                resident.push_back({ chunks_[i].lastUsed[k], { i, k } });
+        }
+    }
+    sort(resident.begin(), resident.end());
+    for (const auto& r : resident) {
+        if (residentVertices_ <= maxResidentVertices) break;
+        Chunk& c = chunks_[r.second.first];
+        int k = r.second.second;
+        gl::DeleteBuffers(1, &c.buffer[k]);
+        c.buffer[k] = 0;
+        residentVertices_ -= (size_t)vertexCount_[k];
+    }
+}
+
+void TerrainRenderer::draw(const glm::mat4& proj, const glm::mat4& view, int viewportHeight,
+    GLuint colorTexture, float zScale, float baseZ, const float lightPos[3]) {
+    if (!isBuilt()) return;
+    frame_++;
+    // DEM strumieniowy zaweza piramide w miare wczytywania kafli - bledy
+    // kafli liczone sa wtedy od nowa (nie czesciej niz co 30 klatek)
+    if (dem_->pyramidRevision() != pyramidRevision_ && frame_ % 30 == 0) {
+        pyramidRevision_ = dem_->pyramidRevision();
+        for (Chunk& c : chunks_) estimateErrors(c);
+    }
+    drawnChunks_ = 0;
+    drawnVertices_ = 0;
+
+    // Plaszczyzny piramidy widzenia z macierzy proj * view (Gribb, Hartmann)
+    glm::mat4 m = proj * view;
+    glm::vec4 row[4];
+    for (int r = 0; r < 4; r++) row[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+    glm::vec4 planes[6] = { row[3] + row[0], row[3] - row[0], row[3] + row[1],
+        row[3] - row[1], row[3] + row[2], row[3] - row[2] };
+    glm::vec3 eye = glm::vec3(glm::inverse(view)[3]);
+    // Metry na piksel w odleglosci d: d / K
+    double K = 0.5 * viewportHeight * proj[1][1];
+
+    gl::UseProgram(program_);
+    gl::Uniform1f(locZScale_, zScale);
+    gl::Uniform1f(locBaseZ_, baseZ);
+    gl::Uniform4f(locTexMap_, texMap_[0], texMap_[1], texMap_[2], texMap_[3]);
+    gl::Uniform3f(locLight_, lightPos[0], lightPos[1], lightPos[2]);
+    gl::Uniform1i(locColorMap_, 0);
+    bool overlay = deposit_ != nullptr && deposit_->isBuilt() && deposit_->maxLoad() > 0.0;
+    gl::Uniform1f(locDepositScale_, overlay ? (float)(1.0 / deposit_->maxLoad()) : 0.0f);
+    if (overlay) {
+        const float* dm = deposit_->texMap();
+        gl::Uniform4f(locDepositTexMap_, dm[0], dm[1], dm[2], dm[3]);
+        gl::Uniform1i(locDepositMap_, 1);
+        gl::ActiveTexture(GL_TEXTURE0 + 1);
+        glBindTexture(GL_TEXTURE_2D, deposit_->texture());
+    }
+    gl::ActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, colorTexture);
+    gl::EnableVertexAttribArray(0);
+    gl::EnableVertexAttribArray(1);
+
+    int builds = 0;
+    for (auto& c : chunks_) {
+        glm::vec3 lo(c.minX, c.minY, (c.minZ - c.skirt - baseZ) * zScale);
+        glm::vec3 hi(c.maxX, c.maxY, (c.maxZ - baseZ) * zScale);
+
+        bool visible = true;
+        for (const auto& p : planes) {
+            glm::vec3 pv(p.x >= 0 ? hi.x : lo.x, p.y >= 0 ? hi.y : lo.y, p.z >= 0 ? hi.z : lo.z);
+            if (p.x * pv.x + p.y * pv.y + p.z * pv.z + p.w < 0.0f) { visible = false; break; }
+        }
+        if (!visible) continue;
+
+        glm::vec3 nearest = glm::clamp(eye, lo, hi);
+        double d = max((double)glm::length(eye - nearest), 1.0);
+        int level = 0;
+        for (int k = levels - 1; k > 0; k--) {
+            if (c.error[k] * zScale * K / d <= pixelTolerance) { level = k; break; }
+        }
+
+        // Brak bufora i wyczerpany limit na klatke: najblizszy grubszy gotowy poziom
+        if (!c.buffer[level]) {
+            if (builds < maxBuildsPerFrame) {
+                buildLevel(c, level);
+                builds++;
+            }
+            else {
+                int k = level + 1;
+                while (k < levels && !c.buffer[k]) k++;
+                if (k == levels) {
+                    k = levels - 1;
+                    buildLevel(c, k);
+                }
+                level = k;
+            }
+        }
+        c.lastUsed[level] = frame_;
+
+        gl::BindBuffer(GL_ARRAY_BUFFER, c.buffer[level]);
+        gl::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer_[level]);
+        gl::VertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex), (const void*)0);
+        gl::VertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex), (const void*)(3 * sizeof(float)));
+        glDrawElements(GL_TRIANGLE_STRIP, indexCount_[level], GL_UNSIGNED_INT, (const void*)0);
+        drawnChunks_++;
+        drawnVertices_ += (size_t)vertexCount_[level];
+    }
+
+    // Stan jak przed rysowaniem: reszta sceny rysowana jest w potoku stalym
+    gl::DisableVertexAttribArray(0);
+    gl::DisableVertexAttribArray(1);
+    gl::BindBuffer(GL_ARRAY_BUFFER, 0);
+    gl::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    if (overlay) {
+        gl::ActiveTexture(GL_TEXTURE0 + 1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        gl::ActiveTexture(GL_TEXTURE0);
+    }
+    gl::UseProgram(0);
+
+    evict();
+}
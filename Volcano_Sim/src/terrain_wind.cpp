@@ -0,0 +1,330 @@
+#include "../include/terrain_wind.h"
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+namespace {
+
+// Bariera dla stalej grupy watkow (kolory SOR musza sie przeplatac)
+class Barrier {
+public:
+    explicit Barrier(int count) : count_(count), waiting_(0), generation_(0) {}
+
+    void wait() {
+        unique_lock<mutex> lk(mutex_);
+        unsigned gen = generation_;
+        if (++waiting_ == count_) {
+            waiting_ = 0;
+            generation_++;
+            cv_.notify_all();
+            return;
+        }
+        cv_.wait(lk, [&] { return gen != generation_; });
+    }
+
+private:
+    mutex mutex_;
+    condition_variable cv_;
+    int count_;
+    int waiting_;
+    unsigned generation_;
+};
+
+enum : uint8_t {
+    OpenWest = 1, OpenEast = 2, OpenSouth = 4, OpenNorth = 8, OpenDown = 16, OpenUp = 32
+};
+
+} // namespace
+
+TerrainWind::TerrainWind()
+    : nx_(0), ny_(0), nz_(0), x0_(0), y0_(0), z0_(0), dx_(1), dy_(1), dz_(1),
+    solvedVersion_(0) {
+}
+
+bool TerrainWind::build(const DEMLoader& dem, int maxCellsXY, double dz, double heightAboveTerrain) {
+    nx_ = ny_ = nz_ = 0;
+    if (!dem.isLoaded() || maxCellsXY < 4 || dz <= 0.0) return false;
+
+    auto range = dem.getHeightRange();
+    if (std::isnan(range.first) || std::isnan(range.second)) return false;
+
+    const double* gt = dem.geoTransform();
+    double minX = gt[0];
+    double maxX = gt[0] + dem.width() * gt[1];
+    double maxY = gt[3];
+    double minY = gt[3] + dem.height() * gt[5];
+    if (minX > maxX) swap(minX, maxX);
+    if (minY > maxY) swap(minY, maxY);
+
+    double cell = max(maxX - minX, maxY - minY) / maxCellsXY;
+    int nx = max(4, (int)ceil((maxX - minX) / cell));
+    int ny = max(4, (int)ceil((maxY - minY) / cell));
+    int nz = max(4, (int)ceil((range.second - range.first + heightAboveTerrain) / dz));
+
+    x0_ = minX;
+    y0_ = minY;
+    z0_ = range.first;
+    dx_ = (maxX - minX) / nx;
+    dy_ = (maxY - minY) / ny;
+    dz_ = dz;
+
+    // Wysokosc terenu w kolumnie: srednia z 3x3 probek w obrebie komorki
+    vector<double> ground((size_t)nx * ny);
+    for (int j = 0; j < ny; j++) {
+        for (int i = 0; i < nx; i++) {
+            double sum = 0.0;
+            int n = 0;
+            for (int sj = 0; sj < 3; sj++) {
+                for (int si = 0; si < 3; si++) {
+                    double h = dem.getGroundZ(x0_ + (i + (si + 0.5) / 3.0) * dx_,
+                        y0_ + (j + (sj + 0.5) / 3.0) * dy_);
+                    if (std::isnan(h)) continue;
+                    sum += h;
+                    n++;
+                }
+            }
+            ground[(size_t)j * nx + i] = n > 0 ? sum / n : z0_;
+        }
+    }
+
+    nx_ = nx;
+    ny_ = ny;
+    nz_ = nz;
+    size_t cells = (size_t)nx * ny * nz;
+    solid_.assign(cells, 0);
+    for (int k = 0; k < nz; k++) {
+        double zc = z0_ + (k + 0.5) * dz_;
+        for (int j = 0; j < ny; j++) {
+            for (int i = 0; i < nx; i++) {
+                solid_[index(i, j, k)] = zc < ground[(size_t)j * nx + i] ? 1 : 0;
+            }
+        }
+    }
+
+    // Sasiedzi bedacy komorkami plynu; teren i dno siatki sa nieprzepuszczalne
+    open_.assign(cells, 0);
+    for (int k = 0; k < nz; k++) {
+        for (int j = 0; j < ny; j++) {
+            for (int i = 0; i < nx; i++) {
+                size_t c = index(i, j, k);
+                if (solid_[c]) continue;
+                uint8_t m = 0;
+                if (i > 0 && !solid_[c - 1]) m |= OpenWest;
+                if (i < nx - 1 && !solid_[c + 1]) m |= OpenEast;
+                if (j > 0 && !solid_[c - nx]) m |= OpenSouth;
+                if (j < ny - 1 && !solid_[c + nx]) m |= OpenNorth;
+                if (k > 0 && !solid_[c - (size_t)nx * ny]) m |= OpenDown;
+                if (k < nz - 1 && !solid_[c + (size_t)nx * ny]) m |= OpenUp;
+                open_[c] = m;
+            }
+        }
+    }
+
+    diagInv_.assign(cells, 0.0);
+    phi_.assign(cells, 0.0);
+    rhs_.assign(cells, 0.0);
+    du_.assign(cells, 0.0f);
+    dv_.assign(cells, 0.0f);
+    dw_.assign(cells, 0.0f);
+    solvedVersion_ = 0;
+
+    cout << "TerrainWind: siatka " << nx_ << " x " << ny_ << " x " << nz_
+        << ", komorka " << dx_ << " x " << dy_ << " x " << dz_ << " m\n";
+    return true;
+}
+
+bool TerrainWind::update(const Weather& weather) {
+    if (!isBuilt()) return false;
+    if (solvedVersion_ == weather.tableVersion()) return false;
+    solve(weather);
+    return true;
+}
+
+void TerrainWind::sweep(int k0, int k1, int colour, double& maxResidual) {
+    const size_t layer = (size_t)nx_ * ny_;
+    const double cx = 1.0 / (dx_ * dx_);
+    const double cy = 1.0 / (dy_ * dy_);
+    const double cz = stability / (dz_ * dz_);
+
+    for (int k = k0; k < k1; k++) {
+        for (int j = 0; j < ny_; j++) {
+            size_t row = index(0, j, k);
+            for (int i = (colour + j + k) & 1; i < nx_; i += 2) {
+                size_t c = row + i;
+                uint8_t m = open_[c];
+                if (diagInv_[c] == 0.0) continue;
+                double sum = rhs_[c];
+                if (m & OpenWest) sum += cx * phi_[c - 1];
+                if (m & OpenEast) sum += cx * phi_[c + 1];
+                if (m & OpenSouth) sum += cy * phi_[c - nx_];
+                if (m & OpenNorth) sum += cy * phi_[c + nx_];
+                if (m & OpenDown) sum += cz * phi_[c - layer];
+                if (m & OpenUp) sum += cz * phi_[c + layer];
+                // Residuum rownania przed aktualizacja (sum - diag * phi)
+                double delta = sum * diagInv_[c] - phi_[c];
+                phi_[c] += omega * delta;
+                maxResidual = max(maxResidual, fabs(delta) / diagInv_[c]);
+            }
+        }
+    }
+}
+
+void TerrainWind::solve(const Weather& weather) {
+    if (!isBuilt()) return;
+
+    const size_t layer = (size_t)nx_ * ny_;
+
+    // Profil na srodkach warstw; w0 = 0
+    vector<double> u0(nz_), v0(nz_);
+    for (int k = 0; k < nz_; k++) {
+        AtmosphereSample a = weather.atmosphereAt(z0_ + (k + 0.5) * dz_);
+        u0[k] = a.wind_u;
+        v0[k] = a.wind_v;
+    }
+
+    // Dywergencja profilu: przy poziomo jednorodnym wietrze pochodzi tylko ze
+    // scian zablokowanych przez teren (tam strumien jest zerowy).
+    // Przekatna: brzegi boczne i gorny maja phi = 0 (przeplyw swobodny),
+    // wiec licza sie jak sasiad; scian z terenem nie ma w rownaniu.
+    const double cx = 1.0 / (dx_ * dx_);
+    const double cy = 1.0 / (dy_ * dy_);
+    const double cz = stability / (dz_ * dz_);
+    for (int k = 0; k < nz_; k++) {
+        for (int j = 0; j < ny_; j++) {
+            for (int i = 0; i < nx_; i++) {
+                size_t c = index(i, j, k);
+                if (solid_[c]) {
+                    rhs_[c] = 0.0;
+                    diagInv_[c] = 0.0;
+                    continue;
+                }
+                uint8_t m = open_[c];
+                double diag = 0.0;
+                if ((m & OpenWest) || i == 0) diag += cx;
+                if ((m & OpenEast) || i == nx_ - 1) diag += cx;
+                if ((m & OpenSouth) || j == 0) diag += cy;
+                if ((m & OpenNorth) || j == ny_ - 1) diag += cy;
+                if (m & OpenDown) diag += cz;
+                if ((m & OpenUp) || k == nz_ - 1) diag += cz;
+                diagInv_[c] = diag > 0.0 ? 1.0 / diag : 0.0;
+
+                double uW = (i > 0 && solid_[c - 1]) ? 0.0 : u0[k];
+                double uE = (i < nx_ - 1 && solid_[c + 1]) ? 0.0 : u0[k];
+                double vS = (j > 0 && solid_[c - nx_]) ? 0.0 : v0[k];
+                double vN = (j < ny_ - 1 && solid_[c + nx_]) ? 0.0 : v0[k];
+                rhs_[c] = (uE - uW) / dx_ + (vN - vS) / dy_;
+            }
+        }
+    }
+
+    double maxRhs = 0.0;
+    for (double r : rhs_) maxRhs = max(maxRhs, fabs(r));
+
+    // Poprzednie phi jest dobrym punktem startu: kolejne godziny roznia sie niewiele
+    int nThreads = (int)min<unsigned>(max(1u, thread::hardware_concurrency()), (unsigned)max(1, nz_ / 4));
+    vector<double> slotResidual(2 * nThreads, 0.0);
+    Barrier barrier(nThreads);
+    int iterations = 0;
+    double finalResidual = 0.0;
+    double stopResidual = tolerance * maxRhs;
+
+    auto worker = [&](int t) {
+        int k0 = nz_ * t / nThreads;
+        int k1 = nz_ * (t + 1) / nThreads;
+        for (int it = 0; it < maxIterations; it++) {
+            double residual = 0.0;
+            sweep(k0, k1, 0, residual);
+            barrier.wait();
+            sweep(k0, k1, 1, residual);
+            // Sloty parzystych i nieparzystych iteracji sa rozdzielone, wiec zapis
+            // w kolejnej iteracji nie koliduje z odczytem w tej
+            slotResidual[(it & 1) * nThreads + t] = residual;
+            barrier.wait();
+
+            double worst = 0.0;
+            for (int s = 0; s < nThreads; s++) worst = max(worst, slotResidual[(it & 1) * nThreads + s]);
+            if (worst <= stopResidual || it == maxIterations - 1) {
+                if (t == 0) {
+                    iterations = it + 1;
+                    finalResidual = worst;
+                }
+                return;
+            }
+        }
+    };
+
+    vector<thread> pool;
+    for (int t = 1; t < nThreads; t++) pool.emplace_back(worker, t);
+    worker(0);
+    for (auto& th : pool) th.join();
+
+    // Predkosci na scianach z gradientu phi, usrednione do srodkow komorek
+    const double T = stability;
+    for (int k = 0; k < nz_; k++) {
+        for (int j = 0; j < ny_; j++) {
+            for (int i = 0; i < nx_; i++) {
+                size_t c = index(i, j, k);
+                if (solid_[c]) {
+                    du_[c] = (float)-u0[k];
+                    dv_[c] = (float)-v0[k];
+                    dw_[c] = 0.0f;
+                    continue;
+                }
+                uint8_t m = open_[c];
+                double p = phi_[c];
+                // Poprawka na scianie: do sasiada plynu, do brzegu z phi = 0, przy terenie
+                // zeruje calkowity strumien
+                double uW = (m & OpenWest) ? u0[k] + (p - phi_[c - 1]) / dx_ : (i == 0 ? u0[k] + p / dx_ : 0.0);
+                double uE = (m & OpenEast) ? u0[k] + (phi_[c + 1] - p) / dx_ : (i == nx_ - 1 ? u0[k] - p / dx_ : 0.0);
+                double vS = (m & OpenSouth) ? v0[k] + (p - phi_[c - nx_]) / dy_ : (j == 0 ? v0[k] + p / dy_ : 0.0);
+                double vN = (m & OpenNorth) ? v0[k] + (phi_[c + nx_] - p) / dy_ : (j == ny_ - 1 ? v0[k] - p / dy_ : 0.0);
+                double wB = (m & OpenDown) ? T * (p - phi_[c - layer]) / dz_ : 0.0;
+                double wT = (m & OpenUp) ? T * (phi_[c + layer] - p) / dz_ : (k == nz_ - 1 ? -T * p / dz_ : 0.0);
+                du_[c] = (float)(0.5 * (uW + uE) - u0[k]);
+                dv_[c] = (float)(0.5 * (vS + vN) - v0[k]);
+                dw_[c] = (float)(0.5 * (wB + wT));
+            }
+        }
+    }
+
+    solvedVersion_ = weather.tableVersion();
+    cout << "TerrainWind: przeliczono pole wiatru (" << iterations << " iteracji, residuum "
+        << (maxRhs > 0.0 ? finalResidual / maxRhs : 0.0) << ")\n";
+}
+
+bool TerrainWind::sample(double x, double y, double z, double& du, double& dv, double& dw) const {
+    if (!isBuilt() || solvedVersion_ == 0) return false;
+
+    // Wartosci w srodkach komorek
+    double fi = (x - x0_) / dx_ - 0.5;
+    double fj = (y - y0_) / dy_ - 0.5;
+    double fk = (z - z0_) / dz_ - 0.5;
+    if (fi < -0.5 || fj < -0.5 || fk > nz_ - 0.5 || fi > nx_ - 0.5 || fj > ny_ - 0.5) return false;
+    fi = min(max(fi, 0.0), nx_ - 1.0);
+    fj = min(max(fj, 0.0), ny_ - 1.0);
+    fk = min(max(fk, 0.0), nz_ - 1.0);
+
+    int i = min((int)fi, nx_ - 2);
+    int j = min((int)fj, ny_ - 2);
+    int k = min((int)fk, nz_ - 2);
+    double tx = fi - i, ty = fj - j, tz = fk - k;
+
+    double acc[3] = { 0.0, 0.0, 0.0 };
+    for (int n = 0; n < 8; n++) {
+        int di = n & 1, dj = (n >> 1) & 1, dk = (n >> 2) & 1;
+        double wgt = (di ? tx : 1.0 - tx) * (dj ? ty : 1.0 - ty) * (dk ? tz : 1.0 - tz);
+        size_t c = index(i + di, j + dj, k + dk);
+        acc[0] += wgt * du_[c];
+        acc[1] += wgt * dv_[c];
+        acc[2] += wgt * dw_[c];
+    }
+    du = acc[0];
+    dv = acc[1];
+    dw = acc[2];
+    return true;
+}
@@ -0,0 +1,102 @@
+#include "../include/tile_cache.h"
+#include <iostream>
+
+using namespace std;
+
+TileCache::TileCache(size_t maxTiles, Loader loader)
+    : maxTiles_(maxTiles < 4 ? 4 : maxTiles), loader_(std::move(loader)) {
+    worker_ = thread(&TileCache::workerLoop, this);
+}
+
+TileCache::~TileCache() {
+    {
+        lock_guard<mutex> lk(mutex_);
+        stop_ = true;
+    }
+    pendingCv_.notify_all();
+    if (worker_.joinable()) worker_.join();
+}
+
+shared_ptr<const TileCache::Tile> TileCache::findLocked(uint64_t k) {
+    auto it = entries_.find(k);
+    if (it == entries_.end()) return nullptr;
+    lru_.splice(lru_.begin(), lru_, it->second.lruIt);
+    return it->second.tile;
+}
+
+void TileCache::insertLocked(uint64_t k, shared_ptr<const Tile> tile) {
+    lru_.push_front(k);
+    entries_[k] = Entry{ std::move(tile), lru_.begin() };
+
+    // Usuwanie najdawniej uzywanych kafli; kafle wciaz trzymane przez
+    // shared_ptr w innych watkach zyja do konca ich uzycia
+    while (entries_.size() > maxTiles_) {
+        uint64_t victim = lru_.back();
+        lru_.pop_back();
+        entries_.erase(victim);
+    }
+}
+
+shared_ptr<const TileCache::Tile> TileCache::get(int tx, int ty) {
+    uint64_t k = key(tx, ty);
+    {
+        lock_guard<mutex> lk(mutex_);
+        if (auto t = findLocked(k)) return t;
+    }
+
+    lock_guard<mutex> io(ioMutex_);
+    {
+        // Inny watek mogl wczytac kafel w czasie oczekiwania na ioMutex_
+        lock_guard<mutex> lk(mutex_);
+        if (auto t = findLocked(k)) return t;
+    }
+
+    auto tile = make_shared<Tile>();
+    if (!loader_(tx, ty, *tile)) {
+        cerr << "TileCache: blad odczytu kafla (" << tx << ", " << ty << ")\n";
+        return nullptr;
+    }
+
+    lock_guard<mutex> lk(mutex_);
+    insertLocked(k, tile);
+    return tile;
+}
+
+shared_ptr<const TileCache::Tile> TileCache::peek(int tx, int ty) {
+    lock_guard<mutex> lk(mutex_);
+    return findLocked(key(tx, ty));
+}
+
+void TileCache::request(int tx, int ty) {
+    uint64_t k = key(tx, ty);
+    {
+        lock_guard<mutex> lk(mutex_);
+        if (entries_.count(k) || pendingSet_.count(k)) return;
+        // Kolejka nie moze byc dluzsza niz polowa cache, inaczej prefetch
+        // wyrzucalby kafle, ktore sa jeszcze potrzebne
+        if (pending_.size() >= maxTiles_ / 2) return;
+        pending_.push_back(k);
+        pendingSet_.insert(k);
+    }
+    pendingCv_.notify_one();
+}
+
+size_t TileCache::size() const {
+    lock_guard<mutex> lk(mutex_);
+    return entries_.size();
+}
+
+void TileCache::workerLoop() {
+    for (;;) {
+        uint64_t k;
+        {
+            unique_lock<mutex> lk(mutex_);
+            pendingCv_.wait(lk, [this] { return stop_ || !pending_.empty(); });
+            if (stop_) return;
+            k = pending_.front();
+            pending_.pop_front();
+            pendingSet_.erase(k);
+        }
+        get((int)(uint32_t)(k & 0xFFFFFFFFu), (int)(uint32_t)(k >> 32));
+    }
+}
@@ -1,82 +1,458 @@
 #include "../include/weather.h"
-#include <fstream>
-#include <sstream>
+#include "../include/mapped_file.h"
 #include <iostream>
 #include <algorithm>
+#include <charconv>
+#include <cstring>
 #include <cmath>
 #include <cpl_port.h>
 using namespace std;
 
+namespace {
+
+const double kGasConstant = 287.05;     // [J/(kg K)]
+const double kGravity = 9.80665;        // [m/s2]
+const double kLapseRate = 0.0065;       // [K/m]
+
+struct Field {
+    const char* begin;
+    const char* end;
+};
+
+// Kolejna linia bufora bez kopiowania; pos przesuwa sie za znak nowej linii
+bool nextLine(const char*& pos, const char* end, Field& line) {
+    if (pos >= end) return false;
+    const char* nl = static_cast<const char*>(memchr(pos, '\n', (size_t)(end - pos)));
+    line.begin = pos;
+    line.end = nl ? nl : end;
+    pos = nl ? nl + 1 : end;
+    if (line.end > line.begin && line.end[-1] == '\r') line.end--;
+    return true;
+}
+
+// Podzial linii na pola; wektor jest uzywany ponownie, wiec po pierwszym
+// wierszu nie ma juz alokacji
+void splitFields(const Field& line, vector<Field>& out) {
+    out.clear();
+    const char* b = line.begin;
+    for (const char* c = line.begin; c < line.end; c++) {
+        if (*c == ',') {
+            out.push_back(Field{ b, c });
+            b = c + 1;
+        }
+    }
+    out.push_back(Field{ b, line.end });
+}
+
+Field trimmed(Field f) {
+    while (f.begin < f.end && (*f.begin == ' ' || *f.begin == '"')) f.begin++;
+    while (f.end > f.begin && (f.end[-1] == ' ' || f.end[-1] == '"')) f.end--;
+    return f;
+}
+
+bool isBlank(const Field& line) {
+    Field f = trimmed(line);
+    return f.begin == f.end;
+}
+
+double parseNumber(Field f) {
+    f = trimmed(f);
+    if (f.begin < f.end && *f.begin == '+') f.begin++;
+    double v;
+    auto r = from_chars(f.begin, f.end, v);
+    if (f.begin == f.end || r.ec != errc()) return NAN;
+    return v;
+}
+
+int parseInt(const char* b, const char* e) {
+    int v = 0;
+    from_chars(b, e, v);
+    return v;
+}
+
+// Liczba dni od 1970-01-01 w kalendarzu gregorianskim
+long long daysFromCivil(int y, int m, int d) {
+    y -= m <= 2;
+    long long era = (y >= 0 ? y : y - 399) / 400;
+    long long yoe = y - era * 400;
+    long long doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    long long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+// "2025-12-06T00:00", "2025-12-06 00:00:00" albo czas unixowy
+double parseTime(Field f) {
+    f = trimmed(f);
+    size_t n = (size_t)(f.end - f.begin);
+    if (n < 10 || f.begin[4] != '-' || f.begin[7] != '-') return parseNumber(f);
+
+    const char* s = f.begin;
+    int y = parseInt(s, s + 4);
+    int mo = parseInt(s + 5, s + 7);
+    int d = parseInt(s + 8, s + 10);
+    int h = n >= 13 ? parseInt(s + 11, s + 13) : 0;
+    int mi = n >= 16 ? parseInt(s + 14, s + 16) : 0;
+    int sec = n >= 19 ? parseInt(s + 17, s + 19) : 0;
+    return (double)(daysFromCivil(y, mo, d) * 86400LL + h * 3600LL + mi * 60LL + sec);
+}
+
+enum class Quantity {
+    Ignore, Time, Altitude, WindU, WindV, WindSpeed, WindDirection,
+    Temperature, Humidity, Pressure, SurfacePressure, SeaLevelPressure, GeopotentialHeight
+};
+
+enum class LevelKind { None, Height, Pressure };
+
+struct Column {
+    Quantity quantity = Quantity::Ignore;
+    LevelKind kind = LevelKind::None;
+    double level = 0.0;       // [m nad gruntem] albo [hPa]
+    double scale = 1.0;       // przeliczenie na m/s, C, Pa, %
+    double offset = 0.0;
+};
+
+bool equals(const char* b, const char* e, const char* s) {
+    size_t n = strlen(s);
+    return (size_t)(e - b) == n && memcmp(b, s, n) == 0;
+}
+
+bool endsWith(const char* b, const char* e, const char* s) {
+    size_t n = strlen(s);
+    return (size_t)(e - b) >= n && memcmp(e - n, s, n) == 0;
+}
+
+// Nazwy kolumn open-meteo ("windspeed_10m (km/h)", "temperature_850hPa (C)")
+// oraz prostego profilu ("altitude,wind_u,wind_v,temperature,pressure,humidity")
+Column classifyColumn(Field f) {
+    f = trimmed(f);
+    const char* nameEnd = f.begin;
+    while (nameEnd < f.end && *nameEnd != ' ' && *nameEnd != '(') nameEnd++;
+    const char* unitBegin = nameEnd;
+    while (unitBegin < f.end && *unitBegin != '(') unitBegin++;
+    const char* unitEnd = unitBegin;
+    while (unitEnd < f.end && *unitEnd != ')') unitEnd++;
+    if (unitEnd < f.end) unitBegin++;
+    else unitBegin = unitEnd = nullptr;
+
+    Column c;
+    const char* b = f.begin;
+    const char* e = nameEnd;
+
+    // Sufiks poziomu: _10m albo _850hPa
+    const char* us = e;
+    while (us > b && us[-1] != '_') us--;
+    if (us > b) {
+        const char* digitsEnd = us;
+        while (digitsEnd < e && ((*digitsEnd >= '0' && *digitsEnd <= '9') || *digitsEnd == '.')) digitsEnd++;
+        if (digitsEnd > us) {
+            double level = 0.0;
+            from_chars(us, digitsEnd, level);
+            if (equals(digitsEnd, e, "m")) c.kind = LevelKind::Height;
+            else if (equals(digitsEnd, e, "hPa")) c.kind = LevelKind::Pressure;
+            if (c.kind != LevelKind::None) {
+                c.level = level;
+                e = us - 1;
+            }
+        }
+    }
+
+    if (equals(b, e, "time")) c.quantity = Quantity::Time;
+    else if (equals(b, e, "altitude") || equals(b, e, "height")) c.quantity = Quantity::Altitude;
+    else if (equals(b, e, "wind_u")) c.quantity = Quantity::WindU;
+    else if (equals(b, e, "wind_v")) c.quantity = Quantity::WindV;
+    else if (equals(b, e, "windspeed") || equals(b, e, "wind_speed")) c.quantity = Quantity::WindSpeed;
+    else if (equals(b, e, "winddirection") || equals(b, e, "wind_direction")) c.quantity = Quantity::WindDirection;
+    else if (equals(b, e, "temperature")) c.quantity = Quantity::Temperature;
+    else if (equals(b, e, "humidity") || equals(b, e, "relative_humidity") ||
+        equals(b, e, "relativehumidity")) c.quantity = Quantity::Humidity;
+    else if (equals(b, e, "pressure")) c.quantity = Quantity::Pressure;
+    else if (equals(b, e, "surface_pressure")) c.quantity = Quantity::SurfacePressure;
+    else if (equals(b, e, "pressure_msl")) c.quantity = Quantity::SeaLevelPressure;
+    else if (equals(b, e, "geopotential_height")) c.quantity = Quantity::GeopotentialHeight;
+
+    // Jednostki; bez jednostki: cisnienie powierzchniowe open-meteo w hPa, reszta w SI
+    if (c.quantity == Quantity::SurfacePressure || c.quantity == Quantity::SeaLevelPressure) c.scale = 100.0;
+    if (unitBegin) {
+        if (equals(unitBegin, unitEnd, "km/h")) c.scale = 1.0 / 3.6;
+        else if (equals(unitBegin, unitEnd, "mp/h") || equals(unitBegin, unitEnd, "mph")) c.scale = 0.44704;
+        else if (equals(unitBegin, unitEnd, "kn")) c.scale = 0.514444;
+        else if (equals(unitBegin, unitEnd, "hPa")) c.scale = 100.0;
+        else if (equals(unitBegin, unitEnd, "kPa")) c.scale = 1000.0;
+        else if (equals(unitBegin, unitEnd, "Pa")) c.scale = 1.0;
+        else if (endsWith(unitBegin, unitEnd, "F")) {
+            c.scale = 5.0 / 9.0;
+            c.offset = -32.0 * 5.0 / 9.0;
+        }
+    }
+    return c;
+}
+
+// Poziom wysokosciowy lub cisnieniowy: indeksy kolumn (-1 = brak)
+struct Level {
+    LevelKind kind;
+    double level;
+    int speed = -1, direction = -1;
+    int temperature = -1, humidity = -1, geopotential = -1;
+};
+
+Level& findLevel(vector<Level>& levels, LevelKind kind, double level) {
+    for (Level& l : levels) {
+        if (l.kind == kind && l.level == level) return l;
+    }
+    levels.push_back(Level{ kind, level });
+    return levels.back();
+}
+
+// Wysokosc w atmosferze standardowej dla cisnienia [Pa]
+double standardAltitude(double pressure) {
+    return 44330.8 * (1.0 - pow(pressure / 101325.0, 0.190263));
+}
+
+double standardTemperature(double altitude) {
+    return max(-56.5, 15.0 - kLapseRate * altitude);
+}
+
+} // namespace
+
 vector<WeatherSample> WeatherDataLoader::LoadCSV(const string& file) {
     vector<WeatherSample> samples;
 
-    ifstream f(file);
-    if (!f.is_open()) {
+    MappedFile mapped;
+    if (!mapped.open(file)) {
         cerr << "WeatherDataLoader: Nie mozna otworzyc pliku: " << file << "\n";
         return samples;
     }
 
-    string line;
+    const char* pos = mapped.data();
+    const char* end = pos + mapped.size();
+    vector<Field> fields;
+    Field line{ nullptr, nullptr };
 
-    if (!getline(f, line)) {
-        cerr << "WeatherDataLoader: Plik pusty\n";
-        return samples;
-    }
+    auto nextNonBlank = [&](Field& out) {
+        while (nextLine(pos, end, out)) {
+            if (!isBlank(out)) return true;
+        }
+        return false;
+    };
 
-    if (!getline(f, line)) {
-        cerr << "WeatherDataLoader: Brak linii z naglowkami\n";
+    if (!nextNonBlank(line)) {
+        cerr << "WeatherDataLoader: Plik pusty\n";
         return samples;
     }
 
-    int lineNum = 2;
-    int samplesLoaded = 0;
-
-    while (getline(f, line)) {
-        lineNum++;
-        if (line.empty()) continue;
-
-        stringstream ss(line);
-        string val;
-        WeatherSample s;
+    // Opcjonalny blok metadanych open-meteo: wysokosc punktu i przesuniecie czasu
+    double elevation = 0.0;
+    double utcOffset = 0.0;
+    splitFields(line, fields);
+    Field first = trimmed(fields[0]);
+    if (equals(first.begin, first.end, "latitude")) {
+        int elevCol = -1, offsetCol = -1;
+        for (size_t i = 0; i < fields.size(); i++) {
+            Field f = trimmed(fields[i]);
+            if (equals(f.begin, f.end, "elevation")) elevCol = (int)i;
+            else if (equals(f.begin, f.end, "utc_offset_seconds")) offsetCol = (int)i;
+        }
+        Field values;
+        if (nextLine(pos, end, values) && !isBlank(values)) {
+            splitFields(values, fields);
+            if (elevCol >= 0 && elevCol < (int)fields.size()) elevation = parseNumber(fields[elevCol]);
+            if (offsetCol >= 0 && offsetCol < (int)fields.size()) utcOffset = parseNumber(fields[offsetCol]);
+            if (std::isnan(elevation)) elevation = 0.0;
+            if (std::isnan(utcOffset)) utcOffset = 0.0;
+        }
+        // Eksport wielu lokalizacji: kolejne wiersze metadanych do pustej linii
+        while (nextLine(pos, end, values) && !isBlank(values)) {}
 
-        try {
-            getline(ss, val, ',');
-            if (val.empty()) continue;
+        if (!nextNonBlank(line)) {
+            cerr << "WeatherDataLoader: Brak linii z naglowkami\n";
+            return samples;
+        }
+        splitFields(line, fields);
+    }
 
-            getline(ss, val, ',');
-            double wind_speed_kmh = stod(val);
-            double wind_speed_ms = wind_speed_kmh * 1000.0 / 3600.0;
+    vector<Column> columns(fields.size());
+    for (size_t i = 0; i < fields.size(); i++) columns[i] = classifyColumn(fields[i]);
+
+    int timeCol = -1, altitudeCol = -1;
+    int windUCol = -1, windVCol = -1, speedCol = -1, directionCol = -1;
+    int tempCol = -1, humCol = -1, presCol = -1;
+    int surfacePresCol = -1, seaLevelPresCol = -1;
+    int surfaceTempCol = -1, surfaceHumCol = -1;
+    vector<Level> levels;
+
+    for (size_t i = 0; i < columns.size(); i++) {
+        const Column& c = columns[i];
+        int col = (int)i;
+        if (c.kind == LevelKind::None) {
+            switch (c.quantity) {
+            case Quantity::Time: timeCol = col; break;
+            case Quantity::Altitude: altitudeCol = col; break;
+            case Quantity::WindU: windUCol = col; break;
+            case Quantity::WindV: windVCol = col; break;
+            case Quantity::WindSpeed: speedCol = col; break;
+            case Quantity::WindDirection: directionCol = col; break;
+            case Quantity::Temperature: tempCol = col; break;
+            case Quantity::Humidity: humCol = col; break;
+            case Quantity::Pressure: presCol = col; break;
+            case Quantity::SurfacePressure: surfacePresCol = col; break;
+            case Quantity::SeaLevelPressure: seaLevelPresCol = col; break;
+            default: break;
+            }
+            continue;
+        }
 
-            getline(ss, val, ',');
-            double wind_dir_deg = stod(val);
+        if (c.quantity == Quantity::WindSpeed || c.quantity == Quantity::WindDirection ||
+            c.quantity == Quantity::GeopotentialHeight) {
+            Level& l = findLevel(levels, c.kind, c.level);
+            if (c.quantity == Quantity::WindSpeed) l.speed = col;
+            else if (c.quantity == Quantity::WindDirection) l.direction = col;
+            else l.geopotential = col;
+        }
+        else if (c.quantity == Quantity::Temperature || c.quantity == Quantity::Humidity) {
+            // Najnizszy poziom wysokosciowy sluzy jako warunek przy gruncie
+            int& surfaceCol = c.quantity == Quantity::Temperature ? surfaceTempCol : surfaceHumCol;
+            if (c.kind == LevelKind::Height &&
+                (surfaceCol < 0 || c.level < columns[surfaceCol].level)) surfaceCol = col;
+        }
+    }
 
-            double wind_dir_rad = wind_dir_deg * M_PI / 180.0;
-            s.wind_u = wind_speed_ms * sin(wind_dir_rad);
-            s.wind_v = wind_speed_ms * cos(wind_dir_rad);
+    // Temperatura i wilgotnosc przypisane do poziomow z wiatrem
+    for (size_t i = 0; i < columns.size(); i++) {
+        const Column& c = columns[i];
+        if (c.kind == LevelKind::None) continue;
+        if (c.quantity != Quantity::Temperature && c.quantity != Quantity::Humidity) continue;
+        for (Level& l : levels) {
+            if (l.kind != c.kind || l.level != c.level) continue;
+            if (c.quantity == Quantity::Temperature) l.temperature = (int)i;
+            else l.humidity = (int)i;
+        }
+    }
+    levels.erase(remove_if(levels.begin(), levels.end(),
+        [](const Level& l) { return l.speed < 0 || l.direction < 0; }), levels.end());
 
-            getline(ss, val, ',');
-            getline(ss, val, ',');
+    bool profileMode = altitudeCol >= 0;
+    bool usable = profileMode || !levels.empty();
+    if (!usable) {
+        cerr << "WeatherDataLoader: Brak rozpoznanych kolumn wysokosci ani poziomow wiatru\n";
+    }
+    else {
+        // Liczba wierszy z liczby znakow nowej linii - jedna rezerwacja zamiast wielu
+        size_t rows = 0;
+        for (const char* p = pos; p < end; p++) {
+            p = static_cast<const char*>(memchr(p, '\n', (size_t)(end - p)));
+            if (!p) break;
+            rows++;
+        }
+        samples.reserve((rows + 1) * (profileMode ? 1 : levels.size()));
+    }
 
-            getline(ss, val, ',');
-            s.temperature = stod(val);
+    vector<double> values(columns.size());
+    int lineNum = 0;
+    int skipped = 0;
 
-            getline(ss, val, ',');
-            s.humidity = stod(val);
+    while (usable && nextLine(pos, end, line)) {
+        lineNum++;
+        if (isBlank(line)) continue;
+        splitFields(line, fields);
+
+        for (size_t i = 0; i < columns.size(); i++) {
+            if (columns[i].quantity == Quantity::Ignore || (int)i == timeCol || i >= fields.size()) {
+                values[i] = NAN;
+                continue;
+            }
+            values[i] = parseNumber(fields[i]) * columns[i].scale + columns[i].offset;
+        }
+        double time = 0.0;
+        if (timeCol >= 0 && timeCol < (int)fields.size()) time = parseTime(fields[timeCol]) - utcOffset;
+        if (std::isnan(time)) {
+            skipped++;
+            continue;
+        }
 
-            getline(ss, val, ',');
-            s.pressure = stod(val) * 100.0;
+        auto value = [&](int col) { return col >= 0 ? values[col] : NAN; };
+        auto windFromPolar = [](double speed, double dirDeg, double& u, double& v) {
+            double dir = dirDeg * M_PI / 180.0;
+            u = speed * sin(dir);
+            v = speed * cos(dir);
+        };
+
+        if (profileMode) {
+            WeatherSample s;
+            s.altitude = value(altitudeCol);
+            s.wind_u = value(windUCol);
+            s.wind_v = value(windVCol);
+            if (std::isnan(s.wind_u) || std::isnan(s.wind_v)) {
+                windFromPolar(value(speedCol), value(directionCol), s.wind_u, s.wind_v);
+            }
+            s.temperature = value(tempCol);
+            if (std::isnan(s.temperature)) s.temperature = standardTemperature(s.altitude);
+            s.pressure = value(presCol);
+            if (std::isnan(s.pressure)) s.pressure = 101325.0 * exp(-s.altitude / 8500.0);
+            s.humidity = value(humCol);
+            if (std::isnan(s.humidity)) s.humidity = 0.0;
+            s.time = time;
+            if (std::isnan(s.altitude) || std::isnan(s.wind_u) || std::isnan(s.wind_v)) {
+                skipped++;
+                continue;
+            }
+            samples.push_back(s);
+            continue;
+        }
 
-            s.altitude = 1176.0;
+        // Warunki przy gruncie do uzupelnienia poziomow bez wlasnych kolumn
+        double surfaceLevel = surfaceTempCol >= 0 ? columns[surfaceTempCol].level : 2.0;
+        double surfaceTemp = value(surfaceTempCol);
+        if (std::isnan(surfaceTemp)) surfaceTemp = standardTemperature(elevation + surfaceLevel);
+        double surfaceHum = value(surfaceHumCol);
+        if (std::isnan(surfaceHum)) surfaceHum = 0.0;
+        double surfacePres = value(surfacePresCol);
+        if (std::isnan(surfacePres)) {
+            double msl = value(seaLevelPresCol);
+            double meanT = surfaceTemp + kLapseRate * 0.5 * elevation + 273.15;
+            surfacePres = std::isnan(msl) ? 101325.0 * exp(-elevation / 8500.0)
+                : msl * exp(-kGravity * elevation / (kGasConstant * meanT));
+        }
 
+        size_t rowBegin = samples.size();
+        for (const Level& l : levels) {
+            WeatherSample s;
+            windFromPolar(value(l.speed), value(l.direction), s.wind_u, s.wind_v);
+            if (std::isnan(s.wind_u) || std::isnan(s.wind_v)) continue;
+            s.temperature = value(l.temperature);
+            s.humidity = value(l.humidity);
+
+            if (l.kind == LevelKind::Height) {
+                s.altitude = elevation + l.level;
+                if (std::isnan(s.temperature)) {
+                    s.temperature = surfaceTemp - kLapseRate * (l.level - surfaceLevel);
+                }
+                // Rownanie hipsometryczne od cisnienia przy gruncie
+                double meanT = 0.5 * (surfaceTemp + s.temperature) + 273.15;
+                s.pressure = surfacePres * exp(-kGravity * l.level / (kGasConstant * meanT));
+            }
+            else {
+                s.pressure = l.level * 100.0;
+                s.altitude = value(l.geopotential);
+                if (std::isnan(s.altitude)) s.altitude = standardAltitude(s.pressure);
+                // Poziomy cisnieniowe pod powierzchnia terenu sa ekstrapolowane przez model
+                if (s.altitude < elevation) continue;
+                if (std::isnan(s.temperature)) s.temperature = standardTemperature(s.altitude);
+            }
+            if (std::isnan(s.humidity)) s.humidity = surfaceHum;
+            s.time = time;
             samples.push_back(s);
-            samplesLoaded++;
-
         }
-        catch (const exception& e) {
-            cerr << "WeatherDataLoader: Blad w linii " << lineNum
-                << ": " << e.what() << "\n";
+
+        if (samples.size() == rowBegin) {
+            skipped++;
             continue;
         }
+        sort(samples.begin() + rowBegin, samples.end(),
+            [](const WeatherSample& a, const WeatherSample& b) { return a.altitude < b.altitude; });
+    }
+
+    if (skipped > 0) {
+        cerr << "WeatherDataLoader: Pominieto " << skipped << " niepoprawnych wierszy\n";
     }
 
     if (samples.empty()) {
@@ -89,14 +465,18 @@ vector<WeatherSample> WeatherDataLoader::LoadCSV(const string& file) {
             ws.humidity = max(0.0, 50.0 - (altitude * 0.002));
             ws.wind_u = 2.0 + (altitude * 0.001);
             ws.wind_v = 1.0 + (altitude * 0.0005);
+            ws.time = 0.0;
             samples.push_back(ws);
         }
     }
     else {
-        sort(samples.begin(), samples.end(),
-            [](const WeatherSample& a, const WeatherSample& b) {
-                return a.altitude < b.altitude;
-            });
+        auto byTimeAltitude = [](const WeatherSample& a, const WeatherSample& b) {
+            return a.time < b.time || (a.time == b.time && a.altitude < b.altitude);
+        };
+        // Eksporty sa zwykle juz uporzadkowane w czasie - wtedy bez sortowania
+        if (!is_sorted(samples.begin(), samples.end(), byTimeAltitude)) {
+            stable_sort(samples.begin(), samples.end(), byTimeAltitude);
+        }
     }
 
     cout << "WeatherDataLoader: Zaladowano " << samples.size() << " probek pogodowych\n";
@@ -105,17 +485,20 @@ vector<WeatherSample> WeatherDataLoader::LoadCSV(const string& file) {
 
 WeatherSample Weather::interpolateForAltitude(double altitude) const {
     if (weatherProfile.empty()) {
-        return WeatherSample{ altitude, wind_u, wind_v, temperature, pressure, humidity };
+        return WeatherSample{ altitude, wind_u, wind_v, temperature, pressure, humidity, 0.0 };
     }
+    return interpolateProfile(weatherProfile, altitude);
+}
 
-    auto it_upper = lower_bound(weatherProfile.begin(), weatherProfile.end(), altitude,
+WeatherSample Weather::interpolateProfile(const vector<WeatherSample>& profile, double altitude) {
+    auto it_upper = lower_bound(profile.begin(), profile.end(), altitude,
         [](const WeatherSample& ws, double alt) { return ws.altitude < alt; });
 
-    if (it_upper == weatherProfile.begin()) {
+    if (it_upper == profile.begin()) {
         return *it_upper;
     }
-    if (it_upper == weatherProfile.end()) {
-        return weatherProfile.back();
+    if (it_upper == profile.end()) {
+        return profile.back();
     }
 
     auto it_lower = prev(it_upper);
@@ -135,6 +518,7 @@ WeatherSample Weather::interpolateForAltitude(double altitude) const {
     result.temperature = it_lower->temperature + t * (it_upper->temperature - it_lower->temperature);
     result.pressure = it_lower->pressure + t * (it_upper->pressure - it_lower->pressure);
     result.humidity = it_lower->humidity + t * (it_upper->humidity - it_lower->humidity);
+    result.time = it_lower->time;
 
     return result;
 }
@@ -148,28 +532,208 @@ Weather::Weather() {
     humidity = 50;
     turbulence = 0.1;
     currentAltitude = 0;
-    interpolatedWeather = WeatherSample{ 0, wind_u, wind_v, temperature, pressure, humidity };
+    tableStep = 10.0;
+    tableInvStep = 0.1;
+    tableMaxAltitude = 200000.0;
+    bakeCount = 0;
+    currentFrame = 0;
+    frameAlpha = 0.0;
+    playbackStart = 0.0;
+    interpolatedWeather = WeatherSample{ 0, wind_u, wind_v, temperature, pressure, humidity, 0.0 };
 }
 
 Weather::Weather(double alt, double u, double v, double temp, double pres, double hum, double turb)
-    : altitude(alt), wind_u(u), wind_v(v), temperature(temp),
-    pressure(pres), humidity(hum), turbulence(turb),
-    currentAltitude(alt) {
-    interpolatedWeather = WeatherSample{ alt, u, v, temp, pres, hum };
+    : currentAltitude(alt), currentFrame(0), frameAlpha(0.0), playbackStart(0.0),
+    tableStep(10.0), tableInvStep(0.1), tableMaxAltitude(200000.0), bakeCount(0),
+    altitude(alt), wind_u(u), wind_v(v), temperature(temp),
+    pressure(pres), humidity(hum), turbulence(turb) {
+    interpolatedWeather = WeatherSample{ alt, u, v, temp, pres, hum, 0.0 };
 }
 
 bool Weather::loadWeatherProfile(const string& csvFile) {
-    weatherProfile = WeatherDataLoader::LoadCSV(csvFile);
-    if (weatherProfile.empty()) {
+    vector<WeatherSample> samples = WeatherDataLoader::LoadCSV(csvFile);
+    if (samples.empty()) {
         cerr << "Weather: Nie udalo sie zaladowac profilu pogodowego\n";
         return false;
     }
 
+    // Probki sa posortowane (czas, wysokosc): kazdy znacznik czasu to ciagly
+    // zakres serii, wiec klatka jest tylko para indeksow
+    weatherSeries = std::move(samples);
+    frameTimes.clear();
+    frameStart.clear();
+    for (size_t i = 0; i < weatherSeries.size(); i++) {
+        if (i == 0 || weatherSeries[i].time != weatherSeries[i - 1].time) {
+            frameTimes.push_back(weatherSeries[i].time);
+            frameStart.push_back(i);
+        }
+    }
+    frameStart.push_back(weatherSeries.size());
+
+    playbackStart = frameTimes.front();
+    currentFrame = 0;
+    frameAlpha = 0.0;
+    weatherProfile = frameProfile(0);
+
     updateForAltitude(currentAltitude);
+    bakeAltitudeTable();
     cout << "Weather: Zaladowano profil pogodowy z " << weatherProfile.size() << " poziomami\n";
+    if (frameTimes.size() > 1) {
+        cout << "Weather: Seria czasowa " << frameTimes.size() << " klatek, "
+            << (frameTimes.back() - frameTimes.front()) / 3600.0 << " h\n";
+    }
     return true;
 }
 
+vector<WeatherSample> Weather::frameProfile(size_t frame) const {
+    return vector<WeatherSample>(weatherSeries.begin() + frameStart[frame],
+        weatherSeries.begin() + frameStart[frame + 1]);
+}
+
+void Weather::setPlaybackStart(double epochTime) {
+    playbackStart = epochTime;
+    if (!frameTimes.empty()) selectFrame(0.0, true);
+}
+
+void Weather::advanceTo(double simTime) {
+    if (frameTimes.size() < 2) return;
+    selectFrame(simTime, false);
+}
+
+void Weather::selectFrame(double simTime, bool force) {
+    double t = playbackStart + simTime;
+    size_t last = frameTimes.size() - 1;
+
+    bool inside = t >= frameTimes[currentFrame] &&
+        (currentFrame == last || t < frameTimes[currentFrame + 1]);
+    if (force || !inside) {
+        size_t frame = (size_t)(upper_bound(frameTimes.begin(), frameTimes.end(), t) - frameTimes.begin());
+        frame = frame == 0 ? 0 : min(frame - 1, last);
+
+        if (!force && frame == currentFrame + 1 && !altitudeTableNext.empty()) {
+            // Zwykle przejscie do nastepnej godziny: tablica k+1 staje sie tablica k,
+            // wypalana jest tylko nowa klatka k+1
+            swap(altitudeTable, altitudeTableNext);
+            weatherProfile = frameProfile(frame);
+            currentFrame = frame;
+            bakeNextTable();
+            bakeCount++;
+        }
+        else {
+            currentFrame = frame;
+            weatherProfile = frameProfile(frame);
+            bakeTable(weatherProfile, altitudeTable);
+            bakeNextTable();
+            bakeCount++;
+        }
+    }
+
+    if (currentFrame < last && !altitudeTableNext.empty()) {
+        double span = frameTimes[currentFrame + 1] - frameTimes[currentFrame];
+        frameAlpha = span > 0.0 ? min(max((t - frameTimes[currentFrame]) / span, 0.0), 1.0) : 0.0;
+    }
+    else {
+        frameAlpha = 0.0;
+    }
+}
+
+void Weather::bakeNextTable() {
+    if (currentFrame + 1 < frameTimes.size()) {
+        bakeTable(frameProfile(currentFrame + 1), altitudeTableNext);
+    }
+    else {
+        altitudeTableNext.clear();
+    }
+}
+
+double Weather::currentTime() const {
+    if (frameTimes.empty()) return 0.0;
+    if (currentFrame + 1 >= frameTimes.size()) return frameTimes[currentFrame];
+    return frameTimes[currentFrame] + frameAlpha * (frameTimes[currentFrame + 1] - frameTimes[currentFrame]);
+}
+
+void Weather::bakeAltitudeTable(double step, double maxAltitude) {
+    tableStep = step;
+    tableInvStep = 1.0 / step;
+    tableMaxAltitude = maxAltitude;
+    bakeTable(weatherProfile, altitudeTable);
+    if (frameTimes.size() > 1) bakeNextTable();
+    else altitudeTableNext.clear();
+    bakeCount++;
+}
+
+void Weather::bakeTable(const vector<WeatherSample>& profile, vector<AtmosphereSample>& table) const {
+    const double R = 287.05;
+    const double g = 9.80665;
+    const double lapseRate = 0.0065;       // [K/m] troposfera standardowa
+    const double tropopauseTemp = -56.5;   // [C]
+
+    double step = tableStep;
+    size_t n = (size_t)ceil(tableMaxAltitude / step) + 1;
+    table.resize(n);
+
+    double profileTop = profile.empty() ? 0.0 : profile.back().altitude;
+    double groundLevel = profile.empty() ? 0.0 : profile.front().altitude;
+    double temp = 0.0, pres = 0.0;
+
+    for (size_t i = 0; i < n; i++) {
+        double alt = i * step;
+        double wu, wv;
+
+        if (!profile.empty() && alt <= profileTop) {
+            WeatherSample ws = interpolateProfile(profile, alt);
+            wu = ws.wind_u;
+            wv = ws.wind_v;
+            temp = ws.temperature;
+            pres = ws.pressure;
+        }
+        else if (!profile.empty()) {
+            // Powyzej profilu: wiatr z ostatniego poziomu, temperatura wg gradientu
+            // standardowego do tropopauzy, cisnienie z rownania hipsometrycznego
+            wu = profile.back().wind_u;
+            wv = profile.back().wind_v;
+            double prevTemp = temp;
+            temp = max(tropopauseTemp, temp - lapseRate * step);
+            double meanT = 0.5 * (prevTemp + temp) + 273.15;
+            pres *= exp(-g * step / (R * meanT));
+        }
+        else {
+            wu = wind_u;
+            wv = wind_v;
+            temp = max(tropopauseTemp, 15.0 - alt * lapseRate);
+            pres = 101325.0 * exp(-alt / 8500.0);
+        }
+
+        AtmosphereSample& a = table[i];
+        a = turbulenceFor(alt, groundLevel, sqrt(wu * wu + wv * wv));
+        a.wind_u = (float)wu;
+        a.wind_v = (float)wv;
+        a.temperature = (float)temp;
+        a.pressure = (float)pres;
+        a.density = (float)(pres / (R * (temp + 273.15)));
+    }
+}
+
+AtmosphereSample Weather::turbulenceFor(double alt, double groundLevel, double windSpeed) const {
+    const double boundaryLayer = 1000.0;   // [m] nad najnizszym poziomem profilu
+    const double tauH = 200.0;             // [s] w warstwie granicznej
+    const double tauW = 50.0;              // [s]
+
+    // W warstwie granicznej natezenie rosnie z predkoscia wiatru (scinanie);
+    // powyzej maleje do 30% w ciagu kolejnych 2 km, a skale czasu sie wydluzaja
+    double above = alt - groundLevel;
+    double layer = above <= boundaryLayer ? 1.0
+        : max(0.3, 1.0 - 0.35 * (above - boundaryLayer) / 1000.0);
+    double sigmaH = turbulence * (0.5 + 0.1 * windSpeed) * layer;
+
+    AtmosphereSample a{};
+    a.sigma_h = (float)sigmaH;
+    a.sigma_w = (float)(0.6 * sigmaH);
+    a.tau_h = (float)(tauH / layer);
+    a.tau_w = (float)(tauW / layer);
+    return a;
+}
+
 void Weather::updateForAltitude(double alt) {
     if (alt < 0) alt = 0;
     if (alt > 20000) alt = 20000;
@@ -0,0 +1,206 @@
+#include "../include/wind_field.h"
+#include <iostream>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+WindField::WindField()
+    : loaded_(false), nx_(0), ny_(0), nz_(0), nt_(0),
+    x0_(0), y0_(0), dx_(1), dy_(1), z0_(0), dz_(1), t0_(0), dt_(1),
+    dataOffset_(0), frameIndex_(0), alpha_(0.0),
+    requested_(-1), ready_(-1), readOk_(true), stop_(false) {
+}
+
+WindField::~WindField() {
+    close();
+}
+
+void WindField::close() {
+    {
+        lock_guard<mutex> lk(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (worker_.joinable()) worker_.join();
+    if (file_.is_open()) file_.close();
+    loaded_ = false;
+    frameA_.clear();
+    frameB_.clear();
+    back_.clear();
+}
+
+bool WindField::open(const string& path) {
+    close();
+
+    file_.open(path, ios::binary);
+    if (!file_.is_open()) {
+        cerr << "WindField: nie mozna otworzyc pliku: " << path << "\n";
+        return false;
+    }
+
+    char magic[4];
+    int32_t dims[4];
+    double geo[8];
+    file_.read(magic, 4);
+    file_.read(reinterpret_cast<char*>(dims), sizeof(dims));
+    file_.read(reinterpret_cast<char*>(geo), sizeof(geo));
+    if (!file_ || memcmp(magic, "VWF1", 4) != 0) {
+        cerr << "WindField: niepoprawny naglowek pliku: " << path << "\n";
+        file_.close();
+        return false;
+    }
+
+    nx_ = dims[0]; ny_ = dims[1]; nz_ = dims[2]; nt_ = dims[3];
+    x0_ = geo[0]; y0_ = geo[1]; dx_ = geo[2]; dy_ = geo[3];
+    z0_ = geo[4]; dz_ = geo[5]; t0_ = geo[6]; dt_ = geo[7];
+    if (nx_ < 2 || ny_ < 2 || nz_ < 2 || nt_ < 1 || dx_ == 0.0 || dy_ == 0.0 || dz_ <= 0.0 || dt_ <= 0.0) {
+        cerr << "WindField: niepoprawne wymiary siatki\n";
+        file_.close();
+        return false;
+    }
+    dataOffset_ = file_.tellg();
+
+    // Dwie pierwsze klatki synchronicznie, kolejne juz w tle
+    if (!readFrame(0, frameA_) || (nt_ > 1 && !readFrame(1, frameB_))) {
+        cerr << "WindField: blad odczytu pierwszych klatek\n";
+        file_.close();
+        return false;
+    }
+    frameIndex_ = 0;
+    alpha_ = 0.0;
+    requested_ = -1;
+    ready_ = -1;
+    stop_ = false;
+    loaded_ = true;
+
+    worker_ = thread(&WindField::workerLoop, this);
+    if (nt_ > 2) requestFrame(2);
+
+    cout << "WindField: wczytano naglowek " << path << "\n";
+    cout << "  Siatka: " << nx_ << " x " << ny_ << " x " << nz_ << ", klatek: " << nt_
+        << " co " << dt_ << " s\n";
+    return true;
+}
+
+bool WindField::readFrame(int index, vector<GridPoint>& out) {
+    size_t points = (size_t)nx_ * ny_ * nz_;
+    out.resize(points);
+    file_.clear();
+    file_.seekg(dataOffset_ + (streamoff)index * (streamoff)(points * sizeof(GridPoint)));
+    file_.read(reinterpret_cast<char*>(out.data()), (streamsize)(points * sizeof(GridPoint)));
+    return (bool)file_;
+}
+
+void WindField::requestFrame(int index) {
+    {
+        lock_guard<mutex> lk(mutex_);
+        requested_ = index;
+        ready_ = -1;
+    }
+    cv_.notify_all();
+}
+
+void WindField::workerLoop() {
+    for (;;) {
+        int index;
+        {
+            unique_lock<mutex> lk(mutex_);
+            cv_.wait(lk, [this] { return stop_ || requested_ >= 0; });
+            if (stop_) return;
+            index = requested_;
+            requested_ = -1;
+        }
+        // back_ nalezy do watku w tle od zlecenia do zgloszenia gotowosci
+        bool ok = readFrame(index, back_);
+        {
+            lock_guard<mutex> lk(mutex_);
+            ready_ = index;
+            readOk_ = ok;
+        }
+        cv_.notify_all();
+    }
+}
+
+void WindField::advanceTo(double simTime) {
+    if (!loaded_) return;
+
+    double pos = (simTime - t0_) / dt_;
+    int target = (int)floor(pos);
+    target = min(max(target, 0), nt_ - 1);
+
+    while (frameIndex_ < target) {
+        int incoming = frameIndex_ + 2;
+        if (incoming < nt_) {
+            // Zwykle klatka jest juz gotowa; czekamy tylko gdy dysk nie nadaza
+            unique_lock<mutex> lk(mutex_);
+            cv_.wait(lk, [&] { return ready_ == incoming; });
+            if (!readOk_) {
+                // Nieudana klatka nie trafia do interpolacji: pole jest wylaczane,
+                // a czastki wracaja do profilu pionowego (sample zwraca false)
+                cerr << "WindField: blad odczytu klatki " << incoming << " - pole wiatru wylaczone\n";
+                loaded_ = false;
+                return;
+            }
+            lk.unlock();
+            swap(frameA_, frameB_);
+            swap(frameB_, back_);
+        }
+        else {
+            swap(frameA_, frameB_);
+        }
+        frameIndex_++;
+        if (frameIndex_ + 2 < nt_) requestFrame(frameIndex_ + 2);
+    }
+
+    if (frameIndex_ + 1 < nt_) alpha_ = min(max(pos - frameIndex_, 0.0), 1.0);
+    else alpha_ = 0.0;
+}
+
+bool WindField::sample(double x, double y, double z,
+    double& out_u, double& out_v, double& out_w,
+    double& out_temp, double& out_pres) const {
+    if (!loaded_) return false;
+
+    double fi = (x - x0_) / dx_;
+    double fj = (y - y0_) / dy_;
+    double fk = (z - z0_) / dz_;
+    if (fi < 0.0 || fj < 0.0 || fk < 0.0 ||
+        fi > nx_ - 1 || fj > ny_ - 1 || fk > nz_ - 1) return false;
+
+    int i = min((int)fi, nx_ - 2);
+    int j = min((int)fj, ny_ - 2);
+    int k = min((int)fk, nz_ - 2);
+    double tx = fi - i, ty = fj - j, tz = fk - k;
+
+    bool blend = alpha_ > 0.0 && !frameB_.empty();
+    double acc[5] = { 0, 0, 0, 0, 0 };
+    for (int c = 0; c < 8; c++) {
+        int di = c & 1, dj = (c >> 1) & 1, dk = (c >> 2) & 1;
+        double wgt = (di ? tx : 1.0 - tx) * (dj ? ty : 1.0 - ty) * (dk ? tz : 1.0 - tz);
+        size_t idx = ((size_t)(k + dk) * ny_ + (j + dj)) * nx_ + (i + di);
+        const GridPoint& a = frameA_[idx];
+        double u = a.u, v = a.v, w = a.w, t = a.temperature, p = a.pressure;
+        if (blend) {
+            const GridPoint& b = frameB_[idx];
+            u += alpha_ * (b.u - u);
+            v += alpha_ * (b.v - v);
+            w += alpha_ * (b.w - w);
+            t += alpha_ * (b.temperature - t);
+            p += alpha_ * (b.pressure - p);
+        }
+        acc[0] += wgt * u;
+        acc[1] += wgt * v;
+        acc[2] += wgt * w;
+        acc[3] += wgt * t;
+        acc[4] += wgt * p;
+    }
+
+    out_u = acc[0];
+    out_v = acc[1];
+    out_w = acc[2];
+    out_temp = acc[3];
+    out_pres = acc[4];
+    return true;
+}